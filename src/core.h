@@ -14,6 +14,9 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
 
 // --------------------------------------------------------------------------
 //
@@ -114,6 +117,7 @@
 
 // Includes, now that we know what we're targetting.
 #if COMPILER_MSVC
+#include <malloc.h>
 #include <math.h>
 #include <intrin.h>
 #include <windows.h>
@@ -124,6 +128,22 @@
 #include <semaphore.h>
 #include <sys/time.h>
 #include <time.h>
+#endif
+
+#if CPU_X86 && (COMPILER_GCC || COMPILER_CLANG)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#if PLATFORM_OSX
+#include <mach/mach_time.h>
+#endif
+
+#if PLATFORM_LINUX
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #elif PLATFORM_WINDOWS
 #include <limits.h>
 #include <windows.h>  // NOLINT(build/include)
@@ -166,6 +186,7 @@ char (&COUNTOF_REQUIRES_ARRAY_ARGUMENT(const T (&)[N]))[N];  // NOLINT
 #define NO_INLINE __attribute__((noinline))
 #define NO_RETURN __attribute__((noreturn))
 #define NO_VTABLE
+#define THREAD __thread
 #elif COMPILER_MSVC
 #define ALIGN_STRUCT(_align, struct) __declspec(align(_align)) struct
 #define ALLOW_UNUSED
@@ -261,62 +282,112 @@ char (&COUNTOF_REQUIRES_ARRAY_ARGUMENT(const T (&)[N]))[N];  // NOLINT
 //
 // --------------------------------------------------------------------------
 
-#if COMPILER_MSVC
-extern "C" void _ReadBarrier();
-extern "C" void _WriteBarrier();
-extern "C" void _ReadWriteBarrier();
-#pragma intrinsic(_ReadBarrier)
-#pragma intrinsic(_WriteBarrier)
-#pragma intrinsic(_ReadWriteBarrier)
-#pragma intrinsic(_InterlockedIncrement)
-#pragma intrinsic(_InterlockedDecrement)
-#endif
-
+// Compiler-only barriers, which stop the compiler moving memory accesses
+// across them, but not the CPU.
 inline void ReadBarrier() {
-#if COMPILER_MSVC
-  _ReadBarrier();
-#elif COMPILER_GCC || COMPILER_CLANG
-  asm volatile("" ::: "memory");
-#endif
+  std::atomic_signal_fence(std::memory_order_acquire);
 }
 
 inline void WriteBarrier() {
-#if COMPILER_MSVC
-  _WriteBarrier();
-#elif COMPILER_GCC || COMPILER_CLANG
-  asm volatile("" ::: "memory");
-#endif
+  std::atomic_signal_fence(std::memory_order_release);
 }
 
 inline void ReadWriteBarrier() {
-#if COMPILER_MSVC
-  _ReadWriteBarrier();
-#elif COMPILER_GCC || COMPILER_CLANG
-  asm volatile("" ::: "memory");
-#endif
+  std::atomic_signal_fence(std::memory_order_acq_rel);
 }
 
+// A full fence, for the CPU too.
 inline void MemBarrier() {
-#if COMPILER_MSVC
-  _mm_mfence();
-#else
-  __sync_synchronize();
-#endif
+  std::atomic_thread_fence(std::memory_order_seq_cst);
 }
 
+// A value that's read and written from more than one thread. Every operation
+// takes the ordering it needs, which defaults to sequentially consistent, so
+// that the ones on hot paths can say they need less.
+//
+// T can be an integer up to 64 bits, or a pointer, which are lock-free on
+// everything that's targetted. The read-modify-write operations return the
+// value from before, except Increment() and Decrement(), which return the
+// value after, as ref-counting wants.
+template <typename T>
+class Atomic {
+ public:
+  Atomic() : value_(T()) {}
+  explicit Atomic(T value) : value_(value) {}
+
+  T Load(std::memory_order order = std::memory_order_seq_cst) const {
+    return value_.load(order);
+  }
+
+  void Store(T value, std::memory_order order = std::memory_order_seq_cst) {
+    value_.store(value, order);
+  }
+
+  T Exchange(T value, std::memory_order order = std::memory_order_seq_cst) {
+    return value_.exchange(value, order);
+  }
+
+  // Replaces the value with |desired| and returns true if it's |*expected|.
+  // Otherwise returns false and sets |*expected| to what it was instead, for
+  // the next try around a loop. Never fails spuriously.
+  bool CompareExchange(T* expected,
+                       T desired,
+                       std::memory_order order = std::memory_order_seq_cst) {
+    return value_.compare_exchange_strong(
+        *expected, desired, order, FailureOrder(order));
+  }
+
+  // For pointers, |delta| is in elements, as with pointer arithmetic.
+  template <typename D>
+  T FetchAdd(D delta, std::memory_order order = std::memory_order_seq_cst) {
+    return value_.fetch_add(delta, order);
+  }
+
+  template <typename D>
+  T FetchSub(D delta, std::memory_order order = std::memory_order_seq_cst) {
+    return value_.fetch_sub(delta, order);
+  }
+
+  T Increment(std::memory_order order = std::memory_order_seq_cst) {
+    return value_.fetch_add(1, order) + 1;
+  }
+
+  T Decrement(std::memory_order order = std::memory_order_seq_cst) {
+    return value_.fetch_sub(1, order) - 1;
+  }
+
+ private:
+  // The failure ordering of a compare-exchange can't be a release.
+  static std::memory_order FailureOrder(std::memory_order order) {
+    if (order == std::memory_order_release)
+      return std::memory_order_relaxed;
+    if (order == std::memory_order_acq_rel)
+      return std::memory_order_acquire;
+    return order;
+  }
+
+  std::atomic<T> value_;
+
+  DISALLOW_COPY_AND_ASSIGN(Atomic);
+};
+
+// Full-barrier operations on plain memory, for where an Atomic<> can't be
+// used. Both return the value from before, with every compiler.
 inline int32_t AtomicIncr(volatile void* var) {
 #if COMPILER_MSVC
-  return _InterlockedIncrement(reinterpret_cast<volatile LONG*>(var));
+  return _InterlockedIncrement(reinterpret_cast<volatile LONG*>(var)) - 1;
 #elif COMPILER_GCC || COMPILER_CLANG
-  return __sync_fetch_and_add(reinterpret_cast<volatile int32_t*>(var), 1);
+  return __atomic_fetch_add(
+      reinterpret_cast<volatile int32_t*>(var), 1, __ATOMIC_SEQ_CST);
 #endif
 }
 
 inline int32_t AtomicDecr(volatile void* var) {
 #if COMPILER_MSVC
-  return _InterlockedDecrement(reinterpret_cast<volatile LONG*>(var));
+  return _InterlockedDecrement(reinterpret_cast<volatile LONG*>(var)) + 1;
 #elif COMPILER_GCC || COMPILER_CLANG
-  return __sync_fetch_and_sub(reinterpret_cast<volatile int32_t*>(var), 1);
+  return __atomic_fetch_sub(
+      reinterpret_cast<volatile int32_t*>(var), 1, __ATOMIC_SEQ_CST);
 #endif
 }
 
@@ -324,7 +395,7 @@ inline void* AtomicExchangePtr(void** _target, void* ptr) {
 #if COMPILER_MSVC
   return InterlockedExchangePointer(_target, ptr);
 #elif COMPILER_GCC || COMPILER_CLANG
-  return __sync_lock_test_and_set(_target, ptr);
+  return __atomic_exchange_n(_target, ptr, __ATOMIC_SEQ_CST);
 #endif
 }
 
@@ -334,31 +405,130 @@ inline void* AtomicExchangePtr(void** _target, void* ptr) {
 //
 // --------------------------------------------------------------------------
 
+// A monotonic clock, counting at GetHPFrequency() ticks a second, which is a
+// nanosecond or better everywhere but Windows, where it's whatever
+// QueryPerformanceCounter() manages, usually 100ns.
 inline int64_t GetHPCounter() {
 #if PLATFORM_WINDOWS
   LARGE_INTEGER li;
   // Performance counter value may unexpectedly leap forward
   // http://support.microsoft.com/kb/274323
   QueryPerformanceCounter(&li);
-  int64_t i64 = li.QuadPart;
+  return li.QuadPart;
+#elif PLATFORM_OSX
+  return static_cast<int64_t>(mach_absolute_time());
 #else
-  struct timeval now;
-  gettimeofday(&now, 0);
-  int64_t i64 = now.tv_sec * INT64_C(1000000) + now.tv_usec;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * INT64_C(1000000000) + now.tv_nsec;
 #endif
-  return i64;
 }
 
 inline int64_t GetHPFrequency() {
 #if PLATFORM_WINDOWS
-  LARGE_INTEGER li;
-  QueryPerformanceFrequency(&li);
-  return li.QuadPart;
+  static const int64_t frequency = [] {
+    LARGE_INTEGER li;
+    QueryPerformanceFrequency(&li);
+    return li.QuadPart;
+  }();
+  return frequency;
+#elif PLATFORM_OSX
+  static const int64_t frequency = [] {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return INT64_C(1000000000) * timebase.denom / timebase.numer;
+  }();
+  return frequency;
+#else
+  return INT64_C(1000000000);
+#endif
+}
+
+// Converts between |ticks| at |frequency| a second and nanoseconds, without
+// overflowing for anything short of centuries.
+inline int64_t TicksToNanoseconds(int64_t ticks, int64_t frequency) {
+  return ticks / frequency * INT64_C(1000000000) +
+         ticks % frequency * INT64_C(1000000000) / frequency;
+}
+
+inline int64_t NanosecondsToTicks(int64_t nanoseconds, int64_t frequency) {
+  return nanoseconds / INT64_C(1000000000) * frequency +
+         nanoseconds % INT64_C(1000000000) * frequency / INT64_C(1000000000);
+}
+
+inline int64_t HPCounterToNanoseconds(int64_t ticks) {
+  return TicksToNanoseconds(ticks, GetHPFrequency());
+}
+
+inline int64_t NanosecondsToHPCounter(int64_t nanoseconds) {
+  return NanosecondsToTicks(nanoseconds, GetHPFrequency());
+}
+
+inline int64_t GetMonotonicNanoseconds() {
+  return HPCounterToNanoseconds(GetHPCounter());
+}
+
+// Whether the CPU's timestamp counter runs at a constant rate whatever the
+// power state, and in step across cores, so that it can be used as a clock.
+inline bool HasInvariantTSC() {
+#if CPU_X86
+  static const bool invariant = [] {
+    int registers[4];
+#if COMPILER_MSVC
+    __cpuid(registers, 0x80000000);
+    if (static_cast<unsigned>(registers[0]) < 0x80000007)
+      return false;
+    __cpuid(registers, 0x80000007);
+#else
+    unsigned eax, ebx, ecx, edx;
+    __cpuid(0x80000000, eax, ebx, ecx, edx);
+    if (eax < 0x80000007)
+      return false;
+    __cpuid(0x80000007, eax, ebx, ecx, edx);
+    registers[3] = static_cast<int>(edx);
+#endif
+    return (registers[3] & (1 << 8)) != 0;
+  }();
+  return invariant;
 #else
-  return INT64_C(1000000);
+  return false;
 #endif
 }
 
+// A cheaper clock for timing hot paths, which is the timestamp counter where
+// it can be used, and otherwise the same as GetHPCounter(). Either way, it
+// counts at GetCycleCounterFrequency() ticks a second.
+inline int64_t GetCycleCounter() {
+#if CPU_X86
+  if (HasInvariantTSC())
+    return static_cast<int64_t>(__rdtsc());
+#endif
+  return GetHPCounter();
+}
+
+// The first call measures the timestamp counter against GetHPCounter() for a
+// few milliseconds.
+inline int64_t GetCycleCounterFrequency() {
+  static const int64_t frequency = [] {
+    if (!HasInvariantTSC())
+      return GetHPFrequency();
+    const int64_t kCalibrationNanoseconds = 10000000;
+    int64_t hp_start = GetHPCounter();
+    int64_t cycles_start = GetCycleCounter();
+    int64_t elapsed;
+    do {
+      elapsed = HPCounterToNanoseconds(GetHPCounter() - hp_start);
+    } while (elapsed < kCalibrationNanoseconds);
+    int64_t cycles = GetCycleCounter() - cycles_start;
+    return cycles * INT64_C(1000000000) / elapsed;
+  }();
+  return frequency;
+}
+
+inline int64_t CyclesToNanoseconds(int64_t cycles) {
+  return TicksToNanoseconds(cycles, GetCycleCounterFrequency());
+}
+
 // --------------------------------------------------------------------------
 //
 // Debug.
@@ -440,4 +610,528 @@ inline void DebugPrintf(const char* format, ...) {
   va_end(arg_list);
 }
 
+// For things aligned more than new would see to before C++17, such as those
+// with CACHE_LINE_ALIGN members. |alignment| is a power of two.
+inline void* AlignedAlloc(size_t size, size_t alignment) {
+#if COMPILER_MSVC
+  return _aligned_malloc(size, alignment);
+#else
+  void* result = NULL;
+  if (alignment < sizeof(void*))
+    alignment = sizeof(void*);
+  if (posix_memalign(&result, alignment, size) != 0)
+    return NULL;
+  return result;
+#endif
+}
+
+inline void AlignedFree(void* pointer) {
+#if COMPILER_MSVC
+  _aligned_free(pointer);
+#else
+  free(pointer);
+#endif
+}
+
+// --------------------------------------------------------------------------
+//
+// Threading.
+//
+// --------------------------------------------------------------------------
+
+// Timeouts are in milliseconds, and negative ones never run out.
+
+#if PLATFORM_LINUX
+static_assert(sizeof(Atomic<int32_t>) == sizeof(int32_t),
+              "futexes need a plain int32_t");
+
+// Sleeps while |*word| is |expected|, and until woken. Returns false if
+// |msecs| ran out first, but can also return early for no reason, so the
+// caller has to check again either way.
+inline bool FutexWait(Atomic<int32_t>* word, int32_t expected, int32_t msecs) {
+  struct timespec timeout;
+  if (msecs >= 0) {
+    timeout.tv_sec = msecs / 1000;
+    timeout.tv_nsec = (msecs % 1000) * 1000000;
+  }
+  return syscall(SYS_futex,
+                 reinterpret_cast<int32_t*>(word),
+                 FUTEX_WAIT_PRIVATE,
+                 expected,
+                 msecs >= 0 ? &timeout : NULL,
+                 NULL,
+                 0) == 0 ||
+         errno != ETIMEDOUT;
+}
+
+inline void FutexWake(Atomic<int32_t>* word, int32_t count) {
+  syscall(SYS_futex,
+          reinterpret_cast<int32_t*>(word),
+          FUTEX_WAKE_PRIVATE,
+          count,
+          NULL,
+          NULL,
+          0);
+}
+#endif  // PLATFORM_LINUX
+
+#if PLATFORM_POSIX
+// How much of a |msecs| timeout that started at |start| is left, or -1 if it
+// was never going to run out.
+inline int32_t RemainingMsecs(int64_t start, int32_t msecs) {
+  if (msecs < 0)
+    return -1;
+  int64_t left = start + msecs - GetMonotonicNanoseconds() / 1000000;
+  return left > 0 ? static_cast<int32_t>(left) : 0;
+}
+#endif  // PLATFORM_POSIX
+
+#if PLATFORM_OSX
+// Waits on |cond| for up to |msecs|, which has to be >= 0, though it can
+// return early for no reason.
+inline void CondTimedWait(pthread_cond_t* cond,
+                          pthread_mutex_t* mutex,
+                          int32_t msecs) {
+  struct timespec timeout;
+  timeout.tv_sec = msecs / 1000;
+  timeout.tv_nsec = (msecs % 1000) * 1000000;
+  pthread_cond_timedwait_relative_np(cond, mutex, &timeout);
+}
+#endif  // PLATFORM_OSX
+
+// A non-recursive lock. Uncontended, locking and unlocking are an atomic
+// operation each, with no system call.
+class Mutex {
+ public:
+#if PLATFORM_LINUX
+  Mutex() {}
+  ~Mutex() {}
+
+  void Lock() {
+    // From "Futexes Are Tricky". |state_| is 0 when unlocked, 1 when locked,
+    // and 2 when there might be someone waiting too.
+    int32_t state = 0;
+    if (state_.CompareExchange(&state, 1, std::memory_order_acquire))
+      return;
+    if (state != 2)
+      state = state_.Exchange(2, std::memory_order_acquire);
+    while (state != 0) {
+      FutexWait(&state_, 2, -1);
+      state = state_.Exchange(2, std::memory_order_acquire);
+    }
+  }
+
+  bool TryLock() {
+    int32_t state = 0;
+    return state_.CompareExchange(&state, 1, std::memory_order_acquire);
+  }
+
+  void Unlock() {
+    if (state_.FetchSub(1, std::memory_order_release) != 1) {
+      state_.Store(0, std::memory_order_release);
+      FutexWake(&state_, 1);
+    }
+  }
+#elif PLATFORM_OSX
+  Mutex() { pthread_mutex_init(&mutex_, NULL); }
+  ~Mutex() { pthread_mutex_destroy(&mutex_); }
+  void Lock() { pthread_mutex_lock(&mutex_); }
+  bool TryLock() { return pthread_mutex_trylock(&mutex_) == 0; }
+  void Unlock() { pthread_mutex_unlock(&mutex_); }
+#elif PLATFORM_WINDOWS
+  Mutex() { InitializeSRWLock(&lock_); }
+  ~Mutex() {}
+  void Lock() { AcquireSRWLockExclusive(&lock_); }
+  bool TryLock() { return TryAcquireSRWLockExclusive(&lock_) != 0; }
+  void Unlock() { ReleaseSRWLockExclusive(&lock_); }
+#endif
+
+ private:
+#if PLATFORM_LINUX
+  Atomic<int32_t> state_;
+#elif PLATFORM_OSX
+  pthread_mutex_t mutex_;
+#elif PLATFORM_WINDOWS
+  SRWLOCK lock_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(Mutex);
+};
+
+// Holds |mutex| for as long as it's in scope.
+class MutexScope {
+ public:
+  explicit MutexScope(Mutex* mutex) : mutex_(mutex) { mutex_->Lock(); }
+  ~MutexScope() { mutex_->Unlock(); }
+
+ private:
+  Mutex* mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(MutexScope);
+};
+
+// A counting semaphore. Posting only makes a system call when something is
+// waiting, and waiting only when the count is 0.
+class Semaphore {
+ public:
+#if PLATFORM_LINUX
+  Semaphore() {}
+  ~Semaphore() {}
+
+  void Post(int32_t count = 1) {
+    // Sequentially consistent, as is adding to |waiters_| in Wait(), so that
+    // either this sees the waiter, or the waiter sees the new count.
+    count_.FetchAdd(count);
+    if (waiters_.Load() > 0)
+      FutexWake(&count_, count);
+  }
+
+  // Returns false if |msecs| ran out before the count could be taken from.
+  bool Wait(int32_t msecs = -1) {
+    int64_t start = msecs > 0 ? GetMonotonicNanoseconds() / 1000000 : 0;
+    for (;;) {
+      int32_t count = count_.Load(std::memory_order_relaxed);
+      while (count > 0) {
+        if (count_.CompareExchange(
+                &count, count - 1, std::memory_order_acquire))
+          return true;
+      }
+      int32_t remaining = RemainingMsecs(start, msecs);
+      if (remaining == 0)
+        return false;
+      waiters_.Increment();
+      FutexWait(&count_, 0, remaining);
+      waiters_.Decrement(std::memory_order_relaxed);
+    }
+  }
+#elif PLATFORM_OSX
+  // macOS doesn't have unnamed POSIX semaphores.
+  Semaphore() : count_(0) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+  ~Semaphore() {
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void Post(int32_t count = 1) {
+    pthread_mutex_lock(&mutex_);
+    count_ += count;
+    pthread_mutex_unlock(&mutex_);
+    for (int32_t i = 0; i < count; ++i)
+      pthread_cond_signal(&cond_);
+  }
+
+  bool Wait(int32_t msecs = -1) {
+    pthread_mutex_lock(&mutex_);
+    bool ok = true;
+    if (msecs < 0) {
+      while (count_ == 0)
+        pthread_cond_wait(&cond_, &mutex_);
+    } else {
+      // Each wait is only for what's left, as it can wake up early.
+      int64_t start = GetMonotonicNanoseconds() / 1000000;
+      int32_t remaining = msecs;
+      while (count_ == 0 && remaining > 0) {
+        CondTimedWait(&cond_, &mutex_, remaining);
+        remaining = RemainingMsecs(start, msecs);
+      }
+      ok = count_ > 0;
+    }
+    if (ok)
+      --count_;
+    pthread_mutex_unlock(&mutex_);
+    return ok;
+  }
+#elif PLATFORM_WINDOWS
+  Semaphore() { handle_ = CreateSemaphore(NULL, 0, LONG_MAX, NULL); }
+  ~Semaphore() { CloseHandle(handle_); }
+
+  void Post(int32_t count = 1) { ReleaseSemaphore(handle_, count, NULL); }
+
+  bool Wait(int32_t msecs = -1) {
+    return WaitForSingleObject(handle_, msecs < 0 ? INFINITE : msecs) ==
+           WAIT_OBJECT_0;
+  }
+#endif
+
+ private:
+#if PLATFORM_LINUX
+  Atomic<int32_t> count_;
+  Atomic<int32_t> waiters_;
+#elif PLATFORM_OSX
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  int32_t count_;
+#elif PLATFORM_WINDOWS
+  HANDLE handle_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(Semaphore);
+};
+
+// An auto-reset event: Set() lets exactly one Wait() through, either one
+// that's already waiting or the next to come along, and setting it again
+// before then does nothing.
+class Event {
+ public:
+#if PLATFORM_LINUX
+  Event() {}
+  ~Event() {}
+
+  void Set() {
+    // As Semaphore::Post().
+    set_.Store(1);
+    if (waiters_.Load() > 0)
+      FutexWake(&set_, 1);
+  }
+
+  // Returns false if |msecs| ran out before the event was set.
+  bool Wait(int32_t msecs = -1) {
+    int64_t start = msecs > 0 ? GetMonotonicNanoseconds() / 1000000 : 0;
+    for (;;) {
+      int32_t set = 1;
+      if (set_.CompareExchange(&set, 0, std::memory_order_acquire))
+        return true;
+      int32_t remaining = RemainingMsecs(start, msecs);
+      if (remaining == 0)
+        return false;
+      waiters_.Increment();
+      FutexWait(&set_, 0, remaining);
+      waiters_.Decrement(std::memory_order_relaxed);
+    }
+  }
+#elif PLATFORM_OSX
+  Event() : set_(false) {
+    pthread_mutex_init(&mutex_, NULL);
+    pthread_cond_init(&cond_, NULL);
+  }
+  ~Event() {
+    pthread_cond_destroy(&cond_);
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  void Set() {
+    pthread_mutex_lock(&mutex_);
+    set_ = true;
+    pthread_mutex_unlock(&mutex_);
+    pthread_cond_signal(&cond_);
+  }
+
+  bool Wait(int32_t msecs = -1) {
+    pthread_mutex_lock(&mutex_);
+    if (msecs < 0) {
+      while (!set_)
+        pthread_cond_wait(&cond_, &mutex_);
+    } else {
+      // As Semaphore::Wait().
+      int64_t start = GetMonotonicNanoseconds() / 1000000;
+      int32_t remaining = msecs;
+      while (!set_ && remaining > 0) {
+        CondTimedWait(&cond_, &mutex_, remaining);
+        remaining = RemainingMsecs(start, msecs);
+      }
+    }
+    bool ok = set_;
+    set_ = false;
+    pthread_mutex_unlock(&mutex_);
+    return ok;
+  }
+#elif PLATFORM_WINDOWS
+  Event() { handle_ = CreateEvent(NULL, FALSE, FALSE, NULL); }
+  ~Event() { CloseHandle(handle_); }
+
+  void Set() { SetEvent(handle_); }
+
+  bool Wait(int32_t msecs = -1) {
+    return WaitForSingleObject(handle_, msecs < 0 ? INFINITE : msecs) ==
+           WAIT_OBJECT_0;
+  }
+#endif
+
+ private:
+#if PLATFORM_LINUX
+  Atomic<int32_t> set_;
+  Atomic<int32_t> waiters_;
+#elif PLATFORM_OSX
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  bool set_;
+#elif PLATFORM_WINDOWS
+  HANDLE handle_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(Event);
+};
+
+// A pointer that has a separate value on each thread, for when there can be
+// more than one of them, so THREAD won't do. Starts out NULL everywhere.
+template <typename T>
+class ThreadLocalPointer {
+ public:
+#if PLATFORM_POSIX
+  ThreadLocalPointer() { pthread_key_create(&key_, NULL); }
+  ~ThreadLocalPointer() { pthread_key_delete(key_); }
+  T* Get() const { return static_cast<T*>(pthread_getspecific(key_)); }
+  void Set(T* value) { pthread_setspecific(key_, value); }
+#elif PLATFORM_WINDOWS
+  ThreadLocalPointer() { index_ = TlsAlloc(); }
+  ~ThreadLocalPointer() { TlsFree(index_); }
+  T* Get() const { return static_cast<T*>(TlsGetValue(index_)); }
+  void Set(T* value) { TlsSetValue(index_, value); }
+#endif
+
+ private:
+#if PLATFORM_POSIX
+  pthread_key_t key_;
+#elif PLATFORM_WINDOWS
+  DWORD index_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadLocalPointer);
+};
+
+class Thread {
+ public:
+  typedef int32_t (*EntryFunction)(void* user_data);
+
+  Thread() : entry_(NULL), user_data_(NULL), exit_code_(0), running_(false) {
+    name_[0] = 0;
+  }
+  ~Thread() { DCHECK(!running_, "Thread not joined"); }
+
+  // Runs |entry|(|user_data|) on a new thread. |name| is what the thread is
+  // called in debuggers and profilers, and can be NULL. A |stack_size| of 0
+  // uses the platform's default.
+  void Start(EntryFunction entry,
+             void* user_data,
+             const char* name = NULL,
+             uint32_t stack_size = 0) {
+    DCHECK(!running_, "Thread already running");
+    entry_ = entry;
+    user_data_ = user_data;
+    name_[0] = 0;
+    if (name) {
+      strncpy(name_, name, sizeof(name_) - 1);
+      name_[sizeof(name_) - 1] = 0;
+    }
+#if PLATFORM_POSIX
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (stack_size)
+      pthread_attr_setstacksize(&attr, stack_size);
+    int result = pthread_create(&handle_, &attr, &Thread::ThreadMain, this);
+    pthread_attr_destroy(&attr);
+    CHECK(result == 0, "pthread_create failed: %d", result);
+#elif PLATFORM_WINDOWS
+    handle_ = CreateThread(
+        NULL, stack_size, &Thread::ThreadMain, this, 0, NULL);
+    CHECK(handle_ != NULL, "CreateThread failed: %u", GetLastError());
+#endif
+    running_ = true;
+  }
+
+  // Waits for the thread to finish, and returns what its entry function did.
+  int32_t Join() {
+    DCHECK(running_, "Thread not running");
+#if PLATFORM_POSIX
+    pthread_join(handle_, NULL);
+#elif PLATFORM_WINDOWS
+    WaitForSingleObject(handle_, INFINITE);
+    CloseHandle(handle_);
+#endif
+    running_ = false;
+    return exit_code_;
+  }
+
+  // Started, and not joined yet, though it might have finished.
+  bool IsRunning() const { return running_; }
+
+  // Restricts the thread to the CPUs whose bits are set in |cpu_mask|, other
+  // than those the process can't use anyway. Returns false if that leaves
+  // none, and always on macOS, where there's no way to say which CPUs a
+  // thread runs on.
+  bool SetAffinity(uint64_t cpu_mask) {
+    DCHECK(running_, "Thread not running");
+#if PLATFORM_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < 64; ++i) {
+      if (cpu_mask & (UINT64_C(1) << i))
+        CPU_SET(i, &set);
+    }
+    return pthread_setaffinity_np(handle_, sizeof(set), &set) == 0;
+#elif PLATFORM_OSX
+    UNUSED(cpu_mask);
+    return false;
+#elif PLATFORM_WINDOWS
+    DWORD_PTR process_mask, system_mask;
+    if (!GetProcessAffinityMask(
+            GetCurrentProcess(), &process_mask, &system_mask))
+      return false;
+    DWORD_PTR mask = static_cast<DWORD_PTR>(cpu_mask) & process_mask;
+    return mask && SetThreadAffinityMask(handle_, mask) != 0;
+#endif
+  }
+
+ private:
+#if PLATFORM_POSIX
+  static void* ThreadMain(void* arg) {
+    Thread* thread = static_cast<Thread*>(arg);
+    thread->SetCurrentThreadName();
+    thread->exit_code_ = thread->entry_(thread->user_data_);
+    return NULL;
+  }
+#elif PLATFORM_WINDOWS
+  static DWORD WINAPI ThreadMain(LPVOID arg) {
+    Thread* thread = static_cast<Thread*>(arg);
+    thread->SetCurrentThreadName();
+    thread->exit_code_ = thread->entry_(thread->user_data_);
+    return static_cast<DWORD>(thread->exit_code_);
+  }
+#endif
+
+  // Only macOS can't name another thread, so it's always done from the new
+  // thread itself.
+  void SetCurrentThreadName() {
+    if (!name_[0])
+      return;
+#if PLATFORM_LINUX
+    // Linux only keeps 15 characters.
+    char short_name[16];
+    strncpy(short_name, name_, sizeof(short_name) - 1);
+    short_name[sizeof(short_name) - 1] = 0;
+    pthread_setname_np(pthread_self(), short_name);
+#elif PLATFORM_OSX
+    pthread_setname_np(name_);
+#elif PLATFORM_WINDOWS
+    // Only in Windows 10, so looked up rather than linked to.
+    typedef HRESULT(WINAPI * SetThreadDescriptionFunction)(HANDLE, PCWSTR);
+    SetThreadDescriptionFunction set_thread_description =
+        reinterpret_cast<SetThreadDescriptionFunction>(GetProcAddress(
+            GetModuleHandleA("kernel32.dll"), "SetThreadDescription"));
+    if (!set_thread_description)
+      return;
+    wchar_t wide_name[COUNTOF(name_)];
+    if (MultiByteToWideChar(
+            CP_UTF8, 0, name_, -1, wide_name, COUNTOF(wide_name)) > 0)
+      set_thread_description(GetCurrentThread(), wide_name);
+#endif
+  }
+
+  EntryFunction entry_;
+  void* user_data_;
+  char name_[64];
+  int32_t exit_code_;
+  bool running_;
+#if PLATFORM_POSIX
+  pthread_t handle_;
+#elif PLATFORM_WINDOWS
+  HANDLE handle_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(Thread);
+};
+
 #endif  // CORE_H_
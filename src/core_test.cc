@@ -0,0 +1,324 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "core.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+struct Counter {
+  Mutex mutex;
+  int value;
+};
+
+int32_t IncrementLots(void* user_data) {
+  Counter* counter = static_cast<Counter*>(user_data);
+  for (int i = 0; i < 100000; ++i) {
+    MutexScope lock(&counter->mutex);
+    ++counter->value;
+  }
+  return 0;
+}
+
+int32_t ReturnUserData(void* user_data) {
+  return static_cast<int32_t>(reinterpret_cast<intptr_t>(user_data));
+}
+
+struct PingPong {
+  Event ping;
+  Event pong;
+  int rounds;
+};
+
+int32_t Pong(void* user_data) {
+  PingPong* ping_pong = static_cast<PingPong*>(user_data);
+  for (int i = 0; i < ping_pong->rounds; ++i) {
+    ping_pong->ping.Wait();
+    ping_pong->pong.Set();
+  }
+  return 0;
+}
+
+struct Queue {
+  Semaphore items;
+  Mutex mutex;
+  int taken;
+};
+
+int32_t TakeItems(void* user_data) {
+  Queue* queue = static_cast<Queue*>(user_data);
+  for (int i = 0; i < 1000; ++i) {
+    queue->items.Wait();
+    MutexScope lock(&queue->mutex);
+    ++queue->taken;
+  }
+  return 0;
+}
+
+THREAD int g_per_thread;
+
+struct Slots {
+  ThreadLocalPointer<int> pointer;
+  int value;
+  bool saw_null;
+  bool saw_own;
+  int global_value;
+};
+
+int32_t UseSlots(void* user_data) {
+  Slots* slots = static_cast<Slots*>(user_data);
+  slots->saw_null = slots->pointer.Get() == NULL;
+  slots->pointer.Set(&slots->value);
+  slots->saw_own = slots->pointer.Get() == &slots->value;
+  slots->global_value = g_per_thread;
+  g_per_thread = 2;
+  return 0;
+}
+
+struct RefCounted {
+  Atomic<int32_t> refs;
+  Atomic<int64_t> total;
+};
+
+int32_t AddAndRelease(void* user_data) {
+  RefCounted* counted = static_cast<RefCounted*>(user_data);
+  for (int i = 0; i < 100000; ++i) {
+    counted->refs.Increment(std::memory_order_relaxed);
+    counted->total.FetchAdd(INT64_C(1) << 32, std::memory_order_relaxed);
+    counted->refs.Decrement(std::memory_order_acq_rel);
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST(Timer, Monotonic) {
+  EXPECT_GE(GetHPFrequency(), INT64_C(1000000));
+  int64_t last = GetHPCounter();
+  for (int i = 0; i < 100000; ++i) {
+    int64_t now = GetHPCounter();
+    ASSERT_GE(now, last);
+    last = now;
+  }
+
+  int64_t start = GetMonotonicNanoseconds();
+  int64_t cycles_start = GetCycleCounter();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  int64_t elapsed = GetMonotonicNanoseconds() - start;
+  int64_t cycles_elapsed =
+      CyclesToNanoseconds(GetCycleCounter() - cycles_start);
+  EXPECT_GE(elapsed, INT64_C(20000000));
+  EXPECT_LT(elapsed, INT64_C(2000000000));
+  // Calibrated well enough to agree with the other clock to within a few
+  // percent.
+  EXPECT_NEAR(static_cast<double>(elapsed),
+              static_cast<double>(cycles_elapsed),
+              elapsed * 0.05);
+}
+
+TEST(Timer, Conversions) {
+  EXPECT_EQ(INT64_C(1000000000), TicksToNanoseconds(10000000, 10000000));
+  EXPECT_EQ(100, TicksToNanoseconds(1, 10000000));
+  EXPECT_EQ(10000000, NanosecondsToTicks(INT64_C(1000000000), 10000000));
+  EXPECT_EQ(1, NanosecondsToTicks(100, 10000000));
+  // A year of 3 GHz cycles doesn't overflow.
+  const int64_t kYear = INT64_C(365) * 24 * 60 * 60;
+  const int64_t kFrequency = INT64_C(3000000000);
+  EXPECT_EQ(kYear * INT64_C(1000000000),
+            TicksToNanoseconds(kYear * kFrequency, kFrequency));
+  EXPECT_EQ(kYear * kFrequency,
+            NanosecondsToTicks(kYear * INT64_C(1000000000), kFrequency));
+  // Only as precise as a tick.
+  EXPECT_NEAR(123456789.0,
+              HPCounterToNanoseconds(NanosecondsToHPCounter(123456789)),
+              1e9 / GetHPFrequency() + 1);
+}
+
+TEST(Atomic, ReturnValues) {
+  Atomic<int32_t> value(5);
+  EXPECT_EQ(5, value.Load());
+  EXPECT_EQ(5, value.FetchAdd(3));
+  EXPECT_EQ(8, value.FetchSub(2, std::memory_order_release));
+  EXPECT_EQ(7, value.Increment());
+  EXPECT_EQ(6, value.Decrement(std::memory_order_relaxed));
+  EXPECT_EQ(6, value.Exchange(10, std::memory_order_acquire));
+  EXPECT_EQ(10, value.Load(std::memory_order_acquire));
+  value.Store(-1, std::memory_order_relaxed);
+  EXPECT_EQ(-1, value.Load(std::memory_order_relaxed));
+
+  int32_t legacy = 5;
+  EXPECT_EQ(5, AtomicIncr(&legacy));
+  EXPECT_EQ(6, AtomicDecr(&legacy));
+  EXPECT_EQ(5, legacy);
+  int a, b;
+  void* pointer = &a;
+  EXPECT_EQ(&a, AtomicExchangePtr(&pointer, &b));
+  EXPECT_EQ(&b, pointer);
+}
+
+TEST(Atomic, CompareExchange) {
+  Atomic<uint32_t> value(1);
+  uint32_t expected = 2;
+  EXPECT_FALSE(value.CompareExchange(&expected, 3));
+  EXPECT_EQ(1u, expected);
+  EXPECT_EQ(1u, value.Load());
+  EXPECT_TRUE(value.CompareExchange(&expected, 3, std::memory_order_acq_rel));
+  EXPECT_EQ(1u, expected);
+  EXPECT_EQ(3u, value.Load());
+  // A release can't be used for the failure case, but is allowed here.
+  expected = 0;
+  EXPECT_FALSE(value.CompareExchange(&expected, 4, std::memory_order_release));
+  EXPECT_EQ(3u, expected);
+}
+
+TEST(Atomic, SixtyFourBit) {
+  Atomic<uint64_t> value;
+  EXPECT_EQ(0u, value.Load());
+  const uint64_t big = UINT64_C(0x123456789abcdef0);
+  value.Store(big);
+  EXPECT_EQ(big, value.FetchAdd(UINT64_C(1) << 40));
+  EXPECT_EQ(big + (UINT64_C(1) << 40), value.Exchange(~UINT64_C(0)));
+  // Unsigned values wrap around.
+  EXPECT_EQ(0u, value.Increment());
+}
+
+TEST(Atomic, Pointer) {
+  int values[4] = {0, 1, 2, 3};
+  Atomic<int*> pointer(values);
+  EXPECT_EQ(values, pointer.FetchAdd(2));
+  EXPECT_EQ(&values[2], pointer.Load());
+  EXPECT_EQ(&values[3], pointer.Increment());
+  EXPECT_EQ(&values[3], pointer.FetchSub(3, std::memory_order_relaxed));
+  int* expected = values;
+  EXPECT_TRUE(pointer.CompareExchange(&expected, NULL));
+  EXPECT_TRUE(pointer.Load() == NULL);
+}
+
+TEST(Atomic, AcrossThreads) {
+  RefCounted counted;
+  Thread threads[4];
+  for (Thread& thread : threads)
+    thread.Start(&AddAndRelease, &counted);
+  for (Thread& thread : threads)
+    thread.Join();
+  EXPECT_EQ(0, counted.refs.Load());
+  EXPECT_EQ(INT64_C(400000) << 32, counted.total.Load());
+}
+
+TEST(Threading, ThreadExitCode) {
+  Thread thread;
+  EXPECT_FALSE(thread.IsRunning());
+  thread.Start(&ReturnUserData, reinterpret_cast<void*>(42), "exit code");
+  EXPECT_TRUE(thread.IsRunning());
+  EXPECT_EQ(42, thread.Join());
+  EXPECT_FALSE(thread.IsRunning());
+
+  // And again, with the same object.
+  thread.Start(&ReturnUserData, reinterpret_cast<void*>(7), NULL, 64 * 1024);
+  EXPECT_EQ(7, thread.Join());
+}
+
+TEST(Threading, MutexExcludes) {
+  Counter counter;
+  counter.value = 0;
+  Thread threads[4];
+  for (Thread& thread : threads)
+    thread.Start(&IncrementLots, &counter, "incrementer");
+  for (Thread& thread : threads)
+    thread.Join();
+  EXPECT_EQ(400000, counter.value);
+}
+
+TEST(Threading, MutexTryLock) {
+  Mutex mutex;
+  EXPECT_TRUE(mutex.TryLock());
+  EXPECT_FALSE(mutex.TryLock());
+  mutex.Unlock();
+  {
+    MutexScope lock(&mutex);
+    EXPECT_FALSE(mutex.TryLock());
+  }
+  EXPECT_TRUE(mutex.TryLock());
+  mutex.Unlock();
+}
+
+TEST(Threading, SemaphoreCounts) {
+  Semaphore semaphore;
+  EXPECT_FALSE(semaphore.Wait(0));
+  EXPECT_FALSE(semaphore.Wait(10));
+  semaphore.Post(2);
+  EXPECT_TRUE(semaphore.Wait(0));
+  EXPECT_TRUE(semaphore.Wait(10));
+  EXPECT_FALSE(semaphore.Wait(0));
+}
+
+TEST(Threading, SemaphoreAcrossThreads) {
+  Queue queue;
+  queue.taken = 0;
+  Thread threads[2];
+  for (Thread& thread : threads)
+    thread.Start(&TakeItems, &queue);
+  for (int i = 0; i < 2000; ++i)
+    queue.items.Post();
+  for (Thread& thread : threads)
+    thread.Join();
+  EXPECT_EQ(2000, queue.taken);
+  EXPECT_FALSE(queue.items.Wait(0));
+}
+
+TEST(Threading, EventAutoResets) {
+  Event event;
+  EXPECT_FALSE(event.Wait(0));
+  EXPECT_FALSE(event.Wait(10));
+  event.Set();
+  event.Set();
+  EXPECT_TRUE(event.Wait(10));
+  EXPECT_FALSE(event.Wait(0));
+}
+
+TEST(Threading, EventAcrossThreads) {
+  PingPong ping_pong;
+  ping_pong.rounds = 1000;
+  Thread thread;
+  thread.Start(&Pong, &ping_pong, "pong");
+  for (int i = 0; i < ping_pong.rounds; ++i) {
+    ping_pong.ping.Set();
+    ASSERT_TRUE(ping_pong.pong.Wait(10000));
+  }
+  thread.Join();
+}
+
+TEST(Threading, ThreadLocal) {
+  Slots slots;
+  int mine = 0;
+  slots.pointer.Set(&mine);
+  g_per_thread = 1;
+  Thread thread;
+  thread.Start(&UseSlots, &slots);
+  thread.Join();
+  EXPECT_TRUE(slots.saw_null);
+  EXPECT_TRUE(slots.saw_own);
+  EXPECT_EQ(0, slots.global_value);
+  EXPECT_EQ(&mine, slots.pointer.Get());
+  EXPECT_EQ(1, g_per_thread);
+}
+
+#if !PLATFORM_OSX
+TEST(Threading, Affinity) {
+  Event done;
+  Thread thread;
+  thread.Start([](void* user_data) -> int32_t {
+    static_cast<Event*>(user_data)->Wait();
+    return 0;
+  }, &done);
+  // Whichever CPUs this process is allowed to use are left.
+  EXPECT_TRUE(thread.SetAffinity(~UINT64_C(0)));
+  done.Set();
+  thread.Join();
+}
+#endif
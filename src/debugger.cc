@@ -0,0 +1,64 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "debugger.h"
+
+const char* GetRegisterName(int index) {
+  static const char* const kNames[] = {
+      "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp", "r8",
+      "r9",  "r10", "r11", "r12", "r13", "r14", "r15", "rip", "rflags",
+  };
+  static_assert(COUNTOF(kNames) == Registers::kCount,
+                "a name for every register");
+  return index >= 0 && index < Registers::kCount ? kNames[index] : "";
+}
+
+std::vector<std::string> SplitCommandLine(const std::string& command_line) {
+  std::vector<std::string> args;
+  std::string arg;
+  // Whether there's an argument, even an empty one, from "".
+  bool in_arg = false;
+  char quote = 0;
+  for (size_t i = 0; i < command_line.size(); ++i) {
+    char c = command_line[i];
+    if (quote == '\'') {
+      if (c == '\'')
+        quote = 0;
+      else
+        arg += c;
+    } else if (c == '\\' && i + 1 < command_line.size() &&
+               (!quote || command_line[i + 1] == '"' ||
+                command_line[i + 1] == '\\')) {
+      arg += command_line[++i];
+      in_arg = true;
+    } else if (quote == '"') {
+      if (c == '"')
+        quote = 0;
+      else
+        arg += c;
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+      in_arg = true;
+    } else if (c == ' ' || c == '\t' || c == '\n') {
+      if (in_arg)
+        args.push_back(arg);
+      arg.clear();
+      in_arg = false;
+    } else {
+      arg += c;
+      in_arg = true;
+    }
+  }
+  if (in_arg)
+    args.push_back(arg);
+  return args;
+}
+
+#if !PLATFORM_LINUX
+// There's no backend for Windows or macOS yet.
+Debugger* MakeDebugger(const std::function<void()>& wake) {
+  UNUSED(wake);
+  return NULL;
+}
+#endif
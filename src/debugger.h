@@ -0,0 +1,170 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DEBUGGER_H_
+#define DEBUGGER_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "core.h"
+
+// The x86-64 general purpose registers of a thread.
+struct Registers {
+  enum Index {
+    kRax,
+    kRbx,
+    kRcx,
+    kRdx,
+    kRsi,
+    kRdi,
+    kRbp,
+    kRsp,
+    kR8,
+    kR9,
+    kR10,
+    kR11,
+    kR12,
+    kR13,
+    kR14,
+    kR15,
+    kRip,
+    kRflags,
+    kCount,
+  };
+  uint64_t values[kCount];
+};
+
+// For display, e.g. "rax".
+const char* GetRegisterName(int index);
+
+// Splits |command_line| into arguments at whitespace, roughly as a POSIX
+// shell would, other than expanding anything. Text in single quotes is
+// taken as it is, and in double quotes, a backslash only escapes a double
+// quote or another backslash, as it escapes anything outside of quotes.
+// Quotes that aren't closed run to the end.
+std::vector<std::string> SplitCommandLine(const std::string& command_line);
+
+// One of several pieces of memory to read at once.
+struct MemoryRange {
+  uint64_t address;
+  void* buffer;
+  size_t size;
+  // Filled in by the read.
+  size_t bytes_read;
+};
+
+// Something that happened to the process being debugged, sent from the
+// debugger's thread to the UI thread.
+struct DebugEvent {
+  enum Type {
+    // Every thread of the process is stopped, and |thread_id| is the one that
+    // stopped it, at |address|. For kEntry and kAttached, that's the main
+    // thread, whose id is the process's.
+    kStopped,
+    // The process has gone, with |exit_code|, or killed by |signal|.
+    kExited,
+    // Something couldn't be done, as described in |message|.
+    kError,
+    // The reply to RequestMemory(), with the |size| bytes that were asked for
+    // at |address|, as far as they could be read, in |memory|.
+    kMemory,
+  };
+  enum StopReason {
+    // Launched, before its first instruction.
+    kEntry,
+    kAttached,
+    kBreakpoint,
+    kStepped,
+    kPaused,
+    // |signal| was sent to the thread. It's passed on when continuing.
+    kSignal,
+  };
+
+  DebugEvent()
+      : type(kError),
+        reason(kEntry),
+        thread_id(0),
+        address(0),
+        signal(0),
+        exit_code(0),
+        entry_point(0),
+        size(0) {}
+
+  Type type;
+  StopReason reason;
+  int thread_id;
+  uint64_t address;
+  int signal;
+  int exit_code;
+  std::string message;
+  // For kEntry and kAttached, where the program starts in the process, which
+  // says where it's been loaded. 0 if that isn't known.
+  uint64_t entry_point;
+  size_t size;
+  std::vector<uint8_t> memory;
+};
+
+// Runs a process under a debugger. All of these are for the UI thread, and
+// never wait for the process, which is looked after by a thread of the
+// debugger's own. Most only ask for something to be done, and the results
+// come back as DebugEvents.
+//
+// Only one process is debugged at a time, and it's all-stop: whenever one of
+// its threads stops, the others are stopped too.
+class Debugger {
+ public:
+  virtual ~Debugger() {}
+
+  // Starts |path|, passing it |args|, stopped before its first instruction.
+  // Anything that's already being debugged is detached or killed first.
+  virtual void Launch(const std::string& path,
+                      const std::vector<std::string>& args,
+                      const std::string& working_directory) = 0;
+  virtual void Attach(int process_id) = 0;
+
+  // Leaves the process running without the debugger, or kills it.
+  virtual void Detach() = 0;
+  virtual void Kill() = 0;
+
+  // Resumes every thread.
+  virtual void Continue() = 0;
+  // Runs one instruction on |thread_id|, and no other threads.
+  virtual void StepInstruction(int thread_id) = 0;
+  // Stops the process wherever it is.
+  virtual void Pause() = 0;
+
+  // Breakpoints stay set across launches, so they can be set before there's
+  // a process, or while it's running.
+  virtual void AddBreakpoint(uint64_t address) = 0;
+  virtual void RemoveBreakpoint(uint64_t address) = 0;
+
+  // These only work while the process is stopped, and return straight away
+  // otherwise. Memory is read as it would be without breakpoints set, until
+  // the first byte that can't be read, and the number that could is
+  // returned.
+  virtual size_t ReadMemory(uint64_t address, void* buffer, size_t size) = 0;
+  // As ReadMemory() for each of |ranges|, but all together, which is much
+  // cheaper than reading them one at a time. Memory's cached until the process
+  // next runs, so reading it again while stopped is cheap too.
+  virtual void ReadMemoryRanges(MemoryRange* ranges, size_t count) = 0;
+  // As ReadMemory(), but without waiting, with the result sent back as a
+  // kMemory event, for callers that mustn't wait for the process, such as
+  // the UI. Nothing's sent back if the process isn't stopped.
+  virtual void RequestMemory(uint64_t address, size_t size) = 0;
+  virtual bool ReadRegisters(int thread_id, Registers* registers) = 0;
+
+  // Takes the next event, if there is one.
+  virtual bool PollEvent(DebugEvent* event) = 0;
+
+  // As of the last event that was polled.
+  virtual bool IsStopped() const = 0;
+};
+
+// |wake| is called on the debugger's thread when there are events to poll.
+// Returns NULL if there's no debugger for this platform.
+Debugger* MakeDebugger(const std::function<void()>& wake);
+
+#endif  // DEBUGGER_H_
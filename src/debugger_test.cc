@@ -0,0 +1,39 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "debugger.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+typedef std::vector<std::string> Args;
+
+}  // namespace
+
+TEST(SplitCommandLine, Whitespace) {
+  EXPECT_EQ(Args(), SplitCommandLine(""));
+  EXPECT_EQ(Args(), SplitCommandLine("  \t "));
+  EXPECT_EQ(Args({"ls", "-l", "/tmp"}), SplitCommandLine("  ls -l\t /tmp "));
+}
+
+TEST(SplitCommandLine, Quotes) {
+  EXPECT_EQ(Args({"/my programs/a.out", "x y"}),
+            SplitCommandLine("'/my programs/a.out' \"x y\""));
+  EXPECT_EQ(Args({"a", "", "b"}), SplitCommandLine("a \"\" b"));
+  // Quotes join up with what's around them.
+  EXPECT_EQ(Args({"--name=some thing"}),
+            SplitCommandLine("--name=\"some thing\""));
+  EXPECT_EQ(Args({"it's"}), SplitCommandLine("\"it's\""));
+  // One that isn't closed runs to the end.
+  EXPECT_EQ(Args({"a", "b c"}), SplitCommandLine("a 'b c"));
+}
+
+TEST(SplitCommandLine, Backslashes) {
+  EXPECT_EQ(Args({"a b", "c"}), SplitCommandLine("a\\ b c"));
+  EXPECT_EQ(Args({"say \"hi\"", "\\n"}),
+            SplitCommandLine("\"say \\\"hi\\\"\" \"\\n\""));
+  EXPECT_EQ(Args({"\\\\"}), SplitCommandLine("'\\\\'"));
+  EXPECT_EQ(Args({"end\\"}), SplitCommandLine("end\\"));
+}
@@ -0,0 +1,341 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "dynamic_glyph_atlas.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "third_party/imgui/imgui_internal.h"
+
+// ImGui keeps its copies of the stb libraries to itself, so this has its own,
+// set up in the same way.
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4456 4505)
+#elif defined(__clang__)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-function"
+#elif defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wtype-limits"
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
+#define STBRP_ASSERT(x) IM_ASSERT(x)
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "third_party/imgui/stb_rect_pack.h"
+#define STBTT_malloc(x, u) ((void)(u), ImGui::MemAlloc(x))
+#define STBTT_free(x, u) ((void)(u), ImGui::MemFree(x))
+#define STBTT_assert(x) IM_ASSERT(x)
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "third_party/imgui/stb_truetype.h"
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#elif defined(__clang__)
+#pragma clang diagnostic pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+// Most GL implementations can manage at least this, and it's room for a few
+// thousand glyphs at the sizes and oversampling that are used.
+const int kMaxTextureHeight = 8192;
+
+}  // namespace
+
+struct DynamicGlyphAtlas::FontState {
+  // One of the fonts merged into an ImFont, in the order they were added.
+  struct Source {
+    const ImFontConfig* config;
+    stbtt_fontinfo info;
+  };
+
+  ImFont* font;
+  // A glyph comes from the first of these that has it.
+  std::vector<Source> sources;
+  // Everything that's been asked for, whether or not the font has it, so
+  // that each character is only looked for once.
+  std::unordered_set<ImWchar> requested;
+  std::vector<ImWchar> pending;
+};
+
+DynamicGlyphAtlas::DynamicGlyphAtlas(ImFontAtlas* atlas,
+                                     const std::function<void()>& wake)
+    : atlas_(atlas),
+      wake_(wake),
+      pending_(false),
+      generation_(0),
+      shelf_x_(0),
+      shelf_y_(0),
+      shelf_height_(0) {
+  unsigned char* pixels;
+  int width, height;
+  atlas_->GetTexDataAsAlpha8(&pixels, &width, &height);
+
+  for (ImFont* font : atlas_->Fonts) {
+    std::unique_ptr<FontState> state(new FontState);
+    state->font = font;
+    for (const ImFontConfig& config : atlas_->ConfigData) {
+      if (config.DstFont != font || !config.FontData)
+        continue;
+      unsigned char* data = static_cast<unsigned char*>(config.FontData);
+      FontState::Source source;
+      source.config = &config;
+      if (!stbtt_InitFont(&source.info,
+                          data,
+                          stbtt_GetFontOffsetForIndex(data, config.FontNo)))
+        continue;
+      state->sources.push_back(source);
+    }
+    if (!state->sources.empty())
+      fonts_.push_back(std::move(state));
+  }
+
+  // The baked glyphs are packed from the top, and the height rounded up to a
+  // power of two, so there's often room left at the bottom to start in.
+  int last_used_row = -1;
+  for (int y = height - 1; y >= 0 && last_used_row < 0; --y) {
+    const unsigned char* row = pixels + y * width;
+    for (int x = 0; x < width; ++x) {
+      if (row[x]) {
+        last_used_row = y;
+        break;
+      }
+    }
+  }
+  // Leave a row of padding, as the baked glyphs have.
+  shelf_y_ = last_used_row + 2;
+}
+
+DynamicGlyphAtlas::~DynamicGlyphAtlas() {}
+
+const ImFont::Glyph* DynamicGlyphAtlas::FindGlyph(const ImFont* font,
+                                                  unsigned int c) {
+  if (c < static_cast<unsigned int>(font->IndexLookup.Size)) {
+    unsigned short i = font->IndexLookup[c];
+    if (i != static_cast<unsigned short>(-1))
+      return &font->Glyphs[i];
+  }
+  RequestGlyph(font, c);
+  return font->FallbackGlyph;
+}
+
+void DynamicGlyphAtlas::RequestGlyphs(const ImFont* font,
+                                      const char* text,
+                                      const char* text_end) {
+  if (!text_end)
+    text_end = text + strlen(text);
+  for (const char* s = text; s < text_end;) {
+    unsigned int c = static_cast<unsigned char>(*s);
+    if (c < 0x80) {
+      s += 1;
+    } else {
+      s += ImTextCharFromUtf8(&c, s, text_end);
+      if (c == 0)
+        break;
+    }
+    if (c >= static_cast<unsigned int>(font->IndexLookup.Size) ||
+        font->IndexLookup[c] == static_cast<unsigned short>(-1))
+      RequestGlyph(font, c);
+  }
+}
+
+void DynamicGlyphAtlas::RequestGlyph(const ImFont* font, unsigned int c) {
+  // ImWchar is 16 bits, so nothing outside the BMP (like most emoji) can be a
+  // glyph.
+  if (c > 0xFFFF || c < ' ')
+    return;
+  FontState* state = FindFontState(font);
+  if (!state || !state->requested.insert(static_cast<ImWchar>(c)).second)
+    return;
+  state->pending.push_back(static_cast<ImWchar>(c));
+  if (!pending_) {
+    pending_ = true;
+    wake_();
+  }
+}
+
+DynamicGlyphAtlas::FontState* DynamicGlyphAtlas::FindFontState(
+    const ImFont* font) {
+  for (const auto& state : fonts_) {
+    if (state->font == font)
+      return state.get();
+  }
+  return NULL;
+}
+
+bool DynamicGlyphAtlas::Update(int* dirty_begin, int* dirty_end) {
+  if (!pending_)
+    return false;
+  pending_ = false;
+
+  int old_height = atlas_->TexHeight;
+  int begin = INT_MAX;
+  int end = 0;
+  stbtt_pack_context spc;
+  memset(&spc, 0, sizeof(spc));
+  stbtt_PackBegin(
+      &spc, NULL, atlas_->TexWidth, kMaxTextureHeight, 0, 1, NULL);
+  for (const auto& state : fonts_) {
+    if (state->pending.empty())
+      continue;
+    ImFont* font = state->font;
+
+    // BuildLookupTable() adds a tab glyph at the end, and only knows to reuse
+    // it if it's still last.
+    if (font->Glyphs.Size && font->Glyphs.back().Codepoint == '\t')
+      font->Glyphs.pop_back();
+    bool added = false;
+    for (ImWchar c : state->pending) {
+      FontState::Source* source = NULL;
+      for (FontState::Source& candidate : state->sources) {
+        if (stbtt_FindGlyphIndex(&candidate.info, c)) {
+          source = &candidate;
+          break;
+        }
+      }
+      if (!source)
+        continue;
+      const ImFontConfig& config = *source->config;
+      stbtt_fontinfo* info = &source->info;
+      stbtt_PackSetOversampling(&spc, config.OversampleH, config.OversampleV);
+      stbtt_packedchar packed;
+      stbtt_pack_range range;
+      memset(&range, 0, sizeof(range));
+      range.font_size = config.SizePixels;
+      range.first_unicode_codepoint_in_range = c;
+      range.num_chars = 1;
+      range.chardata_for_range = &packed;
+      stbrp_rect rect;
+      memset(&rect, 0, sizeof(rect));
+      stbtt_PackFontRangesGatherRects(&spc, info, &range, 1, &rect);
+      int x, y;
+      int height = rect.h;
+      if (!Allocate(rect.w, height, &x, &y))
+        continue;
+      rect.x = x;
+      rect.y = y;
+      rect.was_packed = 1;
+      spc.pixels = atlas_->TexPixelsAlpha8;
+      spc.height = atlas_->TexHeight;
+      stbtt_PackFontRangesRenderIntoRects(&spc, info, &range, 1, &rect);
+      begin = std::min(begin, y);
+      end = std::max(end, y + height);
+
+      // As ImFontAtlas::Build() sets them up.
+      stbtt_aligned_quad q;
+      float dummy_x = 0.0f, dummy_y = 0.0f;
+      stbtt_GetPackedQuad(&packed,
+                          atlas_->TexWidth,
+                          atlas_->TexHeight,
+                          0,
+                          &dummy_x,
+                          &dummy_y,
+                          &q,
+                          0);
+      ImFont::Glyph glyph;
+      glyph.Codepoint = c;
+      glyph.X0 = q.x0;
+      glyph.Y0 = q.y0;
+      glyph.X1 = q.x1;
+      glyph.Y1 = q.y1;
+      glyph.U0 = q.s0;
+      glyph.V0 = q.t0;
+      glyph.U1 = q.s1;
+      glyph.V1 = q.t1;
+      glyph.Y0 += static_cast<float>(static_cast<int>(font->Ascent + 0.5f));
+      glyph.Y1 += static_cast<float>(static_cast<int>(font->Ascent + 0.5f));
+      glyph.XAdvance = packed.xadvance + config.GlyphExtraSpacing.x;
+      if (config.PixelSnapH)
+        glyph.XAdvance = static_cast<float>(static_cast<int>(glyph.XAdvance +
+                                                             0.5f));
+      font->Glyphs.push_back(glyph);
+      added = true;
+    }
+    state->pending.clear();
+    font->BuildLookupTable();
+    if (added)
+      ++generation_;
+  }
+  stbtt_PackEnd(&spc);
+
+  if (begin >= end)
+    return false;
+  if (atlas_->TexHeight != old_height) {
+    *dirty_begin = 0;
+    *dirty_end = atlas_->TexHeight;
+  } else {
+    *dirty_begin = begin;
+    *dirty_end = std::min(end, atlas_->TexHeight);
+  }
+  return true;
+}
+
+bool DynamicGlyphAtlas::Allocate(int width, int height, int* x, int* y) {
+  if (width > atlas_->TexWidth)
+    return false;
+  if (shelf_x_ + width > atlas_->TexWidth) {
+    shelf_x_ = 0;
+    shelf_y_ += shelf_height_;
+    shelf_height_ = 0;
+  }
+  if (shelf_y_ + height > atlas_->TexHeight && !Grow(shelf_y_ + height))
+    return false;
+  *x = shelf_x_;
+  *y = shelf_y_;
+  shelf_x_ += width;
+  shelf_height_ = std::max(shelf_height_, height);
+  return true;
+}
+
+bool DynamicGlyphAtlas::Grow(int min_height) {
+  int old_height = atlas_->TexHeight;
+  int height = old_height;
+  while (height < min_height)
+    height *= 2;
+  if (height > kMaxTextureHeight)
+    return false;
+
+  int width = atlas_->TexWidth;
+  unsigned char* pixels =
+      static_cast<unsigned char*>(ImGui::MemAlloc(width * height));
+  memcpy(pixels, atlas_->TexPixelsAlpha8, width * old_height);
+  memset(pixels + width * old_height, 0, width * (height - old_height));
+  ImGui::MemFree(atlas_->TexPixelsAlpha8);
+  atlas_->TexPixelsAlpha8 = pixels;
+  // Only the alpha is kept up to date.
+  if (atlas_->TexPixelsRGBA32) {
+    ImGui::MemFree(atlas_->TexPixelsRGBA32);
+    atlas_->TexPixelsRGBA32 = NULL;
+  }
+
+  // Everything stays where it was in the texture, so only the vertical
+  // texture coordinates change.
+  ImVector<stbrp_rect> custom_rects;
+  atlas_->RenderCustomTexData(0, &custom_rects);
+  custom_rects[0].x =
+      static_cast<stbrp_coord>(atlas_->TexUvWhitePixel.x * width);
+  custom_rects[0].y =
+      static_cast<stbrp_coord>(atlas_->TexUvWhitePixel.y * old_height);
+  custom_rects[0].was_packed = 1;
+  atlas_->TexHeight = height;
+  atlas_->RenderCustomTexData(1, &custom_rects);
+  float scale = static_cast<float>(old_height) / height;
+  for (ImFont* font : atlas_->Fonts) {
+    for (ImFont::Glyph& glyph : font->Glyphs) {
+      glyph.V0 *= scale;
+      glyph.V1 *= scale;
+    }
+  }
+  ++generation_;
+  return true;
+}
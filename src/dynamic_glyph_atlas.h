@@ -0,0 +1,77 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef DYNAMIC_GLYPH_ATLAS_H_
+#define DYNAMIC_GLYPH_ATLAS_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "core.h"
+#include "third_party/imgui/imgui.h"
+
+// Adds glyphs to an already built font atlas as they're first needed, so that
+// only the common ranges have to be baked at startup, but text from anywhere
+// else in Unicode still shows up. New glyphs are packed into rows below the
+// baked ones, and the texture is made taller when they run out of room.
+// Where other fonts have been merged into an ImFont, a glyph comes from the
+// first of them that has it.
+//
+// Everything here is for the UI thread only.
+class DynamicGlyphAtlas {
+ public:
+  // |atlas| must have been built, and still have its fonts' data, which the
+  // new glyphs are rasterized from. |wake| is called when a glyph is asked for
+  // that isn't there yet, to get another frame drawn, which will have it.
+  DynamicGlyphAtlas(ImFontAtlas* atlas, const std::function<void()>& wake);
+  ~DynamicGlyphAtlas();
+
+  // As ImFont::FindGlyph(), but asks for |c| to be added if |font| doesn't
+  // have it, returning the fallback glyph until it has been.
+  const ImFont::Glyph* FindGlyph(const ImFont* font, unsigned int c);
+
+  // Asks for whatever characters of [text, text_end) that |font| doesn't have
+  // yet, for text that's drawn by ImGui rather than through FindGlyph(). As
+  // in ImGui, |text| is nul-terminated if |text_end| is NULL.
+  void RequestGlyphs(const ImFont* font,
+                     const char* text,
+                     const char* text_end = NULL);
+
+  // Rasterizes the glyphs that have been asked for since the last call into
+  // the atlas's pixels, and adds them to their fonts. Returns true if any
+  // were, and then rows [*dirty_begin, *dirty_end) of the texture need to be
+  // uploaded again. If the texture had to grow, that's all of it.
+  bool Update(int* dirty_begin, int* dirty_end);
+
+  // Changes whenever glyphs are added, or the existing ones move in the
+  // texture, so that text laid out before then can be redone.
+  uint32_t generation() const { return generation_; }
+
+ private:
+  struct FontState;
+
+  void RequestGlyph(const ImFont* font, unsigned int c);
+  FontState* FindFontState(const ImFont* font);
+
+  // Finds room for a |width| by |height| rectangle, making the texture taller
+  // if need be. Returns false if it's as tall as it's allowed to get.
+  bool Allocate(int width, int height, int* x, int* y);
+  bool Grow(int min_height);
+
+  ImFontAtlas* atlas_;
+  std::function<void()> wake_;
+  std::vector<std::unique_ptr<FontState>> fonts_;
+  bool pending_;
+  uint32_t generation_;
+
+  // The row that's being filled, below everything that's been packed so far.
+  int shelf_x_;
+  int shelf_y_;
+  int shelf_height_;
+
+  DISALLOW_COPY_AND_ASSIGN(DynamicGlyphAtlas);
+};
+
+#endif  // DYNAMIC_GLYPH_ATLAS_H_
@@ -0,0 +1,117 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "elf/elf_file.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Whether [offset, offset + size) is inside a file of |file_size| bytes.
+bool InFile(uint64_t offset, uint64_t size, size_t file_size) {
+  return offset <= file_size && size <= file_size - offset;
+}
+
+}  // namespace
+
+// static
+ElfFile* ElfFile::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+      static_cast<uint64_t>(st.st_size) < sizeof(Elf64_Ehdr)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return NULL;
+  ElfFile* file = new ElfFile(static_cast<const uint8_t*>(data), size);
+  if (!file->ReadHeaders()) {
+    delete file;
+    return NULL;
+  }
+  return file;
+}
+
+ElfFile::ElfFile(const uint8_t* data, size_t size)
+    : data_(data), size_(size), entry_point_(0) {}
+
+ElfFile::~ElfFile() {
+  munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+const ElfFile::Section* ElfFile::FindSection(const char* name) const {
+  for (const auto& section : sections_) {
+    if (strcmp(section.name, name) == 0)
+      return &section;
+  }
+  return NULL;
+}
+
+bool ElfFile::ReadHeaders() {
+  Elf64_Ehdr header;
+  memcpy(&header, data_, sizeof(header));
+  if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 ||
+      header.e_ident[EI_CLASS] != ELFCLASS64 ||
+      header.e_ident[EI_DATA] != ELFDATA2LSB ||
+      header.e_shentsize != sizeof(Elf64_Shdr) ||
+      !InFile(header.e_shoff, sizeof(Elf64_Shdr), size_)) {
+    return false;
+  }
+  entry_point_ = header.e_entry;
+
+  // With too many sections for the header, the counts are in the first
+  // section header instead.
+  Elf64_Shdr first;
+  memcpy(&first, data_ + header.e_shoff, sizeof(first));
+  uint64_t count = header.e_shnum ? header.e_shnum : first.sh_size;
+  uint32_t names_index =
+      header.e_shstrndx == SHN_XINDEX ? first.sh_link : header.e_shstrndx;
+  if (count > size_ / sizeof(Elf64_Shdr) ||
+      !InFile(header.e_shoff, count * sizeof(Elf64_Shdr), size_) ||
+      names_index >= count) {
+    return false;
+  }
+
+  std::vector<Elf64_Shdr> headers(static_cast<size_t>(count));
+  memcpy(headers.data(), data_ + header.e_shoff, count * sizeof(Elf64_Shdr));
+  const Elf64_Shdr& names = headers[names_index];
+  // Names are only looked at if the table's properly terminated, so none of
+  // them can run off the end of it.
+  if (!InFile(names.sh_offset, names.sh_size, size_) || names.sh_size == 0 ||
+      data_[names.sh_offset + names.sh_size - 1] != 0) {
+    return false;
+  }
+  const char* name_table =
+      reinterpret_cast<const char*>(data_ + names.sh_offset);
+
+  sections_.resize(headers.size());
+  for (size_t i = 0; i < headers.size(); ++i) {
+    const Elf64_Shdr& in = headers[i];
+    Section& out = sections_[i];
+    out.name = in.sh_name < names.sh_size ? name_table + in.sh_name : "";
+    out.type = in.sh_type;
+    out.link = in.sh_link;
+    out.address = in.sh_addr;
+    out.entry_size = in.sh_entsize;
+    if (in.sh_type != SHT_NOBITS && InFile(in.sh_offset, in.sh_size, size_)) {
+      out.data = data_ + in.sh_offset;
+      out.size = static_cast<size_t>(in.sh_size);
+    } else {
+      out.data = NULL;
+      out.size = 0;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,56 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ELF_ELF_FILE_H_
+#define ELF_ELF_FILE_H_
+
+#include <string>
+#include <vector>
+
+#include "core.h"
+
+// A 64-bit little-endian ELF file, mapped read-only. The headers are checked
+// when it's opened, so that the sections can be used without checking that
+// they're inside the file again.
+class ElfFile {
+ public:
+  struct Section {
+    // Into the section name table, which is mapped.
+    const char* name;
+    uint32_t type;
+    uint32_t link;
+    uint64_t address;
+    uint64_t entry_size;
+    // NULL for sections that aren't in the file, such as .bss.
+    const uint8_t* data;
+    size_t size;
+  };
+
+  // Returns NULL if |path| can't be mapped, or isn't an ELF file that can be
+  // read.
+  static ElfFile* Open(const std::string& path);
+  ~ElfFile();
+
+  // NULL if there isn't one called |name|.
+  const Section* FindSection(const char* name) const;
+  const std::vector<Section>& sections() const { return sections_; }
+
+  // Where the program starts, as linked. The difference between this and
+  // where it starts in a process is how far it's been moved when loaded.
+  uint64_t entry_point() const { return entry_point_; }
+
+ private:
+  ElfFile(const uint8_t* data, size_t size);
+
+  bool ReadHeaders();
+
+  const uint8_t* data_;
+  size_t size_;
+  uint64_t entry_point_;
+  std::vector<Section> sections_;
+
+  DISALLOW_COPY_AND_ASSIGN(ElfFile);
+};
+
+#endif  // ELF_ELF_FILE_H_
@@ -0,0 +1,1100 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "elf/line_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+// From the DWARF 5 standard, with the earlier versions' forms being a subset.
+enum Form {
+  kFormAddr = 0x01,
+  kFormBlock2 = 0x03,
+  kFormBlock4 = 0x04,
+  kFormData2 = 0x05,
+  kFormData4 = 0x06,
+  kFormData8 = 0x07,
+  kFormString = 0x08,
+  kFormBlock = 0x09,
+  kFormBlock1 = 0x0a,
+  kFormData1 = 0x0b,
+  kFormFlag = 0x0c,
+  kFormSdata = 0x0d,
+  kFormStrp = 0x0e,
+  kFormUdata = 0x0f,
+  kFormRefAddr = 0x10,
+  kFormRef1 = 0x11,
+  kFormRef2 = 0x12,
+  kFormRef4 = 0x13,
+  kFormRef8 = 0x14,
+  kFormRefUdata = 0x15,
+  kFormIndirect = 0x16,
+  kFormSecOffset = 0x17,
+  kFormExprloc = 0x18,
+  kFormFlagPresent = 0x19,
+  kFormStrx = 0x1a,
+  kFormAddrx = 0x1b,
+  kFormRefSup4 = 0x1c,
+  kFormStrpSup = 0x1d,
+  kFormData16 = 0x1e,
+  kFormLineStrp = 0x1f,
+  kFormRefSig8 = 0x20,
+  kFormImplicitConst = 0x21,
+  kFormLoclistx = 0x22,
+  kFormRnglistx = 0x23,
+  kFormRefSup8 = 0x24,
+  kFormStrx1 = 0x25,
+  kFormStrx2 = 0x26,
+  kFormStrx3 = 0x27,
+  kFormStrx4 = 0x28,
+  kFormAddrx1 = 0x29,
+  kFormAddrx2 = 0x2a,
+  kFormAddrx3 = 0x2b,
+  kFormAddrx4 = 0x2c,
+  kFormGnuAddrIndex = 0x1f01,
+  kFormGnuStrIndex = 0x1f02,
+  kFormGnuRefAlt = 0x1f20,
+  kFormGnuStrpAlt = 0x1f21,
+};
+
+enum Attribute {
+  kAttributeStmtList = 0x10,
+  kAttributeLowPc = 0x11,
+  kAttributeHighPc = 0x12,
+  kAttributeCompDir = 0x1b,
+  kAttributeRanges = 0x55,
+  kAttributeAddrBase = 0x73,
+  kAttributeRnglistsBase = 0x74,
+  kAttributeGnuAddrBase = 0x2133,
+  kAttributeGnuRangesBase = 0x2132,
+};
+
+const uint64_t kTagCompileUnit = 0x11;
+const uint64_t kTagPartialUnit = 0x3c;
+const uint64_t kTagSkeletonUnit = 0x4a;
+
+const uint8_t kUnitTypeCompile = 0x01;
+const uint8_t kUnitTypePartial = 0x03;
+const uint8_t kUnitTypeSkeleton = 0x04;
+const uint8_t kUnitTypeSplitCompile = 0x05;
+
+enum RangeListEntry {
+  kRangeListEnd = 0x00,
+  kRangeListBaseAddressx = 0x01,
+  kRangeListStartxEndx = 0x02,
+  kRangeListStartxLength = 0x03,
+  kRangeListOffsetPair = 0x04,
+  kRangeListBaseAddress = 0x05,
+  kRangeListStartEnd = 0x06,
+  kRangeListStartLength = 0x07,
+};
+
+enum LineOpcode {
+  kLineExtended = 0x00,
+  kLineCopy = 0x01,
+  kLineAdvancePc = 0x02,
+  kLineAdvanceLine = 0x03,
+  kLineSetFile = 0x04,
+  kLineSetColumn = 0x05,
+  kLineNegateStmt = 0x06,
+  kLineSetBasicBlock = 0x07,
+  kLineConstAddPc = 0x08,
+  kLineFixedAdvancePc = 0x09,
+};
+
+enum LineExtendedOpcode {
+  kLineEndSequence = 0x01,
+  kLineSetAddress = 0x02,
+  kLineDefineFile = 0x03,
+};
+
+enum LineContentType {
+  kLineContentPath = 0x01,
+  kLineContentDirectoryIndex = 0x02,
+};
+
+const uint64_t kNoLineTable = ~UINT64_C(0);
+
+// Reads little-endian DWARF data, without going past the end. Anything that
+// would returns 0, and the reader isn't ok() from then on.
+class Reader {
+ public:
+  Reader() : begin_(NULL), pos_(NULL), end_(NULL), ok_(false) {}
+  Reader(const uint8_t* data, size_t size)
+      : begin_(data), pos_(data), end_(data + size), ok_(data != NULL) {}
+
+  bool ok() const { return ok_; }
+  bool AtEnd() const { return !ok_ || pos_ >= end_; }
+  size_t remaining() const { return static_cast<size_t>(end_ - pos_); }
+
+  void Seek(uint64_t offset) {
+    if (offset > static_cast<uint64_t>(end_ - begin_))
+      Fail();
+    else
+      pos_ = begin_ + offset;
+  }
+
+  void Skip(uint64_t size) {
+    if (size > remaining())
+      Fail();
+    else
+      pos_ += size;
+  }
+
+  uint64_t Fixed(size_t size) {
+    if (size > remaining()) {
+      Fail();
+      return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i)
+      value |= static_cast<uint64_t>(pos_[i]) << (i * 8);
+    pos_ += size;
+    return value;
+  }
+
+  uint8_t U8() { return static_cast<uint8_t>(Fixed(1)); }
+  uint16_t U16() { return static_cast<uint16_t>(Fixed(2)); }
+  uint32_t U32() { return static_cast<uint32_t>(Fixed(4)); }
+  uint64_t U64() { return Fixed(8); }
+
+  uint64_t Uleb() {
+    uint64_t value = 0;
+    for (int shift = 0; pos_ < end_; shift += 7) {
+      uint8_t byte = *pos_++;
+      if (shift < 64)
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    Fail();
+    return 0;
+  }
+
+  int64_t Sleb() {
+    uint64_t value = 0;
+    int shift = 0;
+    while (pos_ < end_) {
+      uint8_t byte = *pos_++;
+      if (shift < 64)
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+      if (!(byte & 0x80)) {
+        if (shift < 64 && (byte & 0x40))
+          value |= ~UINT64_C(0) << shift;
+        return static_cast<int64_t>(value);
+      }
+    }
+    Fail();
+    return 0;
+  }
+
+  // NULL if it isn't terminated.
+  const char* CString() {
+    if (!ok_)
+      return NULL;
+    const uint8_t* nul =
+        static_cast<const uint8_t*>(memchr(pos_, 0, remaining()));
+    if (!nul) {
+      Fail();
+      return NULL;
+    }
+    const char* string = reinterpret_cast<const char*>(pos_);
+    pos_ = nul + 1;
+    return string;
+  }
+
+  // The 32 or 64-bit length that each unit starts with. |*offset_size| is set
+  // to the size of the offsets in the unit, which goes with it.
+  uint64_t UnitLength(size_t* offset_size) {
+    uint64_t length = U32();
+    *offset_size = 4;
+    if (length == 0xffffffff) {
+      length = U64();
+      *offset_size = 8;
+    }
+    return length;
+  }
+
+  // The next |size| bytes, which this skips.
+  Reader Sub(uint64_t size) {
+    if (size > remaining()) {
+      Fail();
+      return Reader();
+    }
+    Reader sub(pos_, static_cast<size_t>(size));
+    pos_ += size;
+    return sub;
+  }
+
+ private:
+  void Fail() {
+    ok_ = false;
+    pos_ = end_;
+  }
+
+  const uint8_t* begin_;
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  bool ok_;
+};
+
+// The string at |offset| in a string section, or "" if there isn't one.
+const char* StringAt(const ElfFile::Section& section, uint64_t offset) {
+  if (!section.data || offset >= section.size)
+    return "";
+  const uint8_t* start = section.data + offset;
+  if (!memchr(start, 0, section.size - static_cast<size_t>(offset)))
+    return "";
+  return reinterpret_cast<const char*>(start);
+}
+
+struct FormContext {
+  uint16_t version;
+  uint8_t address_size;
+  size_t offset_size;
+  const ElfFile::Section* str;
+  const ElfFile::Section* line_str;
+};
+
+enum FormClass {
+  kClassOther,
+  kClassAddress,
+  // An index into .debug_addr.
+  kClassAddressIndex,
+  kClassConstant,
+  kClassString,
+  kClassSectionOffset,
+  // An index into the unit's offsets at the start of .debug_rnglists.
+  kClassRangeListIndex,
+};
+
+struct FormValue {
+  FormClass form_class;
+  uint64_t value;
+  const char* string;
+};
+
+bool ReadForm(Reader* reader,
+              uint64_t form,
+              int64_t implicit_const,
+              const FormContext& context,
+              FormValue* out) {
+  out->form_class = kClassOther;
+  out->value = 0;
+  out->string = NULL;
+  switch (form) {
+    case kFormAddr:
+      out->form_class = kClassAddress;
+      out->value = reader->Fixed(context.address_size);
+      break;
+    case kFormData1:
+    case kFormRef1:
+    case kFormFlag:
+      out->form_class = kClassConstant;
+      out->value = reader->U8();
+      break;
+    case kFormData2:
+    case kFormRef2:
+      out->form_class = kClassConstant;
+      out->value = reader->U16();
+      break;
+    case kFormData4:
+    case kFormRef4:
+    case kFormRefSup4:
+      out->form_class = kClassConstant;
+      out->value = reader->U32();
+      break;
+    case kFormData8:
+    case kFormRef8:
+    case kFormRefSig8:
+    case kFormRefSup8:
+      out->form_class = kClassConstant;
+      out->value = reader->U64();
+      break;
+    case kFormData16:
+      reader->Skip(16);
+      break;
+    case kFormSdata:
+      out->form_class = kClassConstant;
+      out->value = static_cast<uint64_t>(reader->Sleb());
+      break;
+    case kFormUdata:
+    case kFormRefUdata:
+      out->form_class = kClassConstant;
+      out->value = reader->Uleb();
+      break;
+    case kFormImplicitConst:
+      out->form_class = kClassConstant;
+      out->value = static_cast<uint64_t>(implicit_const);
+      break;
+    case kFormFlagPresent:
+      out->form_class = kClassConstant;
+      out->value = 1;
+      break;
+    case kFormString:
+      out->form_class = kClassString;
+      out->string = reader->CString();
+      break;
+    case kFormStrp:
+      out->form_class = kClassString;
+      out->string = StringAt(*context.str, reader->Fixed(context.offset_size));
+      break;
+    case kFormLineStrp:
+      out->form_class = kClassString;
+      out->string =
+          StringAt(*context.line_str, reader->Fixed(context.offset_size));
+      break;
+    case kFormStrpSup:
+    case kFormGnuStrpAlt:
+    case kFormGnuRefAlt:
+      // In a supplementary file, which isn't looked at.
+      reader->Fixed(context.offset_size);
+      break;
+    case kFormRefAddr:
+      reader->Fixed(context.version <= 2 ? context.address_size
+                                         : context.offset_size);
+      break;
+    case kFormSecOffset:
+      out->form_class = kClassSectionOffset;
+      out->value = reader->Fixed(context.offset_size);
+      break;
+    case kFormStrx:
+    case kFormGnuStrIndex:
+    case kFormLoclistx:
+      reader->Uleb();
+      break;
+    case kFormStrx1:
+      reader->Skip(1);
+      break;
+    case kFormStrx2:
+      reader->Skip(2);
+      break;
+    case kFormStrx3:
+      reader->Skip(3);
+      break;
+    case kFormStrx4:
+      reader->Skip(4);
+      break;
+    case kFormAddrx:
+    case kFormGnuAddrIndex:
+      out->form_class = kClassAddressIndex;
+      out->value = reader->Uleb();
+      break;
+    case kFormAddrx1:
+    case kFormAddrx2:
+    case kFormAddrx3:
+    case kFormAddrx4:
+      out->form_class = kClassAddressIndex;
+      out->value = reader->Fixed(form - kFormAddrx1 + 1);
+      break;
+    case kFormRnglistx:
+      out->form_class = kClassRangeListIndex;
+      out->value = reader->Uleb();
+      break;
+    case kFormBlock1:
+      reader->Skip(reader->U8());
+      break;
+    case kFormBlock2:
+      reader->Skip(reader->U16());
+      break;
+    case kFormBlock4:
+      reader->Skip(reader->U32());
+      break;
+    case kFormBlock:
+    case kFormExprloc:
+      reader->Skip(reader->Uleb());
+      break;
+    case kFormIndirect: {
+      uint64_t actual = reader->Uleb();
+      if (actual == kFormIndirect || actual == kFormImplicitConst)
+        return false;
+      return ReadForm(reader, actual, 0, context, out);
+    }
+    default:
+      // Can't be skipped without knowing how big it is.
+      return false;
+  }
+  return reader->ok();
+}
+
+// What the first entry of a compile unit in .debug_info says about it.
+struct UnitHeader {
+  UnitHeader()
+      : version(0),
+        address_size(0),
+        offset_size(4),
+        line_offset(kNoLineTable),
+        comp_dir(""),
+        low_pc(0),
+        low_pc_class(kClassOther),
+        high_pc(0),
+        high_pc_class(kClassOther),
+        ranges(0),
+        ranges_class(kClassOther),
+        addr_base(0),
+        rnglists_base(0) {}
+
+  uint16_t version;
+  uint8_t address_size;
+  size_t offset_size;
+  uint64_t line_offset;
+  const char* comp_dir;
+  uint64_t low_pc;
+  FormClass low_pc_class;
+  uint64_t high_pc;
+  FormClass high_pc_class;
+  uint64_t ranges;
+  FormClass ranges_class;
+  uint64_t addr_base;
+  uint64_t rnglists_base;
+};
+
+struct Row {
+  uint64_t address;
+  uint32_t file;
+  uint32_t line;
+  uint16_t column;
+  bool is_stmt;
+  bool end_sequence;
+};
+
+bool RowLess(const Row& a, const Row& b) {
+  if (a.address != b.address)
+    return a.address < b.address;
+  // Where one sequence ends where another starts, the address is in the
+  // second.
+  return a.end_sequence && !b.end_sequence;
+}
+
+std::string JoinPath(const std::string& directory, const char* name) {
+  if (name[0] == '/' || directory.empty())
+    return name;
+  if (directory.back() == '/')
+    return directory + name;
+  return directory + "/" + name;
+}
+
+// Whether |path| is |suffix|, or ends with it after a '/'.
+bool PathEndsWith(const std::string& path, const std::string& suffix) {
+  if (suffix.size() > path.size() ||
+      path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+    return false;
+  }
+  return suffix.size() == path.size() || suffix[0] == '/' ||
+         path[path.size() - suffix.size() - 1] == '/';
+}
+
+}  // namespace
+
+struct LineIndex::Unit {
+  Unit() : decoded(0) {}
+
+  UnitHeader header;
+  Mutex mutex;
+  Atomic<int32_t> decoded;
+  // Set once |decoded| is, and not changed after that.
+  std::vector<std::string> paths;
+  // Sorted by address.
+  std::vector<Row> rows;
+};
+
+LineIndex::LineIndex(const ElfFile& file)
+    : unit_count_(0), all_decoded_(0), next_unit_(0) {
+  const ElfFile::Section empty = {"", 0, 0, 0, 0, NULL, 0};
+  struct {
+    const char* name;
+    ElfFile::Section* section;
+  } sections[] = {
+      {".debug_info", &info_},
+      {".debug_abbrev", &abbrev_},
+      {".debug_line", &line_},
+      {".debug_str", &str_},
+      {".debug_line_str", &line_str_},
+      {".debug_addr", &addr_},
+      {".debug_ranges", &ranges_},
+      {".debug_rnglists", &rnglists_},
+  };
+  for (const auto& it : sections) {
+    const ElfFile::Section* section = file.FindSection(it.name);
+    *it.section = section ? *section : empty;
+  }
+  ReadUnits();
+}
+
+LineIndex::~LineIndex() {}
+
+bool LineIndex::Lookup(uint64_t address, LineLocation* location) {
+  auto lookup = [this, address, location](Unit* unit) {
+    Decode(unit);
+    Row key = {address, 0, 0, 0, false, false};
+    auto row = std::upper_bound(
+        unit->rows.begin(), unit->rows.end(), key, RowLess);
+    if (row == unit->rows.begin())
+      return false;
+    --row;
+    if (row->end_sequence || row->file >= unit->paths.size())
+      return false;
+    location->path = unit->paths[row->file];
+    location->line = row->line;
+    location->column = row->column;
+    return true;
+  };
+
+  Range key = {address, 0, 0};
+  auto range = std::upper_bound(
+      unit_ranges_.begin(),
+      unit_ranges_.end(),
+      key,
+      [](const Range& a, const Range& b) { return a.begin < b.begin; });
+  if (range != unit_ranges_.begin()) {
+    --range;
+    if (address < range->end && lookup(&units_[range->unit]))
+      return true;
+  }
+
+  // Not from a unit that said it had the address, so it's either not in any,
+  // or in one that didn't say.
+  for (uint32_t unit : unranged_units_) {
+    if (lookup(&units_[unit]))
+      return true;
+  }
+  return false;
+}
+
+std::vector<uint64_t> LineIndex::FindAddresses(const std::string& path,
+                                               uint32_t line) {
+  DecodeAll();
+
+  // The files in each unit that match, as there are far fewer of them than
+  // rows, and the first line that has code, from |line|.
+  std::vector<std::vector<bool>> matches(unit_count_);
+  uint32_t best_line = UINT32_MAX;
+  for (size_t i = 0; i < unit_count_; ++i) {
+    const Unit& unit = units_[i];
+    bool any = false;
+    matches[i].resize(unit.paths.size());
+    for (size_t j = 0; j < unit.paths.size(); ++j) {
+      if (PathEndsWith(unit.paths[j], path)) {
+        matches[i][j] = true;
+        any = true;
+      }
+    }
+    if (!any)
+      continue;
+    for (const Row& row : unit.rows) {
+      if (row.is_stmt && !row.end_sequence && row.line >= line &&
+          row.line < best_line && row.file < matches[i].size() &&
+          matches[i][row.file]) {
+        best_line = row.line;
+      }
+    }
+  }
+
+  std::vector<uint64_t> addresses;
+  if (best_line == UINT32_MAX)
+    return addresses;
+  for (size_t i = 0; i < unit_count_; ++i) {
+    const std::vector<Row>& rows = units_[i].rows;
+    for (size_t j = 0; j < rows.size(); ++j) {
+      const Row& row = rows[j];
+      if (!row.is_stmt || row.end_sequence || row.line != best_line ||
+          row.file >= matches[i].size() || !matches[i][row.file]) {
+        continue;
+      }
+      // Only where the line starts, rather than each row of it.
+      if (j > 0 && !rows[j - 1].end_sequence && rows[j - 1].is_stmt &&
+          rows[j - 1].line == row.line && rows[j - 1].file == row.file) {
+        continue;
+      }
+      addresses.push_back(row.address);
+    }
+  }
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+  return addresses;
+}
+
+size_t LineIndex::decoded_unit_count() const {
+  size_t count = 0;
+  for (size_t i = 0; i < unit_count_; ++i) {
+    if (units_[i].decoded.Load(std::memory_order_acquire))
+      ++count;
+  }
+  return count;
+}
+
+void LineIndex::ReadUnits() {
+  std::vector<UnitHeader> headers;
+  Reader info(info_.data, info_.size);
+  while (!info.AtEnd()) {
+    size_t offset_size;
+    uint64_t length = info.UnitLength(&offset_size);
+    Reader reader = info.Sub(length);
+    if (!info.ok())
+      break;
+
+    UnitHeader header;
+    header.offset_size = offset_size;
+    header.version = reader.U16();
+    if (header.version < 2 || header.version > 5)
+      continue;
+    uint64_t abbrev_offset;
+    if (header.version >= 5) {
+      uint8_t type = reader.U8();
+      header.address_size = reader.U8();
+      abbrev_offset = reader.Fixed(offset_size);
+      if (type == kUnitTypeSkeleton || type == kUnitTypeSplitCompile)
+        reader.Skip(8);
+      else if (type != kUnitTypeCompile && type != kUnitTypePartial)
+        continue;
+    } else {
+      abbrev_offset = reader.Fixed(offset_size);
+      header.address_size = reader.U8();
+    }
+    if (header.address_size != 4 && header.address_size != 8)
+      continue;
+
+    // Only the unit's own entry is wanted, which comes first.
+    uint64_t code = reader.Uleb();
+    if (!reader.ok() || code == 0)
+      continue;
+    Reader abbrev(abbrev_.data, abbrev_.size);
+    abbrev.Seek(abbrev_offset);
+    uint64_t tag = 0;
+    while (abbrev.ok()) {
+      uint64_t abbrev_code = abbrev.Uleb();
+      if (abbrev_code == 0) {
+        abbrev = Reader();
+        break;
+      }
+      tag = abbrev.Uleb();
+      abbrev.U8();  // Whether it has children.
+      if (abbrev_code == code)
+        break;
+      for (;;) {
+        uint64_t attribute = abbrev.Uleb();
+        uint64_t form = abbrev.Uleb();
+        if (form == kFormImplicitConst)
+          abbrev.Sleb();
+        if ((attribute == 0 && form == 0) || !abbrev.ok())
+          break;
+      }
+    }
+    if (!abbrev.ok() || (tag != kTagCompileUnit && tag != kTagPartialUnit &&
+                         tag != kTagSkeletonUnit)) {
+      continue;
+    }
+
+    FormContext context = {
+        header.version, header.address_size, offset_size, &str_, &line_str_};
+    for (;;) {
+      uint64_t attribute = abbrev.Uleb();
+      uint64_t form = abbrev.Uleb();
+      int64_t implicit_const = form == kFormImplicitConst ? abbrev.Sleb() : 0;
+      if ((attribute == 0 && form == 0) || !abbrev.ok())
+        break;
+      FormValue value;
+      if (!ReadForm(&reader, form, implicit_const, context, &value))
+        break;
+      switch (attribute) {
+        case kAttributeStmtList:
+          header.line_offset = value.value;
+          break;
+        case kAttributeLowPc:
+          header.low_pc = value.value;
+          header.low_pc_class = value.form_class;
+          break;
+        case kAttributeHighPc:
+          header.high_pc = value.value;
+          header.high_pc_class = value.form_class;
+          break;
+        case kAttributeRanges:
+          header.ranges = value.value;
+          header.ranges_class = value.form_class;
+          // Before DWARF 4, offsets were constants.
+          if (header.version < 4 && value.form_class == kClassConstant)
+            header.ranges_class = kClassSectionOffset;
+          break;
+        case kAttributeCompDir:
+          if (value.string)
+            header.comp_dir = value.string;
+          break;
+        case kAttributeAddrBase:
+        case kAttributeGnuAddrBase:
+          header.addr_base = value.value;
+          break;
+        case kAttributeRnglistsBase:
+        case kAttributeGnuRangesBase:
+          header.rnglists_base = value.value;
+          break;
+      }
+    }
+    if (header.line_offset != kNoLineTable)
+      headers.push_back(header);
+  }
+
+  unit_count_ = headers.size();
+  units_.reset(new Unit[unit_count_]);
+  for (size_t i = 0; i < unit_count_; ++i) {
+    const UnitHeader& header = headers[i];
+    units_[i].header = header;
+    uint32_t index = static_cast<uint32_t>(i);
+    size_t ranges_before = unit_ranges_.size();
+
+    auto address_at = [this, &header](uint64_t index, bool* ok) {
+      Reader addr(addr_.data, addr_.size);
+      addr.Seek(header.addr_base + index * header.address_size);
+      uint64_t address = addr.Fixed(header.address_size);
+      *ok = *ok && addr.ok();
+      return address;
+    };
+    auto add = [this, index](uint64_t begin, uint64_t end) {
+      if (begin < end) {
+        Range range = {begin, end, index};
+        unit_ranges_.push_back(range);
+      }
+    };
+
+    bool ok = true;
+    uint64_t low_pc = header.low_pc;
+    if (header.low_pc_class == kClassAddressIndex)
+      low_pc = address_at(header.low_pc, &ok);
+    if (header.ranges_class == kClassSectionOffset && header.version < 5) {
+      Reader ranges(ranges_.data, ranges_.size);
+      ranges.Seek(header.ranges);
+      uint64_t base = low_pc;
+      uint64_t base_marker = header.address_size == 4 ? 0xffffffff
+                                                      : ~UINT64_C(0);
+      while (ranges.ok()) {
+        uint64_t begin = ranges.Fixed(header.address_size);
+        uint64_t end = ranges.Fixed(header.address_size);
+        if (!ranges.ok() || (begin == 0 && end == 0))
+          break;
+        if (begin == base_marker)
+          base = end;
+        else
+          add(base + begin, base + end);
+      }
+    } else if (header.ranges_class == kClassSectionOffset ||
+               header.ranges_class == kClassRangeListIndex) {
+      Reader ranges(rnglists_.data, rnglists_.size);
+      uint64_t offset = header.ranges;
+      if (header.ranges_class == kClassRangeListIndex) {
+        ranges.Seek(header.rnglists_base + offset * header.offset_size);
+        offset = header.rnglists_base + ranges.Fixed(header.offset_size);
+      }
+      ranges.Seek(offset);
+      uint64_t base = low_pc;
+      while (ranges.ok() && ok) {
+        uint8_t kind = ranges.U8();
+        if (kind == kRangeListEnd || !ranges.ok())
+          break;
+        uint64_t begin, end;
+        switch (kind) {
+          case kRangeListBaseAddressx:
+            base = address_at(ranges.Uleb(), &ok);
+            break;
+          case kRangeListStartxEndx:
+            begin = address_at(ranges.Uleb(), &ok);
+            add(begin, address_at(ranges.Uleb(), &ok));
+            break;
+          case kRangeListStartxLength:
+            begin = address_at(ranges.Uleb(), &ok);
+            add(begin, begin + ranges.Uleb());
+            break;
+          case kRangeListOffsetPair:
+            begin = ranges.Uleb();
+            end = ranges.Uleb();
+            add(base + begin, base + end);
+            break;
+          case kRangeListBaseAddress:
+            base = ranges.Fixed(header.address_size);
+            break;
+          case kRangeListStartEnd:
+            begin = ranges.Fixed(header.address_size);
+            add(begin, ranges.Fixed(header.address_size));
+            break;
+          case kRangeListStartLength:
+            begin = ranges.Fixed(header.address_size);
+            add(begin, begin + ranges.Uleb());
+            break;
+          default:
+            ok = false;
+            break;
+        }
+      }
+    } else if (header.high_pc_class == kClassConstant) {
+      add(low_pc, low_pc + header.high_pc);
+    } else if (header.high_pc_class == kClassAddress) {
+      add(low_pc, header.high_pc);
+    } else if (header.high_pc_class == kClassAddressIndex) {
+      uint64_t high_pc = address_at(header.high_pc, &ok);
+      add(low_pc, high_pc);
+    }
+
+    // Linkers leave the code that they've dropped at 0.
+    auto dropped = [](const Range& range) { return range.begin == 0; };
+    unit_ranges_.erase(std::remove_if(unit_ranges_.begin() + ranges_before,
+                                      unit_ranges_.end(),
+                                      dropped),
+                       unit_ranges_.end());
+    if (!ok) {
+      unit_ranges_.resize(ranges_before);
+      unranged_units_.push_back(index);
+    } else if (unit_ranges_.size() == ranges_before) {
+      unranged_units_.push_back(index);
+    }
+  }
+  std::sort(unit_ranges_.begin(),
+            unit_ranges_.end(),
+            [](const Range& a, const Range& b) { return a.begin < b.begin; });
+}
+
+void LineIndex::Decode(Unit* unit) {
+  if (unit->decoded.Load(std::memory_order_acquire))
+    return;
+  MutexScope lock(&unit->mutex);
+  if (unit->decoded.Load(std::memory_order_relaxed))
+    return;
+
+  const UnitHeader& header = unit->header;
+  std::vector<std::string> directories;
+  std::vector<Row> rows;
+  Reader section(line_.data, line_.size);
+  section.Seek(header.line_offset);
+  size_t offset_size;
+  uint64_t length = section.UnitLength(&offset_size);
+  Reader reader = section.Sub(length);
+
+  uint16_t version = reader.U16();
+  uint8_t address_size = header.address_size;
+  if (version >= 5) {
+    address_size = reader.U8();
+    reader.U8();  // Segment selector size.
+  }
+  uint64_t header_length = reader.Fixed(offset_size);
+  Reader program = reader;
+  program.Skip(header_length);
+  uint8_t minimum_instruction_length = reader.U8();
+  if (version >= 4)
+    reader.U8();  // Maximum operations per instruction, for VLIW.
+  bool default_is_stmt = reader.U8() != 0;
+  int8_t line_base = static_cast<int8_t>(reader.U8());
+  uint8_t line_range = reader.U8();
+  uint8_t opcode_base = reader.U8();
+  std::vector<uint8_t> opcode_lengths(opcode_base ? opcode_base - 1 : 0);
+  for (uint8_t& opcode_length : opcode_lengths)
+    opcode_length = reader.U8();
+  if (version < 2 || version > 5 || line_range == 0 || opcode_base == 0 ||
+      (address_size != 4 && address_size != 8)) {
+    reader = Reader();
+  }
+
+  if (version >= 5) {
+    // Described by a list of what's in each entry, and then the entries.
+    // Directory 0 is the unit's, as is file 0.
+    FormContext context = {
+        version, address_size, offset_size, &str_, &line_str_};
+    std::vector<std::pair<uint64_t, uint64_t>> formats;
+    std::vector<std::pair<std::string, uint64_t>> files;
+    for (int table = 0; table < 2 && reader.ok(); ++table) {
+      formats.resize(reader.U8());
+      for (auto& format : formats) {
+        format.first = reader.Uleb();
+        format.second = reader.Uleb();
+      }
+      uint64_t count = reader.Uleb();
+      for (uint64_t i = 0; i < count && reader.ok(); ++i) {
+        const char* path = "";
+        uint64_t directory = 0;
+        for (const auto& format : formats) {
+          FormValue value;
+          if (!ReadForm(&reader, format.second, 0, context, &value)) {
+            reader = Reader();
+            break;
+          }
+          if (format.first == kLineContentPath && value.string)
+            path = value.string;
+          else if (format.first == kLineContentDirectoryIndex)
+            directory = value.value;
+        }
+        if (table == 0) {
+          directories.push_back(
+              directories.empty() ? path : JoinPath(directories[0], path));
+        } else {
+          files.push_back(std::make_pair(std::string(path), directory));
+        }
+      }
+    }
+    for (const auto& file : files) {
+      unit->paths.push_back(
+          file.second < directories.size()
+              ? JoinPath(directories[file.second], file.first.c_str())
+              : file.first);
+    }
+  } else {
+    // Directories and files are from 1, with directory 0 being the unit's,
+    // and file 0 unused.
+    directories.push_back(header.comp_dir);
+    while (reader.ok()) {
+      const char* directory = reader.CString();
+      if (!directory || !directory[0])
+        break;
+      directories.push_back(JoinPath(directories[0], directory));
+    }
+    unit->paths.push_back(std::string());
+    while (reader.ok()) {
+      const char* name = reader.CString();
+      if (!name || !name[0])
+        break;
+      uint64_t directory = reader.Uleb();
+      reader.Uleb();  // Modified time.
+      reader.Uleb();  // Size.
+      unit->paths.push_back(directory < directories.size()
+                                ? JoinPath(directories[directory], name)
+                                : name);
+    }
+  }
+  if (!reader.ok())
+    program = Reader();
+
+  // The line number program's state machine, which emits a row at a time,
+  // in sequences of increasing address.
+  Row state;
+  auto reset = [&state, default_is_stmt]() {
+    state.address = 0;
+    state.file = 1;
+    state.line = 1;
+    state.column = 0;
+    state.is_stmt = default_is_stmt;
+    state.end_sequence = false;
+  };
+  reset();
+  size_t sequence_start = rows.size();
+  while (!program.AtEnd()) {
+    uint8_t opcode = program.U8();
+    if (opcode >= opcode_base) {
+      uint8_t adjusted = opcode - opcode_base;
+      state.address += (adjusted / line_range) * minimum_instruction_length;
+      state.line += line_base + adjusted % line_range;
+      rows.push_back(state);
+      continue;
+    }
+    switch (opcode) {
+      case kLineExtended: {
+        uint64_t size = program.Uleb();
+        Reader extended = program.Sub(size);
+        switch (extended.U8()) {
+          case kLineEndSequence:
+            state.end_sequence = true;
+            rows.push_back(state);
+            // Linkers leave the code that they've dropped at 0, or at ~0 or
+            // ~1 with lld.
+            if (rows[sequence_start].address == 0 ||
+                rows[sequence_start].address >= ~UINT64_C(1)) {
+              rows.resize(sequence_start);
+            }
+            sequence_start = rows.size();
+            reset();
+            break;
+          case kLineSetAddress:
+            if (size - 1 <= sizeof(state.address))
+              state.address = extended.Fixed(static_cast<size_t>(size - 1));
+            break;
+          case kLineDefineFile: {
+            const char* name = extended.CString();
+            uint64_t directory = extended.Uleb();
+            if (name) {
+              unit->paths.push_back(directory < directories.size()
+                                        ? JoinPath(directories[directory], name)
+                                        : name);
+            }
+            break;
+          }
+          default:
+            break;
+        }
+        break;
+      }
+      case kLineCopy:
+        rows.push_back(state);
+        break;
+      case kLineAdvancePc:
+        state.address += program.Uleb() * minimum_instruction_length;
+        break;
+      case kLineAdvanceLine:
+        state.line += static_cast<uint32_t>(program.Sleb());
+        break;
+      case kLineSetFile:
+        state.file = static_cast<uint32_t>(program.Uleb());
+        break;
+      case kLineSetColumn:
+        state.column = static_cast<uint16_t>(program.Uleb());
+        break;
+      case kLineNegateStmt:
+        state.is_stmt = !state.is_stmt;
+        break;
+      case kLineSetBasicBlock:
+        break;
+      case kLineConstAddPc:
+        state.address +=
+            ((255 - opcode_base) / line_range) * minimum_instruction_length;
+        break;
+      case kLineFixedAdvancePc:
+        state.address += program.U16();
+        break;
+      default:
+        // Newer than this, but it says how many operands to skip.
+        for (uint8_t i = 0; i < opcode_lengths[opcode - 1]; ++i)
+          program.Uleb();
+        break;
+    }
+  }
+  // Anything after the last complete sequence is junk.
+  rows.resize(sequence_start);
+
+  std::stable_sort(rows.begin(), rows.end(), RowLess);
+  rows.shrink_to_fit();
+  unit->rows.swap(rows);
+  unit->decoded.Store(1, std::memory_order_release);
+}
+
+void LineIndex::DecodeAll() {
+  if (all_decoded_.Load(std::memory_order_acquire))
+    return;
+  MutexScope lock(&decode_all_mutex_);
+  if (all_decoded_.Load(std::memory_order_relaxed))
+    return;
+
+  // The units are handed out one at a time, as they're very different sizes.
+  // Any that have been decoded already are skipped straight over.
+  next_unit_.Store(0);
+  size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::min(thread_count, std::max<size_t>(unit_count_ / 8, 1));
+  std::unique_ptr<Thread[]> threads(new Thread[thread_count - 1]);
+  for (size_t i = 0; i < thread_count - 1; ++i)
+    threads[i].Start(DecodeThreadMain, this, "LineIndex");
+  DecodeThreadMain(this);
+  for (size_t i = 0; i < thread_count - 1; ++i)
+    threads[i].Join();
+  all_decoded_.Store(1, std::memory_order_release);
+}
+
+// static
+int32_t LineIndex::DecodeThreadMain(void* user_data) {
+  LineIndex* index = static_cast<LineIndex*>(user_data);
+  for (;;) {
+    size_t unit = index->next_unit_.FetchAdd(1, std::memory_order_relaxed);
+    if (unit >= index->unit_count_)
+      break;
+    index->Decode(&index->units_[unit]);
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ELF_LINE_INDEX_H_
+#define ELF_LINE_INDEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core.h"
+#include "elf/elf_file.h"
+
+// Where some code came from.
+struct LineLocation {
+  std::string path;
+  uint32_t line;
+  // 0 if it isn't known.
+  uint32_t column;
+};
+
+// Maps addresses to source lines and back, from a binary's DWARF line tables.
+//
+// A big binary has tens of thousands of compile units, and decoding all of
+// their line tables takes seconds, so only each unit's first entry in
+// .debug_info is read up front, for the addresses that it covers and where
+// its line table is. A unit's line table is decoded the first time something
+// in it is asked for. Finding a line means looking in every unit, so then the
+// ones that are left are all decoded at once, in parallel.
+//
+// Addresses are as linked, rather than where they're loaded. This is safe to
+// use from any thread.
+class LineIndex {
+ public:
+  // |file| must outlive this.
+  explicit LineIndex(const ElfFile& file);
+  ~LineIndex();
+
+  // Returns false if there isn't a line for |address|.
+  bool Lookup(uint64_t address, LineLocation* location);
+
+  // Where the statements for |line| of the file whose path ends with |path|
+  // start, e.g. for breakpoints. If there's no code for |line|, it's for the
+  // next line that has some.
+  std::vector<uint64_t> FindAddresses(const std::string& path, uint32_t line);
+
+  size_t unit_count() const { return unit_count_; }
+  size_t decoded_unit_count() const;
+
+ private:
+  struct Unit;
+  struct Range {
+    uint64_t begin;
+    uint64_t end;
+    uint32_t unit;
+  };
+
+  void ReadUnits();
+  void Decode(Unit* unit);
+  void DecodeAll();
+  static int32_t DecodeThreadMain(void* user_data);
+
+  ElfFile::Section info_;
+  ElfFile::Section abbrev_;
+  ElfFile::Section line_;
+  ElfFile::Section str_;
+  ElfFile::Section line_str_;
+  ElfFile::Section addr_;
+  ElfFile::Section ranges_;
+  ElfFile::Section rnglists_;
+
+  std::unique_ptr<Unit[]> units_;
+  size_t unit_count_;
+  // Sorted by |begin|.
+  std::vector<Range> unit_ranges_;
+  // Those that didn't say which addresses they cover, which are only looked
+  // in if none of the others have an address.
+  std::vector<uint32_t> unranged_units_;
+
+  Mutex decode_all_mutex_;
+  Atomic<int32_t> all_decoded_;
+  Atomic<size_t> next_unit_;
+
+  DISALLOW_COPY_AND_ASSIGN(LineIndex);
+};
+
+#endif  // ELF_LINE_INDEX_H_
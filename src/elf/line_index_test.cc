@@ -0,0 +1,117 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "elf/line_index.h"
+
+#include <gtest/gtest.h>
+#include <link.h>
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+const uint32_t kFunctionLine = __LINE__ + 1;
+extern "C" NO_INLINE int LineIndexTestFunction(int x) {
+  return x * 5 + 2;
+}
+
+namespace {
+
+int GetMainProgramBias(dl_phdr_info* info, size_t, void* data) {
+  // The main program is always first.
+  *static_cast<uint64_t*>(data) = info->dlpi_addr;
+  return 1;
+}
+
+// Where LineIndexTestFunction() is, as linked.
+uint64_t GetFunctionAddress() {
+  uint64_t bias = 0;
+  dl_iterate_phdr(GetMainProgramBias, &bias);
+  return reinterpret_cast<uint64_t>(&LineIndexTestFunction) - bias;
+}
+
+// The function's entry is its first line, or, without a prologue, the line
+// after.
+bool IsFunctionLine(uint32_t line) {
+  return line == kFunctionLine || line == kFunctionLine + 1;
+}
+
+bool EndsWith(const std::string& string, const std::string& suffix) {
+  return string.size() >= suffix.size() &&
+         string.compare(
+             string.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+class LineIndexTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    file_.reset(ElfFile::Open("/proc/self/exe"));
+    ASSERT_TRUE(file_);
+    index_.reset(new LineIndex(*file_));
+  }
+
+  std::unique_ptr<ElfFile> file_;
+  std::unique_ptr<LineIndex> index_;
+};
+
+}  // namespace
+
+TEST_F(LineIndexTest, LookupDecodesOnlyWhatItNeeds) {
+  // Every test has a unit, at least.
+  ASSERT_GT(index_->unit_count(), 1u);
+  EXPECT_EQ(0u, index_->decoded_unit_count());
+
+  LineLocation location;
+  ASSERT_TRUE(index_->Lookup(GetFunctionAddress(), &location));
+  EXPECT_TRUE(EndsWith(location.path, "/elf/line_index_test.cc"))
+      << location.path;
+  EXPECT_TRUE(IsFunctionLine(location.line)) << location.line;
+  EXPECT_EQ(1u, index_->decoded_unit_count());
+
+  // Nothing has code at 0.
+  EXPECT_FALSE(index_->Lookup(0, &location));
+  EXPECT_EQ(7, LineIndexTestFunction(1));
+}
+
+TEST_F(LineIndexTest, FindAddresses) {
+  std::vector<uint64_t> addresses =
+      index_->FindAddresses("elf/line_index_test.cc", kFunctionLine);
+  EXPECT_EQ(index_->unit_count(), index_->decoded_unit_count());
+  EXPECT_NE(addresses.end(),
+            std::find(addresses.begin(), addresses.end(),
+                      GetFunctionAddress()));
+
+  // The line before the function has no code, so it's the function's.
+  EXPECT_EQ(addresses,
+            index_->FindAddresses("line_index_test.cc", kFunctionLine - 1));
+
+  // Only whole path components match.
+  EXPECT_TRUE(
+      index_->FindAddresses("ne_index_test.cc", kFunctionLine).empty());
+  EXPECT_TRUE(index_->FindAddresses("nonexistent.cc", 1).empty());
+
+  // And everything can still be looked up.
+  LineLocation location;
+  ASSERT_TRUE(index_->Lookup(GetFunctionAddress(), &location));
+  EXPECT_TRUE(IsFunctionLine(location.line)) << location.line;
+}
+
+TEST_F(LineIndexTest, FromManyThreads) {
+  // Each unit is decoded once, however many ask for it at once.
+  uint64_t address = GetFunctionAddress();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread([this, address] {
+      LineLocation location;
+      EXPECT_TRUE(index_->Lookup(address, &location));
+      EXPECT_TRUE(IsFunctionLine(location.line)) << location.line;
+      EXPECT_FALSE(
+          index_->FindAddresses("line_index_test.cc", kFunctionLine).empty());
+    }));
+  }
+  for (auto& thread : threads)
+    thread.join();
+  EXPECT_EQ(index_->unit_count(), index_->decoded_unit_count());
+}
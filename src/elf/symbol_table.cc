@@ -0,0 +1,115 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "elf/symbol_table.h"
+
+#include <elf.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "elf/elf_file.h"
+
+namespace {
+
+void AddSymbols(const ElfFile& file,
+                const ElfFile::Section* table,
+                std::vector<Symbol>* symbols) {
+  if (!table || !table->data || table->link >= file.sections().size())
+    return;
+  const ElfFile::Section& strings = file.sections()[table->link];
+  // As with the section names, an unterminated table isn't used at all.
+  if (!strings.data || strings.size == 0 || strings.data[strings.size - 1])
+    return;
+  const char* names = reinterpret_cast<const char*>(strings.data);
+
+  size_t count = table->size / sizeof(Elf64_Sym);
+  symbols->reserve(symbols->size() + count);
+  for (size_t i = 0; i < count; ++i) {
+    Elf64_Sym in;
+    memcpy(&in, table->data + i * sizeof(in), sizeof(in));
+    int type = ELF64_ST_TYPE(in.st_info);
+    if ((type != STT_FUNC && type != STT_OBJECT && type != STT_GNU_IFUNC) ||
+        in.st_shndx == SHN_UNDEF || in.st_name == 0 ||
+        in.st_name >= strings.size) {
+      continue;
+    }
+    Symbol out = {in.st_value, in.st_size, names + in.st_name};
+    symbols->push_back(out);
+  }
+}
+
+}  // namespace
+
+SymbolTable::SymbolTable(const ElfFile& file) {
+  // .dynsym is mostly a copy of part of .symtab, but it's all there is once
+  // a binary's been stripped.
+  AddSymbols(file, file.FindSection(".symtab"), &symbols_);
+  AddSymbols(file, file.FindSection(".dynsym"), &symbols_);
+  BuildIndex();
+}
+
+SymbolTable::SymbolTable(const std::vector<Symbol>& symbols)
+    : symbols_(symbols) {
+  BuildIndex();
+}
+
+SymbolTable::~SymbolTable() {}
+
+const Symbol* SymbolTable::Lookup(uint64_t address) const {
+  // Down the tree without branching, going right past every key that's <=
+  // |address|. The last left turn was at the first key that's greater, so
+  // undoing the right turns after it, and it, leads back there.
+  size_t count = symbols_.size();
+  const uint64_t* keys = keys_.data();
+  size_t node = 1;
+  while (node <= count)
+    node = 2 * node + (keys[node] <= address);
+  while (node & 1)
+    node >>= 1;
+  node >>= 1;
+
+  // The one before the first that's greater.
+  size_t upper = node ? ranks_[node] : count;
+  if (upper == 0)
+    return NULL;
+  const Symbol& symbol = symbols_[upper - 1];
+  if (symbol.size && address - symbol.address >= symbol.size)
+    return NULL;
+  return &symbol;
+}
+
+void SymbolTable::BuildIndex() {
+  // Where symbols share an address, such as aliases, or the same one from
+  // both tables, the first that has a size is kept.
+  std::stable_sort(symbols_.begin(),
+                   symbols_.end(),
+                   [](const Symbol& a, const Symbol& b) {
+                     if (a.address != b.address)
+                       return a.address < b.address;
+                     return a.size && !b.size;
+                   });
+  symbols_.erase(std::unique(symbols_.begin(),
+                             symbols_.end(),
+                             [](const Symbol& a, const Symbol& b) {
+                               return a.address == b.address;
+                             }),
+                 symbols_.end());
+  symbols_.shrink_to_fit();
+
+  CHECK(symbols_.size() < UINT32_MAX);
+  keys_.resize(symbols_.size() + 1);
+  ranks_.resize(symbols_.size() + 1);
+  FillIndex(0, 1);
+}
+
+size_t SymbolTable::FillIndex(size_t next, size_t node) {
+  // In order, so the sorted symbols go into the tree sorted.
+  if (node > symbols_.size())
+    return next;
+  next = FillIndex(next, 2 * node);
+  keys_[node] = symbols_[next].address;
+  ranks_[node] = static_cast<uint32_t>(next);
+  return FillIndex(next + 1, 2 * node + 1);
+}
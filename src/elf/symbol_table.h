@@ -0,0 +1,56 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ELF_SYMBOL_TABLE_H_
+#define ELF_SYMBOL_TABLE_H_
+
+#include <vector>
+
+#include "core.h"
+
+class ElfFile;
+
+struct Symbol {
+  // As linked, rather than where it's loaded.
+  uint64_t address;
+  // 0 if it isn't known, in which case it goes up to the next symbol.
+  uint64_t size;
+  // Mangled, and pointing into the file's string table, rather than copied.
+  const char* name;
+};
+
+// The functions and variables of a binary, by address, for symbolizing
+// addresses such as a stack's return addresses.
+//
+// The addresses are searched in Eytzinger order (a binary heap's layout, so
+// that the first few levels of every search share cache lines), rather than
+// sorted, which is several times faster than a binary search once the table
+// doesn't fit in the cache.
+class SymbolTable {
+ public:
+  // From .symtab and .dynsym. |file| must outlive this.
+  explicit SymbolTable(const ElfFile& file);
+  explicit SymbolTable(const std::vector<Symbol>& symbols);
+  ~SymbolTable();
+
+  // The symbol that |address| is in, or NULL if there isn't one.
+  const Symbol* Lookup(uint64_t address) const;
+
+  // Sorted by address, with one for each address.
+  const std::vector<Symbol>& symbols() const { return symbols_; }
+
+ private:
+  void BuildIndex();
+  size_t FillIndex(size_t next, size_t node);
+
+  std::vector<Symbol> symbols_;
+  // |symbols_|'s addresses in Eytzinger order, from 1, and where each is in
+  // |symbols_|.
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> ranks_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolTable);
+};
+
+#endif  // ELF_SYMBOL_TABLE_H_
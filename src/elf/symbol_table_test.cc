@@ -0,0 +1,120 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "elf/symbol_table.h"
+
+#include <gtest/gtest.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include "elf/elf_file.h"
+
+extern "C" NO_INLINE int SymbolTableTestFunction(int x) {
+  return x * 3 + 1;
+}
+
+namespace {
+
+// The symbol that |address| is in, the slow way.
+const Symbol* ExpectedLookup(const std::vector<Symbol>& sorted,
+                             uint64_t address) {
+  const Symbol* found = NULL;
+  for (const auto& symbol : sorted) {
+    if (symbol.address <= address)
+      found = &symbol;
+  }
+  if (found && found->size && address - found->address >= found->size)
+    return NULL;
+  return found;
+}
+
+int GetMainProgramBias(dl_phdr_info* info, size_t, void* data) {
+  // The main program is always first.
+  *static_cast<uint64_t*>(data) = info->dlpi_addr;
+  return 1;
+}
+
+}  // namespace
+
+TEST(SymbolTable, Lookup) {
+  static const char* const kNames[] = {"a", "b", "c", "d"};
+  // Every size of tree up to a few levels, so every shape of the last level
+  // is searched.
+  for (size_t count = 0; count < 70; ++count) {
+    std::vector<Symbol> symbols;
+    for (size_t i = 0; i < count; ++i) {
+      // Backwards, to be sorted, with gaps between some, and some without
+      // sizes.
+      uint64_t address = 100 + (count - i) * 10;
+      Symbol symbol = {address, i % 3 == 0 ? 0u : 4u, kNames[i % 4]};
+      symbols.push_back(symbol);
+    }
+    SymbolTable table(symbols);
+    ASSERT_EQ(count, table.symbols().size());
+    for (uint64_t address = 0; address < 100 + (count + 2) * 10; ++address) {
+      const Symbol* expected = ExpectedLookup(table.symbols(), address);
+      EXPECT_EQ(expected, table.Lookup(address)) << count << " " << address;
+    }
+    EXPECT_EQ(ExpectedLookup(table.symbols(), ~UINT64_C(0)),
+              table.Lookup(~UINT64_C(0)));
+  }
+}
+
+TEST(SymbolTable, Duplicates) {
+  std::vector<Symbol> symbols = {
+      {0x1000, 0, "alias"},
+      {0x1000, 0x20, "sized"},
+      {0x1000, 0x10, "other"},
+      {0x2000, 0x10, "next"},
+  };
+  SymbolTable table(symbols);
+  ASSERT_EQ(2u, table.symbols().size());
+  const Symbol* symbol = table.Lookup(0x101f);
+  ASSERT_TRUE(symbol);
+  EXPECT_STREQ("sized", symbol->name);
+  EXPECT_EQ(NULL, table.Lookup(0x1020));
+  EXPECT_EQ(NULL, table.Lookup(0xfff));
+}
+
+TEST(SymbolTable, FromBinary) {
+  std::unique_ptr<ElfFile> file(ElfFile::Open("/proc/self/exe"));
+  ASSERT_TRUE(file);
+  const ElfFile::Section* text = file->FindSection(".text");
+  ASSERT_TRUE(text);
+  EXPECT_TRUE(text->data);
+  EXPECT_EQ(NULL, file->FindSection(".nonexistent"));
+
+  SymbolTable table(*file);
+  EXPECT_FALSE(table.symbols().empty());
+  uint64_t bias = 0;
+  dl_iterate_phdr(GetMainProgramBias, &bias);
+  uint64_t address =
+      reinterpret_cast<uint64_t>(&SymbolTableTestFunction) - bias;
+  EXPECT_TRUE(address >= text->address &&
+              address < text->address + text->size);
+  const Symbol* symbol = table.Lookup(address + 1);
+  ASSERT_TRUE(symbol);
+  EXPECT_STREQ("SymbolTableTestFunction", symbol->name);
+  EXPECT_EQ(address, symbol->address);
+  EXPECT_EQ(4, SymbolTableTestFunction(1));
+}
+
+TEST(ElfFile, NotElf) {
+  EXPECT_EQ(NULL, ElfFile::Open("/nonexistent/binary"));
+  char path[] = "/tmp/elf_file_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  char junk[256];
+  memset(junk, 0x7f, sizeof(junk));
+  EXPECT_EQ(static_cast<ssize_t>(sizeof(junk)),
+            write(fd, junk, sizeof(junk)));
+  close(fd);
+  EXPECT_EQ(NULL, ElfFile::Open(path));
+  unlink(path);
+}
@@ -0,0 +1,241 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "font_atlas_cache.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "core.h"
+#include "third_party/imgui/imgui.h"
+#include "third_party/imgui/stb_rect_pack.h"
+#include "user_files.h"
+
+namespace {
+
+// Change this whenever the layout below changes.
+const uint32_t kVersion = 1;
+const char kMagic[8] = {'s', 'g', 'f', 'o', 'n', 't', 's', '\0'};
+
+// The file is this, then a FontHeader and that font's glyphs for each font,
+// and then the pixels.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t font_count;
+  uint64_t key;
+  int32_t tex_width;
+  int32_t tex_height;
+  // Where ImGui's own data (the white pixel and mouse cursors) was put.
+  int32_t custom_x;
+  int32_t custom_y;
+};
+
+struct FontHeader {
+  float font_size;
+  float ascent;
+  float descent;
+  int32_t config_data_count;
+  uint32_t glyph_count;
+};
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  // FNV-1a.
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+template <class T>
+uint64_t HashValue(uint64_t hash, const T& value) {
+  return HashBytes(hash, &value, sizeof(value));
+}
+
+// Identifies everything that goes into building |atlas|.
+uint64_t AtlasKey(ImFontAtlas* atlas) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = HashValue(hash, kVersion);
+  hash = HashValue(hash, sizeof(ImFont::Glyph));
+  hash = HashValue(hash, atlas->TexDesiredWidth);
+  for (const ImFontConfig& config : atlas->ConfigData) {
+    hash = HashBytes(hash, config.FontData, config.FontDataSize);
+    hash = HashValue(hash, config.FontNo);
+    hash = HashValue(hash, config.SizePixels);
+    hash = HashValue(hash, config.OversampleH);
+    hash = HashValue(hash, config.OversampleV);
+    hash = HashValue(hash, config.PixelSnapH);
+    hash = HashValue(hash, config.GlyphExtraSpacing.x);
+    hash = HashValue(hash, config.GlyphExtraSpacing.y);
+    hash = HashValue(hash, config.MergeMode);
+    hash = HashValue(hash, config.MergeGlyphCenterV);
+    // Build() uses the default ranges for fonts without any.
+    const ImWchar* ranges = config.GlyphRanges ? config.GlyphRanges
+                                               : atlas->GetGlyphRangesDefault();
+    for (; ranges[0] && ranges[1]; ranges += 2) {
+      hash = HashValue(hash, ranges[0]);
+      hash = HashValue(hash, ranges[1]);
+    }
+    // Which font it goes into.
+    for (int i = 0; i < atlas->Fonts.Size; ++i) {
+      if (atlas->Fonts[i] == config.DstFont)
+        hash = HashValue(hash, i);
+    }
+  }
+  return hash;
+}
+
+const ImFontConfig* FirstConfigFor(const ImFontAtlas& atlas,
+                                   const ImFont* font) {
+  for (const ImFontConfig& config : atlas.ConfigData) {
+    if (config.DstFont == font)
+      return &config;
+  }
+  return NULL;
+}
+
+// Fills in |atlas| from a cache file, as Build() would have. Returns false if
+// |contents| isn't a valid cache of it.
+bool LoadAtlas(ImFontAtlas* atlas,
+               uint64_t key,
+               const std::vector<char>& contents) {
+  const char* pos = contents.data();
+  const char* end = pos + contents.size();
+  FileHeader header;
+  if (static_cast<size_t>(end - pos) < sizeof(header))
+    return false;
+  memcpy(&header, pos, sizeof(header));
+  pos += sizeof(header);
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.key != key ||
+      header.font_count != static_cast<uint32_t>(atlas->Fonts.Size) ||
+      header.tex_width <= 0 || header.tex_height <= 0)
+    return false;
+
+  // Check that it's all there before changing anything.
+  const char* fonts = pos;
+  for (uint32_t i = 0; i < header.font_count; ++i) {
+    FontHeader font;
+    if (static_cast<size_t>(end - pos) < sizeof(font))
+      return false;
+    memcpy(&font, pos, sizeof(font));
+    pos += sizeof(font);
+    if (static_cast<size_t>(end - pos) / sizeof(ImFont::Glyph) <
+        font.glyph_count)
+      return false;
+    pos += font.glyph_count * sizeof(ImFont::Glyph);
+  }
+  size_t pixels_size = static_cast<size_t>(header.tex_width) *
+                       static_cast<size_t>(header.tex_height);
+  if (static_cast<size_t>(end - pos) != pixels_size)
+    return false;
+
+  atlas->ClearTexData();
+  atlas->TexID = NULL;
+  atlas->TexWidth = header.tex_width;
+  atlas->TexHeight = header.tex_height;
+  atlas->TexPixelsAlpha8 =
+      static_cast<unsigned char*>(ImGui::MemAlloc(pixels_size));
+  memcpy(atlas->TexPixelsAlpha8, pos, pixels_size);
+
+  pos = fonts;
+  for (int i = 0; i < atlas->Fonts.Size; ++i) {
+    ImFont* font = atlas->Fonts[i];
+    FontHeader font_header;
+    memcpy(&font_header, pos, sizeof(font_header));
+    pos += sizeof(font_header);
+    font->ContainerAtlas = atlas;
+    font->ConfigData = const_cast<ImFontConfig*>(FirstConfigFor(*atlas, font));
+    font->ConfigDataCount =
+        static_cast<short>(font_header.config_data_count);
+    font->FontSize = font_header.font_size;
+    font->Ascent = font_header.ascent;
+    font->Descent = font_header.descent;
+    font->Glyphs.resize(font_header.glyph_count);
+    memcpy(font->Glyphs.Data,
+           pos,
+           font_header.glyph_count * sizeof(ImFont::Glyph));
+    pos += font_header.glyph_count * sizeof(ImFont::Glyph);
+    font->FallbackGlyph = NULL;
+    font->BuildLookupTable();
+  }
+
+  // This sets up the white pixel and mouse cursors, which Build() does last.
+  ImVector<stbrp_rect> custom_rects;
+  atlas->RenderCustomTexData(0, &custom_rects);
+  custom_rects[0].x = static_cast<stbrp_coord>(header.custom_x);
+  custom_rects[0].y = static_cast<stbrp_coord>(header.custom_y);
+  custom_rects[0].was_packed = 1;
+  atlas->RenderCustomTexData(1, &custom_rects);
+  return true;
+}
+
+void SaveAtlas(const ImFontAtlas& atlas,
+               uint64_t key,
+               const std::string& path) {
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.font_count = static_cast<uint32_t>(atlas.Fonts.Size);
+  header.key = key;
+  header.tex_width = atlas.TexWidth;
+  header.tex_height = atlas.TexHeight;
+  // Build() doesn't keep where it put its own data, but the white pixel is
+  // the middle of its first texel.
+  header.custom_x =
+      static_cast<int32_t>(atlas.TexUvWhitePixel.x * atlas.TexWidth);
+  header.custom_y =
+      static_cast<int32_t>(atlas.TexUvWhitePixel.y * atlas.TexHeight);
+
+  std::vector<char> contents(reinterpret_cast<const char*>(&header),
+                             reinterpret_cast<const char*>(&header + 1));
+  for (const ImFont* font : atlas.Fonts) {
+    FontHeader font_header;
+    font_header.font_size = font->FontSize;
+    font_header.ascent = font->Ascent;
+    font_header.descent = font->Descent;
+    font_header.config_data_count = font->ConfigDataCount;
+    font_header.glyph_count = static_cast<uint32_t>(font->Glyphs.Size);
+    const char* font_header_bytes =
+        reinterpret_cast<const char*>(&font_header);
+    contents.insert(contents.end(),
+                    font_header_bytes,
+                    font_header_bytes + sizeof(font_header));
+    const char* glyphs = reinterpret_cast<const char*>(font->Glyphs.Data);
+    contents.insert(contents.end(),
+                    glyphs,
+                    glyphs + font->Glyphs.Size * sizeof(ImFont::Glyph));
+  }
+  const char* pixels = reinterpret_cast<const char*>(atlas.TexPixelsAlpha8);
+  contents.insert(
+      contents.end(), pixels, pixels + atlas.TexWidth * atlas.TexHeight);
+
+  WriteFileAtomically(path, contents.data(), contents.size());
+}
+
+}  // namespace
+
+bool BuildFontAtlasCached(ImFontAtlas* atlas, const std::string& path) {
+  if (atlas->ConfigData.empty())
+    atlas->AddFontDefault();
+  uint64_t key = AtlasKey(atlas);
+
+  std::vector<char> contents;
+  if (!path.empty() && ReadFileContents(path, &contents) &&
+      LoadAtlas(atlas, key, contents))
+    return true;
+
+  if (!atlas->Build())
+    return false;
+  if (!path.empty())
+    SaveAtlas(*atlas, key, path);
+  return true;
+}
+
+std::string GetFontAtlasCachePath() {
+  return GetUserCachePath("font_atlas.cache");
+}
@@ -0,0 +1,23 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FONT_ATLAS_CACHE_H_
+#define FONT_ATLAS_CACHE_H_
+
+#include <string>
+
+struct ImFontAtlas;
+
+// Builds |atlas| from the fonts that have been added to it, as
+// ImFontAtlas::Build() would, but rasterizing them only the first time. The
+// result is saved in |path|, and loaded from there instead next time, as long
+// as the same fonts (by contents), sizes, oversampling and glyph ranges are
+// added. Returns false if the atlas couldn't be built at all.
+bool BuildFontAtlasCached(ImFontAtlas* atlas, const std::string& path);
+
+// Where BuildFontAtlasCached() should keep the atlas, in the user's cache
+// directory, which is created if needed. Empty if there isn't one.
+std::string GetFontAtlasCachePath();
+
+#endif  // FONT_ATLAS_CACHE_H_
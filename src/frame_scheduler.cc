@@ -0,0 +1,50 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "frame_scheduler.h"
+
+FrameScheduler::FrameScheduler(const std::function<void()>& wake,
+                               double min_interval)
+    : wake_(wake),
+      min_interval_(min_interval),
+      drawn_(false),
+      last_frame_(0),
+      pending_(0) {}
+
+FrameScheduler::~FrameScheduler() {}
+
+void FrameScheduler::RequestFrames(int count) {
+  int pending = pending_.load();
+  while (pending < count) {
+    if (pending_.compare_exchange_weak(pending, count)) {
+      // If there were frames to draw already, the main loop isn't waiting
+      // indefinitely, so there's no need to wake it again.
+      if (pending == 0)
+        wake_();
+      return;
+    }
+  }
+}
+
+double FrameScheduler::TimeUntilFrame(double now) const {
+  if (pending_.load() == 0)
+    return -1;
+  if (!drawn_)
+    return 0;
+  double next_frame = last_frame_ + min_interval_;
+  return next_frame > now ? next_frame - now : 0;
+}
+
+bool FrameScheduler::BeginFrame(double now) {
+  if (drawn_ && now < last_frame_ + min_interval_)
+    return false;
+  int pending = pending_.load();
+  do {
+    if (pending == 0)
+      return false;
+  } while (!pending_.compare_exchange_weak(pending, pending - 1));
+  drawn_ = true;
+  last_frame_ = now;
+  return true;
+}
@@ -0,0 +1,56 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FRAME_SCHEDULER_H_
+#define FRAME_SCHEDULER_H_
+
+#include <atomic>
+#include <functional>
+
+#include "core.h"
+
+// Decides when the main loop should draw, so that it can sleep while nothing
+// on screen is changing. Anything that changes what's shown, on any thread,
+// asks for a frame. However many times that happens before the next frame,
+// they all get that one frame, and only the first wakes the main loop. Frames
+// are also kept at least |min_interval| seconds apart, e.g. a display refresh,
+// so that a steady stream of changes doesn't draw any faster than it can be
+// shown.
+class FrameScheduler {
+ public:
+  // |wake| is called, on whichever thread asked for a frame, to get the main
+  // loop out of waiting for events.
+  FrameScheduler(const std::function<void()>& wake, double min_interval);
+  ~FrameScheduler();
+
+  // Asks for (at least) the next |count| frames to be drawn. More than one is
+  // for things that take a frame to settle, like ImGui's response to input.
+  // This can be called from any thread.
+  void RequestFrames(int count);
+  void RequestFrame() { RequestFrames(1); }
+
+  // The rest are for the main thread, with times in seconds.
+
+  // How long the main loop can wait for events at |now| before it's time to
+  // draw: 0 to draw right away, or negative if there's nothing to draw, and
+  // it can wait until something asks.
+  double TimeUntilFrame(double now) const;
+
+  // Returns true if a frame should be drawn at |now|, in which case it's no
+  // longer waiting to be drawn.
+  bool BeginFrame(double now);
+
+  void set_min_interval(double min_interval) { min_interval_ = min_interval; }
+
+ private:
+  std::function<void()> wake_;
+  double min_interval_;
+  bool drawn_;
+  double last_frame_;
+  std::atomic<int> pending_;
+
+  DISALLOW_COPY_AND_ASSIGN(FrameScheduler);
+};
+
+#endif  // FRAME_SCHEDULER_H_
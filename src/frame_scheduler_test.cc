@@ -0,0 +1,90 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "frame_scheduler.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+TEST(FrameScheduler, IdleUntilAsked) {
+  int wakes = 0;
+  FrameScheduler scheduler([&wakes] { ++wakes; }, 0.01);
+  EXPECT_LT(scheduler.TimeUntilFrame(1.0), 0);
+  EXPECT_FALSE(scheduler.BeginFrame(1.0));
+
+  scheduler.RequestFrame();
+  EXPECT_EQ(1, wakes);
+  EXPECT_EQ(0, scheduler.TimeUntilFrame(1.0));
+  EXPECT_TRUE(scheduler.BeginFrame(1.0));
+  EXPECT_LT(scheduler.TimeUntilFrame(1.0), 0);
+  EXPECT_FALSE(scheduler.BeginFrame(2.0));
+}
+
+TEST(FrameScheduler, CoalescesRequests) {
+  int wakes = 0;
+  FrameScheduler scheduler([&wakes] { ++wakes; }, 0.01);
+  for (int i = 0; i < 100; ++i)
+    scheduler.RequestFrame();
+  EXPECT_EQ(1, wakes);
+  EXPECT_TRUE(scheduler.BeginFrame(1.0));
+  EXPECT_FALSE(scheduler.BeginFrame(2.0));
+
+  // Asking for more than one frame doesn't add up either.
+  scheduler.RequestFrames(2);
+  scheduler.RequestFrames(2);
+  scheduler.RequestFrame();
+  EXPECT_EQ(2, wakes);
+  EXPECT_TRUE(scheduler.BeginFrame(3.0));
+  EXPECT_TRUE(scheduler.BeginFrame(4.0));
+  EXPECT_FALSE(scheduler.BeginFrame(5.0));
+}
+
+TEST(FrameScheduler, RateLimited) {
+  FrameScheduler scheduler([] {}, 0.25);
+  scheduler.RequestFrame();
+  EXPECT_TRUE(scheduler.BeginFrame(1.0));
+
+  // Too soon after the last one.
+  scheduler.RequestFrame();
+  EXPECT_DOUBLE_EQ(0.125, scheduler.TimeUntilFrame(1.125));
+  EXPECT_FALSE(scheduler.BeginFrame(1.125));
+  EXPECT_EQ(0, scheduler.TimeUntilFrame(1.25));
+  EXPECT_TRUE(scheduler.BeginFrame(1.25));
+
+  // But not after being idle for a while.
+  scheduler.RequestFrame();
+  EXPECT_EQ(0, scheduler.TimeUntilFrame(10.0));
+  EXPECT_TRUE(scheduler.BeginFrame(10.0));
+}
+
+TEST(FrameScheduler, RequestsFromOtherThreads) {
+  std::atomic<int> wakes(0);
+  FrameScheduler scheduler([&wakes] { ++wakes; }, 0);
+  std::atomic<int> running(4);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::thread([&scheduler, &running] {
+      for (int j = 0; j < 1000; ++j)
+        scheduler.RequestFrame();
+      --running;
+    }));
+  }
+  int frames = 0;
+  double now = 0;
+  while (running.load() > 0 || scheduler.TimeUntilFrame(now) >= 0) {
+    if (scheduler.BeginFrame(now))
+      ++frames;
+    now += 1;
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  // Each wake was for a frame that was drawn, but there weren't nearly as
+  // many of either as there were requests.
+  EXPECT_EQ(wakes.load(), frames);
+  EXPECT_GE(frames, 1);
+  EXPECT_LE(frames, 4000);
+}
@@ -8,9 +8,30 @@
 #endif
 #include "third_party/imgui/imgui.h"
 #include <stdio.h>
+#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "debugger.h"
+#include "dynamic_glyph_atlas.h"
+#if PLATFORM_LINUX
+#include "elf/elf_file.h"
+#include "elf/line_index.h"
+#include "elf/symbol_table.h"
+#endif
+#include "font_atlas_cache.h"
+#include "frame_scheduler.h"
+#include "memory_pages.h"
+#include "user_files.h"
+
+// After core.h, for PLATFORM_LINUX.
+#if PLATFORM_LINUX
+#include <cxxabi.h>
+#endif
 
 #define IMGUI_DEFINE_PLACEMENT_NEW
 #define IMGUI_DEFINE_MATH_OPERATORS
@@ -18,14 +39,27 @@
 
 struct GLFWwindow;
 
-IMGUI_API bool ImGui_ImplGlfw_Init(GLFWwindow* window, bool install_callbacks);
+// If |frame_scheduler| is given, the callbacks ask it for frames when there's
+// input.
+IMGUI_API bool ImGui_ImplGlfw_Init(GLFWwindow* window,
+                                   bool install_callbacks,
+                                   FrameScheduler* frame_scheduler = NULL);
 IMGUI_API void ImGui_ImplGlfw_Shutdown();
 IMGUI_API void ImGui_ImplGlfw_NewFrame();
 
+// Calls ImGui::Render(), and then clears to |clear_color| and draws what it
+// built, unless that's exactly what was drawn last time. Returns true if
+// anything was drawn, i.e. there's something to swap.
+IMGUI_API bool ImGui_ImplGlfw_RenderFrame(const ImVec4& clear_color);
+
 // Use if you want to reset your rendering device without losing ImGui state.
 IMGUI_API void ImGui_ImplGlfw_InvalidateDeviceObjects();
 IMGUI_API bool ImGui_ImplGlfw_CreateDeviceObjects();
 
+// Uploads rows [y_begin, y_end) of the font atlas again after glyphs have been
+// added to it, or the whole thing if it has changed size.
+IMGUI_API void ImGui_ImplGlfw_UpdateFontTexture(int y_begin, int y_end);
+
 // GLFW callbacks (installed by default if you enable 'install_callbacks' during
 // initialization)
 // Provided here if you want to chain callbacks.
@@ -71,6 +105,16 @@ IMGUI_API void EndDock();
 IMGUI_API void SetDockActive();
 IMGUI_API void DockDebugWindow();
 
+// Restores the docks to how they were when SaveDockLayout() wrote |path|. Call
+// before the first frame, so that they start out where they were left rather
+// than being docked one by one. Returns false if there's no layout there.
+IMGUI_API bool LoadDockLayout(const char* path);
+// Writes the layout to |path|, unless it's what was loaded or last written.
+IMGUI_API void SaveDockLayout(const char* path);
+// Calls SaveDockLayout() once the layout has stopped changing for a moment,
+// so that it's not written for every step of a drag. Call once a frame.
+IMGUI_API void SaveDockLayoutWhenSettled(const char* path);
+
 }  // namespace ImGui
 
 // ImGui GLFW binding with OpenGL
@@ -106,14 +150,34 @@ static GLFWwindow* g_Window = NULL;
 static double g_Time = 0.0f;
 static bool g_MousePressed[3] = {false, false, false};
 static float g_MouseWheel = 0.0f;
+static FrameScheduler* g_FrameScheduler = NULL;
+static void (*g_RenderDrawLists)(ImDrawData* draw_data) = NULL;
+// The hash of the last frame drawn, unless the window's contents have been
+// lost since, and it has to be drawn again regardless.
+static bool g_LastFrameValid = false;
+static uint64_t g_LastFrameHash = 0;
 static GLuint g_FontTexture = 0;
+static int g_FontTextureWidth = 0;
+static int g_FontTextureHeight = 0;
+
+// Used when the context is GL 3.3 or later, rather than the fixed-function
+// pipeline, which a core profile context doesn't have.
+static bool g_UseGL3 = false;
+static GLuint g_ShaderHandle = 0;
+static GLint g_UniformLocationTex = 0;
+static GLint g_UniformLocationProjMtx = 0;
+static GLuint g_VaoHandle = 0;
+static GLuint g_VboHandle = 0;
+static GLuint g_ElementsHandle = 0;
+static GLsizeiptr g_VboSize = 0;
+static GLsizeiptr g_ElementsSize = 0;
 
 // This is the main rendering function that you have to implement and provide to
 // ImGui (via setting up 'RenderDrawListsFn' in the ImGuiIO structure)
 // If text or lines are blurry when integrating ImGui in your engine:
 // - in your Render function, try translating your projection matrix by
 // (0.5f,0.5f) or (0.375f,0.375f)
-void ImGui_ImplGlfw_RenderDrawLists(ImDrawData* draw_data) {
+void ImGui_ImplGlfw_RenderDrawListsFixedFunction(ImDrawData* draw_data) {
   // Avoid rendering when minimized, scale coordinates for retina displays
   // (screen coordinates != framebuffer coordinates)
   ImGuiIO& io = ImGui::GetIO();
@@ -211,6 +275,155 @@ void ImGui_ImplGlfw_RenderDrawLists(ImDrawData* draw_data) {
              (GLsizei)last_viewport[3]);
 }
 
+// The same thing for a GL 3.3 core context. All the command lists go into one
+// vertex and one index buffer, which are orphaned and refilled every frame,
+// and the vertex format is only set up once, in the VAO.
+void ImGui_ImplGlfw_RenderDrawListsGL3(ImDrawData* draw_data) {
+  ImGuiIO& io = ImGui::GetIO();
+  int fb_width = (int)(io.DisplaySize.x * io.DisplayFramebufferScale.x);
+  int fb_height = (int)(io.DisplaySize.y * io.DisplayFramebufferScale.y);
+  if (fb_width == 0 || fb_height == 0 || draw_data->TotalVtxCount == 0)
+    return;
+  draw_data->ScaleClipRects(io.DisplayFramebufferScale);
+
+  // Backup GL state.
+  GLint last_program;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+  GLint last_texture;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+  GLint last_array_buffer;
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+  GLint last_vertex_array;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
+  GLint last_viewport[4];
+  glGetIntegerv(GL_VIEWPORT, last_viewport);
+  GLboolean last_enable_blend = glIsEnabled(GL_BLEND);
+  GLboolean last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
+  GLboolean last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
+  GLboolean last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+
+  // Setup render state: alpha-blending enabled, no face culling, no depth
+  // testing, scissor enabled.
+  glEnable(GL_BLEND);
+  glBlendEquation(GL_FUNC_ADD);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glDisable(GL_CULL_FACE);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_SCISSOR_TEST);
+  glActiveTexture(GL_TEXTURE0);
+
+  // Setup viewport, orthographic projection matrix.
+  glViewport(0, 0, (GLsizei)fb_width, (GLsizei)fb_height);
+  const float ortho_projection[4][4] = {
+      {2.0f / io.DisplaySize.x, 0.0f, 0.0f, 0.0f},
+      {0.0f, 2.0f / -io.DisplaySize.y, 0.0f, 0.0f},
+      {0.0f, 0.0f, -1.0f, 0.0f},
+      {-1.0f, 1.0f, 0.0f, 1.0f},
+  };
+  glUseProgram(g_ShaderHandle);
+  glUniform1i(g_UniformLocationTex, 0);
+  glUniformMatrix4fv(
+      g_UniformLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
+  glBindVertexArray(g_VaoHandle);
+
+  // Upload everything at once. Mapping with GL_MAP_INVALIDATE_BUFFER_BIT
+  // orphans the old contents, so the driver doesn't have to wait for the last
+  // frame to finish drawing from them.
+  GLsizeiptr vtx_size = draw_data->TotalVtxCount * sizeof(ImDrawVert);
+  GLsizeiptr idx_size = draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+  glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+  if (vtx_size > g_VboSize) {
+    g_VboSize = vtx_size * 2;
+    glBufferData(GL_ARRAY_BUFFER, g_VboSize, NULL, GL_STREAM_DRAW);
+  }
+  if (idx_size > g_ElementsSize) {
+    g_ElementsSize = idx_size * 2;
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_ElementsSize, NULL, GL_STREAM_DRAW);
+  }
+  unsigned char* vtx_dst = (unsigned char*)glMapBufferRange(
+      GL_ARRAY_BUFFER,
+      0,
+      vtx_size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  unsigned char* idx_dst = (unsigned char*)glMapBufferRange(
+      GL_ELEMENT_ARRAY_BUFFER,
+      0,
+      idx_size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (vtx_dst && idx_dst) {
+    for (int n = 0; n < draw_data->CmdListsCount; n++) {
+      const ImDrawList* cmd_list = draw_data->CmdLists[n];
+      size_t list_vtx_size = cmd_list->VtxBuffer.size() * sizeof(ImDrawVert);
+      size_t list_idx_size = cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx);
+      memcpy(vtx_dst, cmd_list->VtxBuffer.Data, list_vtx_size);
+      memcpy(idx_dst, cmd_list->IdxBuffer.Data, list_idx_size);
+      vtx_dst += list_vtx_size;
+      idx_dst += list_idx_size;
+    }
+  }
+  // Unmapping can fail if the contents were lost, in which case there's
+  // nothing to do but skip this frame.
+  bool uploaded = vtx_dst && idx_dst;
+  if (vtx_dst && !glUnmapBuffer(GL_ARRAY_BUFFER))
+    uploaded = false;
+  if (idx_dst && !glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER))
+    uploaded = false;
+
+  // Render command lists, each with its vertices' offset into the buffer as
+  // the base vertex, as the indices are relative to the list.
+  GLint vtx_offset = 0;
+  size_t idx_offset = 0;
+  for (int n = 0; uploaded && n < draw_data->CmdListsCount; n++) {
+    const ImDrawList* cmd_list = draw_data->CmdLists[n];
+    for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.size(); cmd_i++) {
+      const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+      if (pcmd->UserCallback) {
+        pcmd->UserCallback(cmd_list, pcmd);
+      } else {
+        glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+        glScissor((int)pcmd->ClipRect.x,
+                  (int)(fb_height - pcmd->ClipRect.w),
+                  (int)(pcmd->ClipRect.z - pcmd->ClipRect.x),
+                  (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
+        glDrawElementsBaseVertex(
+            GL_TRIANGLES,
+            (GLsizei)pcmd->ElemCount,
+            sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+            (void*)(idx_offset * sizeof(ImDrawIdx)),
+            vtx_offset);
+      }
+      idx_offset += pcmd->ElemCount;
+    }
+    vtx_offset += cmd_list->VtxBuffer.size();
+  }
+
+  // Restore modified GL state.
+  glUseProgram(last_program);
+  glBindTexture(GL_TEXTURE_2D, last_texture);
+  glBindVertexArray(last_vertex_array);
+  glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+  if (last_enable_blend)
+    glEnable(GL_BLEND);
+  else
+    glDisable(GL_BLEND);
+  if (last_enable_cull_face)
+    glEnable(GL_CULL_FACE);
+  else
+    glDisable(GL_CULL_FACE);
+  if (last_enable_depth_test)
+    glEnable(GL_DEPTH_TEST);
+  else
+    glDisable(GL_DEPTH_TEST);
+  if (last_enable_scissor_test)
+    glEnable(GL_SCISSOR_TEST);
+  else
+    glDisable(GL_SCISSOR_TEST);
+  glViewport(last_viewport[0],
+             last_viewport[1],
+             (GLsizei)last_viewport[2],
+             (GLsizei)last_viewport[3]);
+}
+
 static const char* ImGui_ImplGlfw_GetClipboardText() {
   return glfwGetClipboardString(g_Window);
 }
@@ -219,18 +432,27 @@ static void ImGui_ImplGlfw_SetClipboardText(const char* text) {
   glfwSetClipboardString(g_Window, text);
 }
 
+// ImGui takes a frame or two after some input to settle, e.g. a menu that's
+// opened by a click is laid out on the frame after the click.
+static void ImGui_ImplGlfw_RequestInputFrames() {
+  if (g_FrameScheduler)
+    g_FrameScheduler->RequestFrames(3);
+}
+
 void ImGui_ImplGlfw_MouseButtonCallback(GLFWwindow*,
                                         int button,
                                         int action,
                                         int /*mods*/) {
   if (action == GLFW_PRESS && button >= 0 && button < 3)
     g_MousePressed[button] = true;
+  ImGui_ImplGlfw_RequestInputFrames();
 }
 
 void ImGui_ImplGlfw_ScrollCallback(GLFWwindow*,
                                    double /*xoffset*/,
                                    double yoffset) {
   g_MouseWheel += (float)yoffset / 3.f;
+  ImGui_ImplGlfw_RequestInputFrames();
 }
 
 void ImGui_ImplGlFw_KeyCallback(GLFWwindow*,
@@ -252,40 +474,254 @@ void ImGui_ImplGlFw_KeyCallback(GLFWwindow*,
   io.KeyAlt = io.KeysDown[GLFW_KEY_LEFT_ALT] || io.KeysDown[GLFW_KEY_RIGHT_ALT];
   io.KeySuper =
       io.KeysDown[GLFW_KEY_LEFT_SUPER] || io.KeysDown[GLFW_KEY_RIGHT_SUPER];
+  ImGui_ImplGlfw_RequestInputFrames();
 }
 
 void ImGui_ImplGlfw_CharCallback(GLFWwindow*, unsigned int c) {
   ImGuiIO& io = ImGui::GetIO();
   if (c > 0 && c < 0x10000)
     io.AddInputCharacter((unsigned short)c);
+  ImGui_ImplGlfw_RequestInputFrames();
+}
+
+// The rest don't have anything to tell ImGui that it doesn't ask GLFW for
+// itself in NewFrame(), but do mean there's something new to draw.
+static void ImGui_ImplGlfw_CursorPosCallback(GLFWwindow*, double, double) {
+  ImGui_ImplGlfw_RequestInputFrames();
+}
+
+static void ImGui_ImplGlfw_CursorEnterCallback(GLFWwindow*, int) {
+  ImGui_ImplGlfw_RequestInputFrames();
+}
+
+static void ImGui_ImplGlfw_WindowFocusCallback(GLFWwindow*, int) {
+  ImGui_ImplGlfw_RequestInputFrames();
+}
+
+static void ImGui_ImplGlfw_WindowRefreshCallback(GLFWwindow*) {
+  g_LastFrameValid = false;
+  ImGui_ImplGlfw_RequestInputFrames();
+}
+
+static void ImGui_ImplGlfw_FramebufferSizeCallback(GLFWwindow*, int, int) {
+  ImGui_ImplGlfw_RequestInputFrames();
+}
+
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  // A word at a time, with a multiply and shift to mix, as in MurmurHash64A.
+  const uint64_t kMul = 0xc6a4a7935bd1e995ULL;
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (; size >= 8; bytes += 8, size -= 8) {
+    uint64_t word;
+    memcpy(&word, bytes, 8);
+    hash = (hash ^ word) * kMul;
+    hash ^= hash >> 47;
+  }
+  for (; size > 0; ++bytes, --size) {
+    hash = (hash ^ *bytes) * kMul;
+    hash ^= hash >> 47;
+  }
+  return hash;
+}
+
+template <class T>
+static uint64_t HashValue(uint64_t hash, const T& value) {
+  return HashBytes(hash, &value, sizeof(value));
+}
+
+// Returns false if |draw_data| can't be compared with another frame, because
+// it has callbacks that might draw something different each time.
+static bool HashDrawData(const ImDrawData* draw_data,
+                         const ImVec4& clear_color,
+                         uint64_t* hash) {
+  ImGuiIO& io = ImGui::GetIO();
+  uint64_t h = 0;
+  h = HashValue(h, io.DisplaySize);
+  h = HashValue(h, io.DisplayFramebufferScale);
+  h = HashValue(h, clear_color);
+  for (int n = 0; n < draw_data->CmdListsCount; n++) {
+    const ImDrawList* cmd_list = draw_data->CmdLists[n];
+    h = HashBytes(h,
+                  cmd_list->VtxBuffer.Data,
+                  cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+    h = HashBytes(h,
+                  cmd_list->IdxBuffer.Data,
+                  cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+    // Field by field, as there may be padding.
+    for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.size(); cmd_i++) {
+      const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+      if (pcmd->UserCallback)
+        return false;
+      h = HashValue(h, pcmd->ElemCount);
+      h = HashValue(h, pcmd->ClipRect);
+      h = HashValue(h, pcmd->TextureId);
+    }
+  }
+  *hash = h;
+  return true;
+}
+
+bool ImGui_ImplGlfw_RenderFrame(const ImVec4& clear_color) {
+  ImGui::Render();
+  ImDrawData* draw_data = ImGui::GetDrawData();
+
+  // Moving the mouse over nothing, for example, builds the same frame again,
+  // and there's no need to pay for drawing and swapping it.
+  uint64_t hash = 0;
+  bool hashed = HashDrawData(draw_data, clear_color, &hash);
+  if (hashed && g_LastFrameValid && hash == g_LastFrameHash)
+    return false;
+  g_LastFrameValid = hashed;
+  g_LastFrameHash = hash;
+
+  int display_w, display_h;
+  glfwGetFramebufferSize(g_Window, &display_w, &display_h);
+  glViewport(0, 0, display_w, display_h);
+  glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
+  glClear(GL_COLOR_BUFFER_BIT);
+  g_RenderDrawLists(draw_data);
+  return true;
+}
+
+static bool CompileShader(GLuint shader, const GLchar* source) {
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    GLchar log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    fprintf(stderr, "Couldn't compile shader: %s\n", log);
+  }
+  return !!status;
+}
+
+static bool ImGui_ImplGlfw_CreateGL3Objects() {
+  // The font atlas is the only texture, and is only coverage, so it's in the
+  // red channel.
+  static const GLchar kVertexShader[] =
+      "#version 330 core\n"
+      "uniform mat4 ProjMtx;\n"
+      "layout(location = 0) in vec2 Position;\n"
+      "layout(location = 1) in vec2 UV;\n"
+      "layout(location = 2) in vec4 Color;\n"
+      "out vec2 Frag_UV;\n"
+      "out vec4 Frag_Color;\n"
+      "void main() {\n"
+      "  Frag_UV = UV;\n"
+      "  Frag_Color = Color;\n"
+      "  gl_Position = ProjMtx * vec4(Position.xy, 0, 1);\n"
+      "}\n";
+  static const GLchar kFragmentShader[] =
+      "#version 330 core\n"
+      "uniform sampler2D Texture;\n"
+      "in vec2 Frag_UV;\n"
+      "in vec4 Frag_Color;\n"
+      "out vec4 Out_Color;\n"
+      "void main() {\n"
+      "  Out_Color = vec4(Frag_Color.rgb,\n"
+      "                   Frag_Color.a * texture(Texture, Frag_UV).r);\n"
+      "}\n";
+
+  GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+  GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+  bool compiled = CompileShader(vertex_shader, kVertexShader) &&
+                  CompileShader(fragment_shader, kFragmentShader);
+  GLint linked = 0;
+  if (compiled) {
+    g_ShaderHandle = glCreateProgram();
+    glAttachShader(g_ShaderHandle, vertex_shader);
+    glAttachShader(g_ShaderHandle, fragment_shader);
+    glLinkProgram(g_ShaderHandle);
+    glGetProgramiv(g_ShaderHandle, GL_LINK_STATUS, &linked);
+    if (!linked) {
+      GLchar log[1024];
+      glGetProgramInfoLog(g_ShaderHandle, sizeof(log), NULL, log);
+      fprintf(stderr, "Couldn't link shaders: %s\n", log);
+    }
+  }
+  // The program keeps them until it's deleted.
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+  if (!linked)
+    return false;
+  g_UniformLocationTex = glGetUniformLocation(g_ShaderHandle, "Texture");
+  g_UniformLocationProjMtx = glGetUniformLocation(g_ShaderHandle, "ProjMtx");
+
+  GLint last_array_buffer;
+  glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+  GLint last_vertex_array;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
+
+  glGenBuffers(1, &g_VboHandle);
+  glGenBuffers(1, &g_ElementsHandle);
+  glGenVertexArrays(1, &g_VaoHandle);
+  glBindVertexArray(g_VaoHandle);
+  glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+#define OFFSETOF(TYPE, ELEMENT) ((size_t) & (((TYPE*)0)->ELEMENT))
+  glVertexAttribPointer(0,
+                        2,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(ImDrawVert),
+                        (GLvoid*)OFFSETOF(ImDrawVert, pos));
+  glVertexAttribPointer(1,
+                        2,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(ImDrawVert),
+                        (GLvoid*)OFFSETOF(ImDrawVert, uv));
+  glVertexAttribPointer(2,
+                        4,
+                        GL_UNSIGNED_BYTE,
+                        GL_TRUE,
+                        sizeof(ImDrawVert),
+                        (GLvoid*)OFFSETOF(ImDrawVert, col));
+#undef OFFSETOF
+
+  glBindVertexArray(last_vertex_array);
+  glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+  return true;
 }
 
 bool ImGui_ImplGlfw_CreateDeviceObjects() {
+  if (g_UseGL3 && !ImGui_ImplGlfw_CreateGL3Objects())
+    return false;
+
   // Build texture atlas
   ImGuiIO& io = ImGui::GetIO();
   unsigned char* pixels;
   int width, height;
   io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height);
 
-  // Upload texture to graphics system
+  // Upload texture to graphics system. GL_ALPHA textures aren't in the core
+  // profile, so the GL3 shader reads red instead.
   GLint last_texture;
   glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
   glGenTextures(1, &g_FontTexture);
   glBindTexture(GL_TEXTURE_2D, g_FontTexture);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
   glTexImage2D(GL_TEXTURE_2D,
                0,
-               GL_ALPHA,
+               g_UseGL3 ? GL_R8 : GL_ALPHA,
                width,
                height,
                0,
-               GL_ALPHA,
+               g_UseGL3 ? GL_RED : GL_ALPHA,
                GL_UNSIGNED_BYTE,
                pixels);
 
   // Store our identifier
   io.Fonts->TexID = (void*)(intptr_t)g_FontTexture;
+  g_FontTextureWidth = width;
+  g_FontTextureHeight = height;
+  g_LastFrameValid = false;
 
   // Restore state
   glBindTexture(GL_TEXTURE_2D, last_texture);
@@ -293,16 +729,74 @@ bool ImGui_ImplGlfw_CreateDeviceObjects() {
   return true;
 }
 
+void ImGui_ImplGlfw_UpdateFontTexture(int y_begin, int y_end) {
+  // Otherwise it's all uploaded when it's created.
+  if (!g_FontTexture)
+    return;
+
+  ImFontAtlas* atlas = ImGui::GetIO().Fonts;
+  GLenum format = g_UseGL3 ? GL_RED : GL_ALPHA;
+  GLint last_texture;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+  glBindTexture(GL_TEXTURE_2D, g_FontTexture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (atlas->TexWidth != g_FontTextureWidth ||
+      atlas->TexHeight != g_FontTextureHeight) {
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 g_UseGL3 ? GL_R8 : GL_ALPHA,
+                 atlas->TexWidth,
+                 atlas->TexHeight,
+                 0,
+                 format,
+                 GL_UNSIGNED_BYTE,
+                 atlas->TexPixelsAlpha8);
+    g_FontTextureWidth = atlas->TexWidth;
+    g_FontTextureHeight = atlas->TexHeight;
+  } else {
+    glTexSubImage2D(GL_TEXTURE_2D,
+                    0,
+                    0,
+                    y_begin,
+                    atlas->TexWidth,
+                    y_end - y_begin,
+                    format,
+                    GL_UNSIGNED_BYTE,
+                    atlas->TexPixelsAlpha8 + y_begin * atlas->TexWidth);
+  }
+  glBindTexture(GL_TEXTURE_2D, last_texture);
+  g_LastFrameValid = false;
+}
+
 void ImGui_ImplGlfw_InvalidateDeviceObjects() {
+  if (g_VaoHandle)
+    glDeleteVertexArrays(1, &g_VaoHandle);
+  if (g_VboHandle)
+    glDeleteBuffers(1, &g_VboHandle);
+  if (g_ElementsHandle)
+    glDeleteBuffers(1, &g_ElementsHandle);
+  if (g_ShaderHandle)
+    glDeleteProgram(g_ShaderHandle);
+  g_VaoHandle = g_VboHandle = g_ElementsHandle = g_ShaderHandle = 0;
+  g_VboSize = g_ElementsSize = 0;
+
   if (g_FontTexture) {
     glDeleteTextures(1, &g_FontTexture);
     ImGui::GetIO().Fonts->TexID = 0;
     g_FontTexture = 0;
+    g_FontTextureWidth = g_FontTextureHeight = 0;
   }
 }
 
-bool ImGui_ImplGlfw_Init(GLFWwindow* window, bool install_callbacks) {
+bool ImGui_ImplGlfw_Init(GLFWwindow* window,
+                         bool install_callbacks,
+                         FrameScheduler* frame_scheduler) {
   g_Window = window;
+  g_FrameScheduler = frame_scheduler;
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    return false;
+  g_UseGL3 =
+      GLVersion.major > 3 || (GLVersion.major == 3 && GLVersion.minor >= 3);
 
   ImGuiIO& io = ImGui::GetIO();
   io.IniFilename = nullptr;
@@ -328,11 +822,11 @@ bool ImGui_ImplGlfw_Init(GLFWwindow* window, bool install_callbacks) {
   io.KeyMap[ImGuiKey_Y] = GLFW_KEY_Y;
   io.KeyMap[ImGuiKey_Z] = GLFW_KEY_Z;
 
-  io.RenderDrawListsFn =
-      ImGui_ImplGlfw_RenderDrawLists;  // Alternatively you can set this to NULL
-                                       // and call ImGui::GetDrawData() after
-                                       // ImGui::Render() to get the same
-                                       // ImDrawData pointer.
+  // ImGui_ImplGlfw_RenderFrame() gets the draw data from ImGui::GetDrawData()
+  // after ImGui::Render() instead, so that it can decide whether to draw it.
+  io.RenderDrawListsFn = NULL;
+  g_RenderDrawLists = g_UseGL3 ? ImGui_ImplGlfw_RenderDrawListsGL3
+                               : ImGui_ImplGlfw_RenderDrawListsFixedFunction;
   io.SetClipboardTextFn = ImGui_ImplGlfw_SetClipboardText;
   io.GetClipboardTextFn = ImGui_ImplGlfw_GetClipboardText;
 #ifdef _WIN32
@@ -344,6 +838,12 @@ bool ImGui_ImplGlfw_Init(GLFWwindow* window, bool install_callbacks) {
     glfwSetScrollCallback(window, ImGui_ImplGlfw_ScrollCallback);
     glfwSetKeyCallback(window, ImGui_ImplGlFw_KeyCallback);
     glfwSetCharCallback(window, ImGui_ImplGlfw_CharCallback);
+    glfwSetCursorPosCallback(window, ImGui_ImplGlfw_CursorPosCallback);
+    glfwSetCursorEnterCallback(window, ImGui_ImplGlfw_CursorEnterCallback);
+    glfwSetWindowFocusCallback(window, ImGui_ImplGlfw_WindowFocusCallback);
+    glfwSetWindowRefreshCallback(window, ImGui_ImplGlfw_WindowRefreshCallback);
+    glfwSetFramebufferSizeCallback(window,
+                                   ImGui_ImplGlfw_FramebufferSizeCallback);
   }
 
   return true;
@@ -450,6 +950,43 @@ void ImGui_ImplGlfw_NewFrame() {
 
 using namespace ImGui;
 
+namespace {
+
+// Change this whenever the layout file's format changes.
+const uint32_t kDockLayoutVersion = 1;
+const char kDockLayoutMagic[8] = {'s', 'g', 'd', 'o', 'c', 'k', 's', '\0'};
+
+// How long the layout has to be unchanged before it's saved.
+const float kDockLayoutSaveDelay = 1.0f;
+
+// The file is this, and then a DockLayoutRecord followed by the label for each
+// dock.
+struct DockLayoutHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dock_count;
+};
+
+// Links to other docks are their indices in the file, or -1.
+struct DockLayoutRecord {
+  int32_t parent;
+  int32_t children[2];
+  int32_t prev_tab;
+  int32_t next_tab;
+  float pos_x;
+  float pos_y;
+  float size_x;
+  float size_y;
+  uint8_t status;
+  uint8_t active;
+  uint8_t opened;
+  uint8_t padding;
+  char location[16];
+  uint32_t label_length;
+};
+
+}  // namespace
+
 struct DockContext {
   enum EndAction_ {
     EndAction_None,
@@ -603,33 +1140,91 @@ struct DockContext {
   };
 
   ImVector<Dock*> m_docks;
+  // The docks in |m_docks| that have labels, i.e. all but the containers.
+  std::unordered_map<ImU32, Dock*> m_docks_by_id;
   ImVec2 m_drag_offset;
   Dock* m_current;
   Dock* m_next_parent;
   int m_last_frame;
+  int m_last_check_frame;
   EndAction_ m_end_action;
   ImVec2 m_workspace_pos;
   ImVec2 m_workspace_size;
   ImGuiDockSlot m_next_dock_slot;
 
+  // Which docks are where in the tree, worked out again only after it has
+  // changed, rather than by walking every dock each time it's needed.
+  bool m_layout_valid;
+  Dock* m_root;
+  // Docked, with no parent. Normally only the root and its tabs.
+  ImVector<Dock*> m_docked_roots;
+  ImVector<Dock*> m_containers;
+  // Docked or being dragged, and not containers, in |m_docks| order.
+  ImVector<Dock*> m_leaves;
+
+  // What's in the layout file, and a different layout that's waiting to be
+  // saved if it's still the same at |m_next_save_check|.
+  std::vector<char> m_saved_layout;
+  std::vector<char> m_unsaved_layout;
+  float m_next_save_check;
+
   DockContext()
       : m_current(nullptr),
         m_next_parent(nullptr),
         m_last_frame(0),
-        m_next_dock_slot(ImGuiDockSlot_Tab) {}
+        m_last_check_frame(-1),
+        m_next_dock_slot(ImGuiDockSlot_Tab),
+        m_layout_valid(false),
+        m_root(nullptr),
+        m_next_save_check(0) {}
 
   ~DockContext() {}
 
-  Dock& getDock(const char* label, bool opened) {
-    ImU32 id = ImHash(label, 0);
+  // Must be called whenever a dock's parent, children, tabs or status change,
+  // or docks are added or removed.
+  void invalidateLayout() { m_layout_valid = false; }
+
+  void setStatus(Dock& dock, Status_ status) {
+    if (dock.status == status)
+      return;
+    dock.status = status;
+    invalidateLayout();
+  }
+
+  void updateLayout() {
+    if (m_layout_valid)
+      return;
+    m_layout_valid = true;
+    m_root = nullptr;
+    m_docked_roots.clear();
+    m_containers.clear();
+    m_leaves.clear();
     for (int i = 0; i < m_docks.size(); ++i) {
-      if (m_docks[i]->id == id)
-        return *m_docks[i];
+      Dock* dock = m_docks[i];
+      if (!dock->parent && !m_root &&
+          (dock->status == Status_Docked || dock->children[0])) {
+        m_root = dock;
+      }
+      if (!dock->parent && dock->status == Status_Docked)
+        m_docked_roots.push_back(dock);
+      if (dock->isContainer())
+        m_containers.push_back(dock);
+      else if (dock->status != Status_Float)
+        m_leaves.push_back(dock);
     }
+  }
+
+  Dock& getDock(const char* label, bool opened) {
+    ImU32 id = ImHash(label, 0);
+    auto it = m_docks_by_id.find(id);
+    if (it != m_docks_by_id.end())
+      return *it->second;
 
     Dock* new_dock = (Dock*)MemAlloc(sizeof(Dock));
     IM_PLACEMENT_NEW(new_dock) Dock();
     m_docks.push_back(new_dock);
+    m_docks_by_id[id] = new_dock;
+    invalidateLayout();
     new_dock->label = ImStrdup(label);
     IM_ASSERT(new_dock->label);
     new_dock->id = id;
@@ -669,25 +1264,22 @@ struct DockContext {
 
     putInBackground();
 
-    for (int i = 0; i < m_docks.size(); ++i) {
-      Dock& dock = *m_docks[i];
-      if (!dock.parent && (dock.status == Status_Docked)) {
-        dock.setPosSize(m_workspace_pos, m_workspace_size);
-      }
-    }
+    updateLayout();
+    for (int i = 0; i < m_docked_roots.size(); ++i)
+      m_docked_roots[i]->setPosSize(m_workspace_pos, m_workspace_size);
 
     ImU32 color = GetColorU32(ImGuiCol_Button);
     ImU32 color_hovered = GetColorU32(ImGuiCol_ButtonHovered);
     ImDrawList* draw_list = GetWindowDrawList();
     ImGuiIO& io = GetIO();
-    for (int i = 0; i < m_docks.size(); ++i) {
-      Dock& dock = *m_docks[i];
-      if (!dock.isContainer())
-        continue;
+    for (int i = 0; i < m_containers.size(); ++i) {
+      Dock& dock = *m_containers[i];
 
-      PushID(i);
+      // By pointer, so that a split being dragged keeps its id when others
+      // come and go.
+      PushID(&dock);
       if (!IsMouseDown(0))
-        dock.status = Status_Docked;
+        setStatus(dock, Status_Docked);
 
       ImVec2 pos0 = dock.children[0]->pos;
       ImVec2 pos1 = dock.children[1]->pos;
@@ -740,7 +1332,7 @@ struct DockContext {
       }
 
       if (IsItemHovered() && IsMouseClicked(0)) {
-        dock.status = Status_Dragged;
+        setStatus(dock, Status_Dragged);
       }
 
       draw_list->AddRectFilled(GetItemRectMin(),
@@ -750,31 +1342,38 @@ struct DockContext {
     }
   }
 
+  // Floats docks that haven't been begun for a few frames. Only done once a
+  // frame, rather than for every dock that's begun.
   void checkNonexistent() {
-    int frame_limit = ImMax(0, ImGui::GetFrameCount() - 2);
-    for (int i = 0; i < m_docks.size(); ++i) {
-      Dock* dock = m_docks[i];
-      if (dock->isContainer())
-        continue;
-      if (dock->status == Status_Float)
-        continue;
+    int frame = ImGui::GetFrameCount();
+    if (frame == m_last_check_frame)
+      return;
+    m_last_check_frame = frame;
+
+    int frame_limit = ImMax(0, frame - 2);
+    ImVector<Dock*> gone;
+    updateLayout();
+    for (int i = 0; i < m_leaves.size(); ++i) {
+      Dock* dock = m_leaves[i];
       if (dock->last_frame < frame_limit) {
         ++dock->invalid_frames;
-        if (dock->invalid_frames > 2) {
-          doUndock(*dock);
-          dock->status = Status_Float;
-        }
-        return;
+        if (dock->invalid_frames > 2)
+          gone.push_back(dock);
+      } else {
+        dock->invalid_frames = 0;
       }
-      dock->invalid_frames = 0;
+    }
+    // Undocking changes the layout, so it's done after looking through it.
+    for (int i = 0; i < gone.size(); ++i) {
+      doUndock(*gone[i]);
+      setStatus(*gone[i], Status_Float);
     }
   }
 
-  Dock* getDockAt(const ImVec2& pos) const {
-    for (int i = 0; i < m_docks.size(); ++i) {
-      Dock& dock = *m_docks[i];
-      if (dock.isContainer())
-        continue;
+  Dock* getDockAt(const ImVec2& pos) {
+    updateLayout();
+    for (int i = 0; i < m_leaves.size(); ++i) {
+      Dock& dock = *m_leaves[i];
       if (dock.status != Status_Docked)
         continue;
       if (IsMouseHoveringRect(dock.pos, dock.pos + dock.size, false)) {
@@ -843,13 +1442,8 @@ struct DockContext {
   }
 
   Dock* getRootDock() {
-    for (int i = 0; i < m_docks.size(); ++i) {
-      if (!m_docks[i]->parent &&
-          (m_docks[i]->status == Status_Docked || m_docks[i]->children[0])) {
-        return m_docks[i];
-      }
-    }
-    return nullptr;
+    updateLayout();
+    return m_root;
   }
 
   bool dockSlots(Dock& dock,
@@ -919,7 +1513,7 @@ struct DockContext {
     canvas->PopClipRect();
 
     if (!IsMouseDown(0)) {
-      dock.status = Status_Float;
+      setStatus(dock, Status_Float);
       dock.location[0] = 0;
       dock.setActive();
     }
@@ -995,6 +1589,7 @@ struct DockContext {
       dock.next_tab->prev_tab = dock.prev_tab;
     dock.parent = nullptr;
     dock.prev_tab = dock.next_tab = nullptr;
+    invalidateLayout();
   }
 
   void drawTabbarListButton(Dock& dock) {
@@ -1067,7 +1662,7 @@ struct DockContext {
         if (IsItemActive() && IsMouseDragging()) {
           m_drag_offset = GetMousePos() - dock_tab->pos;
           doUndock(*dock_tab);
-          dock_tab->status = Status_Dragged;
+          setStatus(*dock_tab, Status_Dragged);
         }
 
         bool hovered = IsItemHovered();
@@ -1205,6 +1800,7 @@ struct DockContext {
       setDockPosSize(*dest, dock, dock_slot, *container);
     }
     dock.setActive();
+    invalidateLayout();
   }
 
   void rootDock(const ImVec2& pos, const ImVec2& size) {
@@ -1302,7 +1898,7 @@ struct DockContext {
       if (dock.status != Status_Float) {
         fillLocation(dock);
         doUndock(dock);
-        dock.status = Status_Float;
+        setStatus(dock, Status_Float);
       }
       dock.opened = false;
       return false;
@@ -1343,7 +1939,7 @@ struct DockContext {
       if (g.ActiveId == GetCurrentWindow()->MoveId && g.IO.MouseDown[0]) {
         m_drag_offset = GetMousePos() - dock.pos;
         doUndock(dock);
-        dock.status = Status_Dragged;
+        setStatus(dock, Status_Dragged);
       }
       return ret;
     }
@@ -1435,16 +2031,209 @@ struct DockContext {
     IM_ASSERT(false);
     return -1;
   }
+
+  void clear() {
+    for (int i = 0; i < m_docks.size(); ++i) {
+      m_docks[i]->~Dock();
+      MemFree(m_docks[i]);
+    }
+    m_docks.clear();
+    m_docks_by_id.clear();
+    m_current = nullptr;
+    m_next_parent = nullptr;
+    invalidateLayout();
+  }
+
+  void saveLayout(std::vector<char>* contents) {
+    std::unordered_map<const Dock*, int32_t> indices;
+    indices[nullptr] = -1;
+    for (int i = 0; i < m_docks.size(); ++i)
+      indices[m_docks[i]] = i;
+
+    DockLayoutHeader header;
+    memcpy(header.magic, kDockLayoutMagic, sizeof(kDockLayoutMagic));
+    header.version = kDockLayoutVersion;
+    header.dock_count = m_docks.size();
+    const char* header_bytes = reinterpret_cast<const char*>(&header);
+    contents->assign(header_bytes, header_bytes + sizeof(header));
+    for (int i = 0; i < m_docks.size(); ++i) {
+      const Dock& dock = *m_docks[i];
+      DockLayoutRecord record;
+      memset(&record, 0, sizeof(record));
+      record.parent = indices[dock.parent];
+      record.children[0] = indices[dock.children[0]];
+      record.children[1] = indices[dock.children[1]];
+      record.prev_tab = indices[dock.prev_tab];
+      record.next_tab = indices[dock.next_tab];
+      record.pos_x = dock.pos.x;
+      record.pos_y = dock.pos.y;
+      record.size_x = dock.size.x;
+      record.size_y = dock.size.y;
+      // A drag in progress is left where it is.
+      record.status = static_cast<uint8_t>(
+          dock.status == Status_Dragged ? Status_Float : dock.status);
+      record.active = dock.active;
+      record.opened = dock.opened;
+      memcpy(record.location, dock.location, sizeof(record.location));
+      record.label_length = static_cast<uint32_t>(strlen(dock.label));
+      const char* record_bytes = reinterpret_cast<const char*>(&record);
+      contents->insert(
+          contents->end(), record_bytes, record_bytes + sizeof(record));
+      contents->insert(
+          contents->end(), dock.label, dock.label + record.label_length);
+    }
+  }
+
+  // Replaces all the docks with the ones in |contents|, unless it's not a
+  // layout that saveLayout() could have written.
+  bool loadLayout(const std::vector<char>& contents) {
+    const char* pos = contents.data();
+    const char* end = pos + contents.size();
+    DockLayoutHeader header;
+    if (static_cast<size_t>(end - pos) < sizeof(header))
+      return false;
+    memcpy(&header, pos, sizeof(header));
+    pos += sizeof(header);
+    if (memcmp(header.magic, kDockLayoutMagic, sizeof(kDockLayoutMagic)) !=
+            0 ||
+        header.version != kDockLayoutVersion)
+      return false;
+
+    std::vector<DockLayoutRecord> records;
+    std::vector<const char*> labels;
+    for (uint32_t i = 0; i < header.dock_count; ++i) {
+      DockLayoutRecord record;
+      if (static_cast<size_t>(end - pos) < sizeof(record))
+        return false;
+      memcpy(&record, pos, sizeof(record));
+      pos += sizeof(record);
+      if (static_cast<size_t>(end - pos) < record.label_length)
+        return false;
+      labels.push_back(pos);
+      pos += record.label_length;
+      records.push_back(record);
+    }
+    if (pos != end || !isValidLayout(records))
+      return false;
+
+    clear();
+    for (size_t i = 0; i < records.size(); ++i) {
+      Dock* dock = (Dock*)MemAlloc(sizeof(Dock));
+      IM_PLACEMENT_NEW(dock) Dock();
+      m_docks.push_back(dock);
+    }
+    auto link = [this](int32_t index) {
+      return index < 0 ? nullptr : m_docks[index];
+    };
+    for (size_t i = 0; i < records.size(); ++i) {
+      const DockLayoutRecord& record = records[i];
+      Dock& dock = *m_docks[i];
+      dock.label = (char*)MemAlloc(record.label_length + 1);
+      memcpy(dock.label, labels[i], record.label_length);
+      dock.label[record.label_length] = 0;
+      dock.parent = link(record.parent);
+      dock.children[0] = link(record.children[0]);
+      dock.children[1] = link(record.children[1]);
+      dock.prev_tab = link(record.prev_tab);
+      dock.next_tab = link(record.next_tab);
+      dock.pos = ImVec2(record.pos_x, record.pos_y);
+      dock.size = ImVec2(record.size_x, record.size_y);
+      dock.status = static_cast<Status_>(record.status);
+      dock.active = record.active != 0;
+      dock.opened = record.opened != 0;
+      memcpy(dock.location, record.location, sizeof(dock.location));
+      dock.location[sizeof(dock.location) - 1] = 0;
+      dock.first = false;
+      // Docks that aren't begun any more are floated by checkNonexistent()
+      // after a few frames, as they would have been if they'd gone away
+      // while running.
+      dock.last_frame = GetFrameCount();
+      dock.invalid_frames = 0;
+      if (!dock.isContainer()) {
+        dock.id = ImHash(dock.label, 0);
+        m_docks_by_id[dock.id] = &dock;
+      }
+    }
+    m_saved_layout = contents;
+    m_unsaved_layout.clear();
+    return true;
+  }
+
+  // Checks that the links between |records| make a tree, so that nothing
+  // walking it loops forever or falls off the end.
+  static bool isValidLayout(const std::vector<DockLayoutRecord>& records) {
+    int32_t count = static_cast<int32_t>(records.size());
+    auto valid = [count](int32_t index) {
+      return index >= -1 && index < count;
+    };
+    for (const DockLayoutRecord& record : records) {
+      if (!valid(record.parent) || !valid(record.children[0]) ||
+          !valid(record.children[1]) || !valid(record.prev_tab) ||
+          !valid(record.next_tab) || record.status > Status_Float)
+        return false;
+    }
+    for (int32_t i = 0; i < count; ++i) {
+      const DockLayoutRecord& record = records[i];
+      if ((record.children[0] < 0) != (record.children[1] < 0))
+        return false;
+      for (int32_t child : record.children) {
+        if (child >= 0 && records[child].parent != i)
+          return false;
+      }
+      if (record.next_tab >= 0 && records[record.next_tab].prev_tab != i)
+        return false;
+      if (record.prev_tab >= 0 && records[record.prev_tab].next_tab != i)
+        return false;
+      // Every chain of parents or tabs has to end within |count| steps.
+      int32_t parent = record.parent;
+      int32_t tab = record.next_tab;
+      for (int32_t steps = 0; parent >= 0 || tab >= 0; ++steps) {
+        if (steps == count)
+          return false;
+        if (parent >= 0)
+          parent = records[parent].parent;
+        if (tab >= 0)
+          tab = records[tab].next_tab;
+      }
+    }
+    return true;
+  }
+
+  void save(const char* path) {
+    std::vector<char> layout;
+    saveLayout(&layout);
+    if (layout == m_saved_layout)
+      return;
+    if (WriteFileAtomically(path, layout.data(), layout.size()))
+      m_saved_layout.swap(layout);
+    m_unsaved_layout.clear();
+  }
+
+  void saveWhenSettled(const char* path) {
+    // Nothing's settled while a split or tab is being dragged.
+    float now = GetTime();
+    if (now < m_next_save_check || IsMouseDown(0))
+      return;
+    m_next_save_check = now + kDockLayoutSaveDelay;
+
+    std::vector<char> layout;
+    saveLayout(&layout);
+    if (layout == m_saved_layout) {
+      m_unsaved_layout.clear();
+    } else if (layout == m_unsaved_layout) {
+      if (WriteFileAtomically(path, layout.data(), layout.size()))
+        m_saved_layout.swap(layout);
+      m_unsaved_layout.clear();
+    } else {
+      m_unsaved_layout.swap(layout);
+    }
+  }
 };
 
 static DockContext g_dock;
 
 void ImGui::ShutdownDock() {
-  for (int i = 0; i < g_dock.m_docks.size(); ++i) {
-    g_dock.m_docks[i]->~Dock();
-    MemFree(g_dock.m_docks[i]);
-  }
-  g_dock.m_docks.clear();
+  g_dock.clear();
 }
 
 void ImGui::SetNextDock(ImGuiDockSlot slot) {
@@ -1480,6 +2269,19 @@ void ImGui::EndDock() {
 void ImGui::DockDebugWindow() {
   g_dock.debugWindow();
 }
+
+bool ImGui::LoadDockLayout(const char* path) {
+  std::vector<char> contents;
+  return ReadFileContents(path, &contents) && g_dock.loadLayout(contents);
+}
+
+void ImGui::SaveDockLayout(const char* path) {
+  g_dock.save(path);
+}
+
+void ImGui::SaveDockLayoutWhenSettled(const char* path) {
+  g_dock.saveWhenSettled(path);
+}
 #endif
 
 /////////////////////////////// dock //////////////////////////////////////////
@@ -1502,51 +2304,300 @@ void ImGui::DockDebugWindow() {
 /////////////////////////////// dock //////////////////////////////////////////
 /////////////////////////////// dock //////////////////////////////////////////
 
-#include "source_view/cpp_lexer.h"
+#include <string.h>
+
 #include "source_view/lexer.h"
+#include "source_view/source_loader.h"
 
-class SourceView {
+// Glyph quads for lines of source, laid out relative to the start of each
+// line. They only depend on the text, its colors and the font, so a line
+// that's still on screen from the last frame is drawn by copying its quads
+// into the draw list, rather than decoding and looking up every glyph again.
+class SourceLayoutCache {
  public:
-  SourceView();
-  ~SourceView();
-
-  void SetFilePath(const std::string& path);
-  void Draw();
+  // Glyphs that the font doesn't have yet are asked for from |glyphs|.
+  explicit SourceLayoutCache(DynamicGlyphAtlas* glyphs);
+  ~SourceLayoutCache();
+
+  // Throws away everything laid out with a different font, font atlas,
+  // display scale or colors, or before glyphs were added to the atlas. Called
+  // at the start of each frame.
+  void Validate(const ImFont* font,
+                float font_size,
+                const ImVec2& framebuffer_scale,
+                const ImU32* colors);
+
+  // Forgets all lines, e.g. when the text or its colors have changed.
+  void Clear();
+
+  // Draws the line numbered |line_number| at |pos|, laying it out first if
+  // it's not cached, or was only laid out to less than is visible now.
+  void DrawLine(ImDrawList* draw_list,
+                ImVec2 pos,
+                const ImVec4& clip_rect,
+                size_t line_number,
+                const char* line,
+                const char* line_end,
+                const ColorRun* runs,
+                const ColorRun* runs_end);
 
  private:
-  struct ColoredText {
-    Lexer::TokenType type;
-    std::string text;
+  struct Line {
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    // How far the line was laid out, if it was cut short.
+    float width;
+    bool complete;
   };
-  using Line = std::vector<ColoredText>;
 
-  std::vector<Line> lines_;
-
-  DISALLOW_COPY_AND_ASSIGN(SourceView);
+  // Appends the quads for |line| up to |max_width| to |vertices_|.
+  Line LayOut(const char* line,
+              const char* line_end,
+              const ColorRun* runs,
+              const ColorRun* runs_end,
+              float max_width);
+
+  DynamicGlyphAtlas* glyphs_;
+  const ImFont* font_;
+  float font_size_;
+  uint32_t glyph_generation_;
+  ImTextureID texture_id_;
+  int texture_width_;
+  int texture_height_;
+  ImVec2 framebuffer_scale_;
+  ImU32 colors_[Lexer::Invalid + 1];
+
+  std::unordered_map<size_t, Line> lines_;
+  // All the lines' vertices, each line's 4 to a glyph.
+  std::vector<ImDrawVert> vertices_;
+
+  DISALLOW_COPY_AND_ASSIGN(SourceLayoutCache);
 };
 
-SourceView::SourceView() {}
+namespace {
 
-SourceView::~SourceView() {}
+// Once this many vertices are cached, start again rather than keep every line
+// that has ever been scrolled past.
+const size_t kMaxCachedVertices = 1 << 20;
+
+}  // namespace
+
+SourceLayoutCache::SourceLayoutCache(DynamicGlyphAtlas* glyphs)
+    : glyphs_(glyphs),
+      font_(NULL),
+      font_size_(0),
+      glyph_generation_(0),
+      texture_id_(NULL),
+      texture_width_(0),
+      texture_height_(0) {
+  memset(colors_, 0, sizeof(colors_));
+}
+
+SourceLayoutCache::~SourceLayoutCache() {}
+
+void SourceLayoutCache::Validate(const ImFont* font,
+                                 float font_size,
+                                 const ImVec2& framebuffer_scale,
+                                 const ImU32* colors) {
+  const ImFontAtlas* atlas = font->ContainerAtlas;
+  if (font == font_ && font_size == font_size_ &&
+      glyphs_->generation() == glyph_generation_ &&
+      atlas->TexID == texture_id_ && atlas->TexWidth == texture_width_ &&
+      atlas->TexHeight == texture_height_ &&
+      framebuffer_scale.x == framebuffer_scale_.x &&
+      framebuffer_scale.y == framebuffer_scale_.y &&
+      memcmp(colors, colors_, sizeof(colors_)) == 0)
+    return;
+  font_ = font;
+  font_size_ = font_size;
+  glyph_generation_ = glyphs_->generation();
+  texture_id_ = atlas->TexID;
+  texture_width_ = atlas->TexWidth;
+  texture_height_ = atlas->TexHeight;
+  framebuffer_scale_ = framebuffer_scale;
+  memcpy(colors_, colors, sizeof(colors_));
+  Clear();
+}
+
+void SourceLayoutCache::Clear() {
+  lines_.clear();
+  vertices_.clear();
+}
 
-static void SplitString(const std::string& str,
-                        char delimiter,
-                        std::vector<std::string>* into) {
-  std::vector<std::string> parsed;
-  std::string::size_type pos = 0;
-  for (;;) {
-    const std::string::size_type at = str.find(delimiter, pos);
-    if (at == std::string::npos) {
-      parsed.push_back(str.substr(pos));
+void SourceLayoutCache::DrawLine(ImDrawList* draw_list,
+                                 ImVec2 pos,
+                                 const ImVec4& clip_rect,
+                                 size_t line_number,
+                                 const char* line,
+                                 const char* line_end,
+                                 const ColorRun* runs,
+                                 const ColorRun* runs_end) {
+  if (line == line_end || runs == runs_end)
+    return;
+  if (pos.y > clip_rect.w || pos.y + font_size_ < clip_rect.y)
+    return;
+  DCHECK(font_->ContainerAtlas->TexID == draw_list->_TextureIdStack.back());
+
+  // Align to be pixel perfect, as ImFont::RenderText() does.
+  ImVec2 origin(static_cast<int>(pos.x) + font_->DisplayOffset.x,
+                static_cast<int>(pos.y) + font_->DisplayOffset.y);
+  float visible_width = clip_rect.z - origin.x;
+  auto it = lines_.find(line_number);
+  if (it == lines_.end() ||
+      (!it->second.complete && it->second.width < visible_width)) {
+    if (vertices_.size() > kMaxCachedVertices)
+      Clear();
+    // Lay out a bit more than is visible, so that it doesn't have to be done
+    // again for every pixel the window is widened by.
+    Line layout = LayOut(line, line_end, runs, runs_end, visible_width * 2);
+    it = lines_.insert(std::make_pair(line_number, layout)).first;
+    it->second = layout;
+  }
+  const Line& layout = it->second;
+  if (layout.vertex_count == 0)
+    return;
+
+  int vtx_count = static_cast<int>(layout.vertex_count);
+  int idx_count = vtx_count / 4 * 6;
+  draw_list->PrimReserve(idx_count, vtx_count);
+  ImDrawVert* vtx_write = draw_list->_VtxWritePtr;
+  ImDrawIdx* idx_write = draw_list->_IdxWritePtr;
+  unsigned int vtx_current_idx = draw_list->_VtxCurrentIdx;
+  const ImDrawVert* vtx_read = &vertices_[layout.first_vertex];
+  for (int i = 0; i < vtx_count; ++i) {
+    vtx_write[i] = vtx_read[i];
+    vtx_write[i].pos.x += origin.x;
+    vtx_write[i].pos.y += origin.y;
+  }
+  for (int i = 0; i < vtx_count; i += 4) {
+    idx_write[0] = static_cast<ImDrawIdx>(vtx_current_idx + i);
+    idx_write[1] = static_cast<ImDrawIdx>(vtx_current_idx + i + 1);
+    idx_write[2] = static_cast<ImDrawIdx>(vtx_current_idx + i + 2);
+    idx_write[3] = static_cast<ImDrawIdx>(vtx_current_idx + i);
+    idx_write[4] = static_cast<ImDrawIdx>(vtx_current_idx + i + 2);
+    idx_write[5] = static_cast<ImDrawIdx>(vtx_current_idx + i + 3);
+    idx_write += 6;
+  }
+  draw_list->_VtxWritePtr = vtx_write + vtx_count;
+  draw_list->_IdxWritePtr = idx_write;
+  draw_list->_VtxCurrentIdx = vtx_current_idx + vtx_count;
+}
+
+// This is ImFont::RenderText() cut down to what a single line of source
+// needs, changing color between runs as it goes.
+SourceLayoutCache::Line SourceLayoutCache::LayOut(const char* line,
+                                                  const char* line_end,
+                                                  const ColorRun* runs,
+                                                  const ColorRun* runs_end,
+                                                  float max_width) {
+  Line layout;
+  layout.first_vertex = static_cast<uint32_t>(vertices_.size());
+  layout.complete = true;
+
+  float scale = font_size_ / font_->FontSize;
+  float x = 0;
+  const ColorRun* run = runs;
+  const char* run_end = line + run->start + run->length;
+  ImU32 col = colors_[run->type];
+  for (const char* s = line; s < line_end;) {
+    if (x > max_width) {
+      layout.complete = false;
       break;
+    }
+    while (s >= run_end && run + 1 != runs_end) {
+      ++run;
+      run_end = line + run->start + run->length;
+      col = colors_[run->type];
+    }
+
+    unsigned int c = static_cast<unsigned char>(*s);
+    if (c < 0x80) {
+      s += 1;
     } else {
-      parsed.push_back(str.substr(pos, at - pos));
-      pos = at + 1;
+      s += ImTextCharFromUtf8(&c, s, line_end);
+      if (c == 0)
+        break;
     }
+    if (c == '\r')
+      continue;
+
+    const ImFont::Glyph* glyph = glyphs_->FindGlyph(font_, c);
+    if (!glyph)
+      continue;
+    // Spaces and tabs are assumed to be empty, as in RenderText().
+    if (c != ' ' && c != '\t') {
+      float x1 = x + glyph->X0 * scale;
+      float x2 = x + glyph->X1 * scale;
+      float y1 = glyph->Y0 * scale;
+      float y2 = glyph->Y1 * scale;
+      ImDrawVert quad[4];
+      quad[0].pos = ImVec2(x1, y1);
+      quad[0].uv = ImVec2(glyph->U0, glyph->V0);
+      quad[0].col = col;
+      quad[1].pos = ImVec2(x2, y1);
+      quad[1].uv = ImVec2(glyph->U1, glyph->V0);
+      quad[1].col = col;
+      quad[2].pos = ImVec2(x2, y2);
+      quad[2].uv = ImVec2(glyph->U1, glyph->V1);
+      quad[2].col = col;
+      quad[3].pos = ImVec2(x1, y2);
+      quad[3].uv = ImVec2(glyph->U0, glyph->V1);
+      quad[3].col = col;
+      vertices_.insert(vertices_.end(), quad, quad + 4);
+    }
+    x += glyph->XAdvance * scale;
   }
-  into->swap(parsed);
+
+  layout.vertex_count =
+      static_cast<uint32_t>(vertices_.size() - layout.first_vertex);
+  layout.width = x;
+  return layout;
 }
 
+class SourceView {
+ public:
+  // |frame_scheduler| is asked for a frame whenever more of the file has been
+  // loaded. Characters that aren't in the font yet are added to |glyphs|.
+  SourceView(SourceFileCache* files,
+             FrameScheduler* frame_scheduler,
+             DynamicGlyphAtlas* glyphs);
+  ~SourceView();
+
+  // The file is loaded and lexed in the background. Setting the same path
+  // again reloads the file, only relexing the part of it that changed.
+  void SetFilePath(const std::string& path);
+  const std::string& path() const { return path_; }
+
+  // Scrolls to |line|, counting from 1, and highlights it, once it's loaded.
+  void ShowLine(uint32_t line);
+
+  void Draw();
+
+ private:
+  std::string path_;
+  FrameScheduler* frame_scheduler_;
+  DynamicGlyphAtlas* glyphs_;
+  SourceLoader loader_;
+  SourceLayoutCache layout_;
+  // 0 if there isn't one.
+  uint32_t highlighted_line_;
+  bool scroll_to_highlight_;
+
+  DISALLOW_COPY_AND_ASSIGN(SourceView);
+};
+
+SourceView::SourceView(SourceFileCache* files,
+                       FrameScheduler* frame_scheduler,
+                       DynamicGlyphAtlas* glyphs)
+    : frame_scheduler_(frame_scheduler),
+      glyphs_(glyphs),
+      loader_(files, [frame_scheduler] { frame_scheduler->RequestFrame(); }),
+      layout_(glyphs),
+      highlighted_line_(0),
+      scroll_to_highlight_(false) {}
+
+SourceView::~SourceView() {}
+
 ImVec4 ColorFromHex(uint32_t rgb) {
   return ImVec4(((rgb & 0xff0000) >> 16) / 255.f,
                 ((rgb & 0xff00) >> 8) / 255.f,
@@ -1616,67 +2667,87 @@ const ImVec4& ColorForTokenType(Lexer::TokenType type) {
   return kBase0;
 }
 
-// TODO(scottmg): Losing last line if doesn't end in \n.
 void SourceView::SetFilePath(const std::string& path) {
-  FILE* f = fopen(path.c_str(), "rb");
-  if (!f)
-    return;
-  fseek(f, 0, SEEK_END);
-  int len = ftell(f);
-  std::unique_ptr<char[]> file_contents(new char[len]);
-  fseek(f, 0, SEEK_SET);
-  fread(file_contents.get(), 1, len, f);
-  fclose(f);
-
-  std::string input(file_contents.get(), len);
-  std::unique_ptr<Lexer> lexer(MakeCppLexer());
-  std::vector<Token> tokens;
-  lexer->GetTokensUnprocessed(input, &tokens);
-  Line current_line;
-  for (size_t i = 0; i < tokens.size(); ++i) {
-    const Token& token = tokens[i];
-    if (token.value == "\n") {
-      lines_.push_back(current_line);
-      current_line.clear();
-    } else {
-      ColoredText fragment;
-      fragment.type = token.token;
-      std::vector<std::string> tok_lines;
-      SplitString(token.value, '\n', &tok_lines);
-      fragment.text = tok_lines[0];
-      current_line.push_back(fragment);
-      // If we have multiple lines in a token, push as separate pieces.
-      for (size_t j = 1; j < tok_lines.size(); ++j) {
-        lines_.push_back(current_line);
-        current_line.clear();
-        fragment.text = tok_lines[j];
-        current_line.push_back(fragment);
-      }
-    }
-  }
+  path_ = path;
+  loader_.Load(path);
+}
+
+void SourceView::ShowLine(uint32_t line) {
+  highlighted_line_ = line;
+  scroll_to_highlight_ = true;
+  frame_scheduler_->RequestFrame();
 }
 
 void SourceView::Draw() {
-  float line_height = ImGui::CalcTextSize("").y;
-  ImGuiListClipper clipper(lines_.size(), line_height);
+  if (loader_.Poll())
+    layout_.Clear();
+  if (loader_.status() != SourceLoader::kLoaded)
+    glyphs_->RequestGlyphs(ImGui::GetFont(), path_.c_str());
+  if (loader_.status() == SourceLoader::kLoading) {
+    ImGui::Text("Loading %s...", path_.c_str());
+    return;
+  }
+  if (loader_.status() == SourceLoader::kFailed) {
+    ImGui::Text("Couldn't read %s.", path_.c_str());
+    return;
+  }
+
+  ImU32 colors[Lexer::Invalid + 1];
+  for (int i = 0; i <= Lexer::Invalid; ++i) {
+    colors[i] = ImGui::GetColorU32(
+        ColorForTokenType(static_cast<Lexer::TokenType>(i)));
+  }
+  layout_.Validate(ImGui::GetFont(),
+                   ImGui::GetFontSize(),
+                   ImGui::GetIO().DisplayFramebufferScale,
+                   colors);
+
+  // The lines are drawn straight into the window's draw list rather than as a
+  // widget per run, and only the cursor is moved past them afterwards.
+  ImDrawList* draw_list = ImGui::GetWindowDrawList();
+  float line_height = ImGui::GetTextLineHeightWithSpacing();
+  if (scroll_to_highlight_ && highlighted_line_ > 0) {
+    // Roughly in the middle, and applied next frame.
+    float y = (highlighted_line_ - 1) * line_height -
+              ImGui::GetWindowHeight() / 2;
+    ImGui::SetScrollY(std::max(y, 0.f));
+    scroll_to_highlight_ = false;
+    frame_scheduler_->RequestFrame();
+  }
+  ImGuiListClipper clipper(static_cast<int>(loader_.line_count()),
+                           line_height);
   while (clipper.Step()) {
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    const ImVec4& clip_rect = draw_list->_ClipRectStack.back();
     for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
-      if (lines_[i].empty()) {
-        ImGui::Text("");
+      if (static_cast<uint32_t>(i) + 1 == highlighted_line_) {
+        draw_list->AddRectFilled(
+            ImVec2(clip_rect.x, pos.y),
+            ImVec2(clip_rect.z, pos.y + line_height),
+            ImGui::GetColorU32(kBase02));
+      }
+      const char* line = loader_.LineBegin(i);
+      const char* line_end = loader_.LineEnd(i);
+      if (static_cast<size_t>(i) < loader_.colored_line_count()) {
+        layout_.DrawLine(draw_list,
+                         pos,
+                         clip_rect,
+                         i,
+                         line,
+                         line_end,
+                         loader_.RunsBegin(i),
+                         loader_.RunsEnd(i));
       } else {
-        //Text("     ");
-        //SameLine(0, 0);
-        for (size_t j = 0; j < lines_[i].size(); ++j) {
-          const ColoredText& part = lines_[i][j];
-          ImGui::PushStyleColor(ImGuiCol_Text, ColorForTokenType(part.type));
-          ImGui::TextUnformatted(part.text.data(),
-                                 part.text.data() + part.text.size());
-          if (j != lines_[i].size() - 1)
-            ImGui::SameLine(0, 0);
-          ImGui::PopStyleColor();
-        }
+        // Not lexed yet.
+        ColorRun run = {0, static_cast<uint32_t>(line_end - line),
+                        Lexer::Text};
+        layout_.DrawLine(
+            draw_list, pos, clip_rect, i, line, line_end, &run, &run + 1);
       }
+      pos.y += line_height;
     }
+    ImGui::Dummy(
+        ImVec2(0, (clipper.DisplayEnd - clipper.DisplayStart) * line_height));
   }
 
 #if 0
@@ -1705,6 +2776,571 @@ void SourceView::Draw() {
 #endif
 }
 
+// Shows where the process being debugged is, and has the buttons to run it.
+class DebuggerView {
+ public:
+  // |debugger|, |frame_scheduler| and |glyphs| must outlive this. A frame is
+  // asked for when the binary's symbols have loaded. Characters in the status
+  // that aren't in the font yet are added to |glyphs|.
+  DebuggerView(Debugger* debugger,
+               FrameScheduler* frame_scheduler,
+               DynamicGlyphAtlas* glyphs);
+  ~DebuggerView();
+
+  // Runs |command_line|, which is split as SplitCommandLine() does.
+  void Launch(const std::string& command_line);
+
+  void OnEvent(const DebugEvent& event);
+
+  // Returns true, once, each time the process stops somewhere with a known
+  // source line, with the file and line (counting from 1) it's at.
+  bool TakeSourceLocation(std::string* path, uint32_t* line);
+
+  void Draw();
+
+ private:
+#if PLATFORM_LINUX
+  struct Binary {
+    std::unique_ptr<ElfFile> file;
+    std::unique_ptr<SymbolTable> symbols;
+    std::unique_ptr<LineIndex> lines;
+  };
+
+  // Where a loading thread leaves what it loaded. It's shared with the
+  // threads, which are never waited for, so that a big binary that's still
+  // loading doesn't hold up another launch, or quitting.
+  struct LoadedBinary {
+    LoadedBinary() : generation(0) {}
+    Mutex mutex;
+    // Which load is wanted. Threads for earlier ones throw theirs away.
+    int generation;
+    std::unique_ptr<Binary> binary;
+  };
+
+  // Starts loading the symbols for the program running as |process_id|.
+  void LoadBinary(int process_id);
+
+  // Sets |location_| to the symbol the process stopped in, and
+  // |source_location_| to its line, if they're known.
+  void UpdateLocation();
+#endif
+
+  Debugger* debugger_;
+  FrameScheduler* frame_scheduler_;
+  DynamicGlyphAtlas* glyphs_;
+  std::string status_;
+  int thread_id_;
+  bool have_registers_;
+  Registers registers_;
+#if PLATFORM_LINUX
+  // Symbols are loaded in the background, as they're not needed until the
+  // process stops somewhere.
+  std::shared_ptr<LoadedBinary> loaded_binary_;
+  std::unique_ptr<Binary> binary_;
+  uint64_t entry_point_;
+  uint64_t stop_address_;
+  std::string location_;
+  LineLocation source_location_;
+  bool source_location_changed_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(DebuggerView);
+};
+
+DebuggerView::DebuggerView(Debugger* debugger,
+                           FrameScheduler* frame_scheduler,
+                           DynamicGlyphAtlas* glyphs)
+    : debugger_(debugger),
+      frame_scheduler_(frame_scheduler),
+      glyphs_(glyphs),
+      status_("No process"),
+      thread_id_(0),
+      have_registers_(false) {
+#if PLATFORM_LINUX
+  entry_point_ = 0;
+  stop_address_ = 0;
+  source_location_.line = 0;
+  source_location_changed_ = false;
+  loaded_binary_ = std::make_shared<LoadedBinary>();
+#endif
+}
+
+DebuggerView::~DebuggerView() {
+#if PLATFORM_LINUX
+  // Once this returns, nothing that's still loading will use
+  // |frame_scheduler_|.
+  MutexScope lock(&loaded_binary_->mutex);
+  ++loaded_binary_->generation;
+  loaded_binary_->binary.reset();
+#endif
+}
+
+void DebuggerView::Launch(const std::string& command_line) {
+  std::vector<std::string> args = SplitCommandLine(command_line);
+  if (args.empty())
+    return;
+  std::string path = args[0];
+  args.erase(args.begin());
+  debugger_->Launch(path, args, std::string());
+  status_ = "Starting " + path;
+  have_registers_ = false;
+
+#if PLATFORM_LINUX
+  // The symbols are loaded once it's started.
+  binary_.reset();
+  location_.clear();
+#else
+  UNUSED(frame_scheduler_);
+#endif
+}
+
+#if PLATFORM_LINUX
+void DebuggerView::LoadBinary(int process_id) {
+  // Through /proc, rather than the path it was launched with, which execvp()
+  // might have found in PATH.
+  char path_buffer[64];
+  snprintf(path_buffer, sizeof(path_buffer), "/proc/%d/exe", process_id);
+  std::string path = path_buffer;
+  binary_.reset();
+  location_.clear();
+  source_location_.path.clear();
+  source_location_.line = 0;
+  int generation;
+  {
+    MutexScope lock(&loaded_binary_->mutex);
+    generation = ++loaded_binary_->generation;
+    loaded_binary_->binary.reset();
+  }
+  std::shared_ptr<LoadedBinary> loaded = loaded_binary_;
+  FrameScheduler* frame_scheduler = frame_scheduler_;
+  std::thread([path, loaded, generation, frame_scheduler] {
+    std::unique_ptr<Binary> binary(new Binary);
+    binary->file.reset(ElfFile::Open(path));
+    if (binary->file) {
+      binary->symbols.reset(new SymbolTable(*binary->file));
+      // Only the units' headers are read here; their line tables are decoded
+      // as they're stopped in.
+      binary->lines.reset(new LineIndex(*binary->file));
+    }
+    MutexScope lock(&loaded->mutex);
+    if (loaded->generation != generation)
+      return;
+    loaded->binary = std::move(binary);
+    frame_scheduler->RequestFrame();
+  }).detach();
+}
+
+void DebuggerView::UpdateLocation() {
+  location_.clear();
+  if (!binary_ || !binary_->symbols || !have_registers_)
+    return;
+  // Position-independent programs are loaded somewhere other than where they
+  // were linked, which is worked out from where they started.
+  uint64_t bias =
+      entry_point_ ? entry_point_ - binary_->file->entry_point() : 0;
+  LineLocation source_location;
+  if (binary_->lines->Lookup(stop_address_ - bias, &source_location) &&
+      (source_location.path != source_location_.path ||
+       source_location.line != source_location_.line)) {
+    source_location_ = source_location;
+    source_location_changed_ = true;
+    // It's shown next frame, as the source has already been drawn if the
+    // binary's only just loaded.
+    frame_scheduler_->RequestFrame();
+  }
+  const Symbol* symbol = binary_->symbols->Lookup(stop_address_ - bias);
+  if (!symbol)
+    return;
+  int status;
+  char* demangled = abi::__cxa_demangle(symbol->name, NULL, NULL, &status);
+  char offset[32];
+  snprintf(offset,
+           sizeof(offset),
+           "+0x%llx",
+           static_cast<unsigned long long>(stop_address_ - bias -
+                                           symbol->address));
+  location_ = std::string("in ") + (demangled ? demangled : symbol->name) +
+              offset;
+  free(demangled);
+}
+#endif
+
+void DebuggerView::OnEvent(const DebugEvent& event) {
+  static const char* const kStopReasons[] = {
+      "entry", "attached", "breakpoint", "stepped", "paused", "signal",
+  };
+  char status[256];
+  switch (event.type) {
+    case DebugEvent::kStopped:
+      snprintf(status,
+               sizeof(status),
+               "Thread %d stopped at 0x%llx (%s)",
+               event.thread_id,
+               static_cast<unsigned long long>(event.address),
+               kStopReasons[event.reason]);
+      status_ = status;
+      thread_id_ = event.thread_id;
+      have_registers_ = debugger_->ReadRegisters(thread_id_, &registers_);
+#if PLATFORM_LINUX
+      if (event.reason == DebugEvent::kEntry ||
+          event.reason == DebugEvent::kAttached) {
+        entry_point_ = event.entry_point;
+        LoadBinary(event.thread_id);
+      }
+      stop_address_ = event.address;
+      UpdateLocation();
+#endif
+      break;
+    case DebugEvent::kExited:
+      if (!event.message.empty())
+        snprintf(status, sizeof(status), "%s", event.message.c_str());
+      else if (event.signal)
+        snprintf(status, sizeof(status), "Killed by signal %d", event.signal);
+      else
+        snprintf(status, sizeof(status), "Exited with %d", event.exit_code);
+      status_ = status;
+      have_registers_ = false;
+      break;
+    case DebugEvent::kError:
+      status_ = event.message;
+      break;
+    case DebugEvent::kMemory:
+      break;
+  }
+}
+
+bool DebuggerView::TakeSourceLocation(std::string* path, uint32_t* line) {
+#if PLATFORM_LINUX
+  if (!source_location_changed_)
+    return false;
+  source_location_changed_ = false;
+  *path = source_location_.path;
+  *line = source_location_.line;
+  return true;
+#else
+  UNUSED(path);
+  UNUSED(line);
+  return false;
+#endif
+}
+
+void DebuggerView::Draw() {
+#if PLATFORM_LINUX
+  std::unique_ptr<Binary> loaded;
+  {
+    MutexScope lock(&loaded_binary_->mutex);
+    loaded = std::move(loaded_binary_->binary);
+  }
+  if (loaded) {
+    binary_ = std::move(loaded);
+    UpdateLocation();
+  }
+#endif
+
+  // Paths, and the command line, can have anything in them.
+  glyphs_->RequestGlyphs(ImGui::GetFont(), status_.c_str());
+  ImGui::TextUnformatted(status_.c_str());
+#if PLATFORM_LINUX
+  if (!location_.empty() && debugger_->IsStopped()) {
+    glyphs_->RequestGlyphs(ImGui::GetFont(), location_.c_str());
+    ImGui::TextUnformatted(location_.c_str());
+  }
+#endif
+  if (debugger_->IsStopped()) {
+    if (ImGui::Button("Continue"))
+      debugger_->Continue();
+    ImGui::SameLine();
+    if (ImGui::Button("Step"))
+      debugger_->StepInstruction(thread_id_);
+    ImGui::SameLine();
+  } else {
+    if (ImGui::Button("Pause"))
+      debugger_->Pause();
+    ImGui::SameLine();
+  }
+  if (ImGui::Button("Kill"))
+    debugger_->Kill();
+
+  if (have_registers_ && debugger_->IsStopped()) {
+    ImGui::Separator();
+    for (int i = 0; i < Registers::kCount; ++i) {
+      ImGui::Text("%-6s %016llx",
+                  GetRegisterName(i),
+                  static_cast<unsigned long long>(registers_.values[i]));
+    }
+  }
+}
+
+// A hex dump of the process's memory, anywhere in the address space. Only the
+// pages that are on screen, and a screen's worth either side, are ever read,
+// in the background, and bytes that changed since the last stop are
+// highlighted.
+class MemoryView {
+ public:
+  // |debugger| must outlive this. |frame_scheduler| is asked for a frame when
+  // the view moves.
+  MemoryView(Debugger* debugger, FrameScheduler* frame_scheduler);
+
+  void OnEvent(const DebugEvent& event);
+  void Draw();
+
+ private:
+  static const uint64_t kBytesPerRow = 16;
+  // ImGui lays out in floats, which can't reach the end of the address space
+  // a row at a time, so the scrolling region is only this many rows, from
+  // |base_row_|, and it's moved when the view gets near either end of it.
+  static const uint64_t kWindowRows = 1 << 16;
+  // The last page isn't shown, so the end of the last row doesn't wrap.
+  static const uint64_t kRowCount =
+      (UINT64_C(1) << 60) - MemoryPages::kPageSize / kBytesPerRow;
+  // Reads are no bigger than this, so that other reads can be answered in
+  // between.
+  static const size_t kMaxRequestSize = 64 * 1024;
+
+  static uint64_t BaseRowFor(uint64_t row);
+  void DrawRow(ImDrawList* draw_list, ImVec2 pos, uint64_t row);
+
+  Debugger* debugger_;
+  FrameScheduler* frame_scheduler_;
+  MemoryPages pages_;
+  std::vector<MemoryPages::Request> requests_;
+  uint64_t base_row_;
+  // The scroll position is only applied a frame after it's set, so the base
+  // that goes with it waits until then too.
+  bool have_pending_base_row_;
+  uint64_t pending_base_row_;
+  bool have_go_to_row_;
+  uint64_t go_to_row_;
+  char address_text_[17];
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryView);
+};
+
+MemoryView::MemoryView(Debugger* debugger, FrameScheduler* frame_scheduler)
+    : debugger_(debugger),
+      frame_scheduler_(frame_scheduler),
+      pages_(1024),
+      base_row_(0),
+      have_pending_base_row_(false),
+      pending_base_row_(0),
+      have_go_to_row_(false),
+      go_to_row_(0) {
+  address_text_[0] = 0;
+}
+
+void MemoryView::OnEvent(const DebugEvent& event) {
+  switch (event.type) {
+    case DebugEvent::kStopped:
+      pages_.OnStopped();
+      // Somewhere to start from.
+      if (!address_text_[0]) {
+        snprintf(address_text_,
+                 sizeof(address_text_),
+                 "%llx",
+                 static_cast<unsigned long long>(event.address));
+        have_go_to_row_ = true;
+        go_to_row_ = event.address / kBytesPerRow;
+      }
+      break;
+    case DebugEvent::kExited:
+      pages_.Clear();
+      break;
+    case DebugEvent::kMemory:
+      pages_.OnRead(event.address, event.size, event.memory);
+      break;
+    case DebugEvent::kError:
+      break;
+  }
+}
+
+uint64_t MemoryView::BaseRowFor(uint64_t row) {
+  uint64_t base = row > kWindowRows / 2 ? row - kWindowRows / 2 : 0;
+  return std::min(base, kRowCount - kWindowRows);
+}
+
+void MemoryView::DrawRow(ImDrawList* draw_list, ImVec2 pos, uint64_t row) {
+  static const char kHex[] = "0123456789abcdef";
+  ImU32 colors[] = {
+      ImGui::GetColorU32(kBase01),  // kUnknown
+      ImGui::GetColorU32(kBase01),  // kUnreadable
+      ImGui::GetColorU32(kBase01),  // kStale
+      ImGui::GetColorU32(kBase0),   // kUnchanged
+      ImGui::GetColorU32(kRed),     // kChanged
+  };
+  float char_width = ImGui::CalcTextSize("0").x;
+  uint64_t address = row * kBytesPerRow;
+  uint8_t bytes[kBytesPerRow];
+  MemoryPages::ByteState states[kBytesPerRow];
+  pages_.Get(address, kBytesPerRow, bytes, states);
+
+  // "0000000000401000  55 48 89 e5 ... 00 00  UH......", with the text in
+  // runs of the same state, so there are only a few per row.
+  char text[16 + 2 + kBytesPerRow * 3 + 1 + 1 + kBytesPerRow];
+  char* out = text;
+  for (int i = 60; i >= 0; i -= 4)
+    *out++ = kHex[(address >> i) & 0xf];
+  draw_list->AddText(pos, colors[MemoryPages::kUnknown], text, out);
+  out = text;
+
+  int column = 18;
+  size_t run_start = 0;
+  for (size_t i = 0; i <= kBytesPerRow; ++i) {
+    if (i == kBytesPerRow || (i > 0 && states[i] != states[run_start])) {
+      // Each byte is 3 characters, and there's one more after the eighth.
+      int start_column = column + static_cast<int>(run_start * 3) +
+                         (run_start >= kBytesPerRow / 2 ? 1 : 0);
+      draw_list->AddText(
+          ImVec2(pos.x + start_column * char_width, pos.y),
+          colors[states[run_start]],
+          text,
+          out);
+      out = text;
+      run_start = i;
+      if (i == kBytesPerRow)
+        break;
+    }
+    switch (states[i]) {
+      case MemoryPages::kUnknown:
+        *out++ = '.';
+        *out++ = '.';
+        break;
+      case MemoryPages::kUnreadable:
+        *out++ = '?';
+        *out++ = '?';
+        break;
+      default:
+        *out++ = kHex[bytes[i] >> 4];
+        *out++ = kHex[bytes[i] & 0xf];
+        break;
+    }
+    *out++ = ' ';
+    if (i == kBytesPerRow / 2 - 1)
+      *out++ = ' ';
+  }
+
+  column += kBytesPerRow * 3 + 2;
+  for (size_t i = 0; i < kBytesPerRow; ++i) {
+    bool known = states[i] != MemoryPages::kUnknown &&
+                 states[i] != MemoryPages::kUnreadable;
+    *out++ = known && bytes[i] >= 0x20 && bytes[i] < 0x7f
+                 ? static_cast<char>(bytes[i])
+                 : '.';
+  }
+  draw_list->AddText(ImVec2(pos.x + column * char_width, pos.y),
+                     colors[MemoryPages::kUnchanged],
+                     text,
+                     out);
+}
+
+void MemoryView::Draw() {
+  if (have_pending_base_row_) {
+    base_row_ = pending_base_row_;
+    have_pending_base_row_ = false;
+  }
+
+  ImGui::PushItemWidth(ImGui::CalcTextSize("0").x * 20);
+  if (ImGui::InputText("Address",
+                       address_text_,
+                       sizeof(address_text_),
+                       ImGuiInputTextFlags_EnterReturnsTrue |
+                           ImGuiInputTextFlags_CharsHexadecimal)) {
+    have_go_to_row_ = true;
+    go_to_row_ = strtoull(address_text_, NULL, 16) / kBytesPerRow;
+  }
+  ImGui::PopItemWidth();
+
+  ImGui::BeginChild("##memory");
+  ImDrawList* draw_list = ImGui::GetWindowDrawList();
+  float line_height = ImGui::GetTextLineHeightWithSpacing();
+  uint64_t first_row = 0;
+  uint64_t end_row = 0;
+  ImGuiListClipper clipper(static_cast<int>(kWindowRows), line_height);
+  while (clipper.Step()) {
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    first_row = base_row_ + clipper.DisplayStart;
+    end_row = base_row_ + clipper.DisplayEnd;
+    for (uint64_t row = first_row; row < end_row; ++row) {
+      DrawRow(draw_list, pos, row);
+      pos.y += line_height;
+    }
+    ImGui::Dummy(
+        ImVec2(0, (clipper.DisplayEnd - clipper.DisplayStart) * line_height));
+  }
+
+  // Move the window along when the view's near either end of it, or somewhere
+  // else altogether.
+  float scroll = ImGui::GetScrollY();
+  uint64_t top = static_cast<uint64_t>(scroll / line_height);
+  uint64_t row = base_row_ + top;
+  float offset = scroll - top * line_height;
+  if (have_go_to_row_) {
+    row = go_to_row_;
+    offset = 0;
+    have_go_to_row_ = false;
+  }
+  uint64_t base_row = base_row_;
+  if (row < base_row_ || row >= base_row_ + kWindowRows ||
+      (top < kWindowRows / 4 && base_row_ > 0) ||
+      (top > kWindowRows * 3 / 4 && base_row_ < kRowCount - kWindowRows)) {
+    base_row = BaseRowFor(row);
+  }
+  if (base_row != base_row_ || row != base_row_ + top) {
+    ImGui::SetScrollY((row - base_row) * line_height + offset);
+    have_pending_base_row_ = true;
+    pending_base_row_ = base_row;
+    frame_scheduler_->RequestFrame();
+  }
+  ImGui::EndChild();
+
+  // Read what's on screen, and a screen either side of it, and let go of
+  // anything else.
+  if (!debugger_->IsStopped() || end_row <= first_row)
+    return;
+  uint64_t screen = end_row - first_row;
+  uint64_t prefetch_begin = first_row > screen ? first_row - screen : 0;
+  uint64_t prefetch_end =
+      kRowCount - end_row > screen ? end_row + screen : kRowCount;
+  pages_.TakeMissing(prefetch_begin * kBytesPerRow,
+                     prefetch_end * kBytesPerRow,
+                     kMaxRequestSize,
+                     &requests_);
+  for (const auto& request : requests_)
+    debugger_->RequestMemory(request.address, request.size);
+  pages_.Trim(prefetch_begin * kBytesPerRow, prefetch_end * kBytesPerRow);
+}
+
+// Returns the path of a font that's installed with the OS that has CJK
+// glyphs, which Roboto doesn't, or NULL if none of the usual ones are there.
+static const char* FindFallbackFont() {
+  static const char* const kPaths[] = {
+#if PLATFORM_WINDOWS
+    "C:\\Windows\\Fonts\\msyh.ttc",
+    "C:\\Windows\\Fonts\\msgothic.ttc",
+#elif PLATFORM_OSX
+    "/System/Library/Fonts/PingFang.ttc",
+    "/System/Library/Fonts/Hiragino Sans GB.ttc",
+    "/Library/Fonts/Arial Unicode.ttf",
+#else
+    // Smallest first, as the whole file is read, and hashed for the atlas
+    // cache, at startup.
+    "/usr/share/fonts/truetype/droid/DroidSansFallbackFull.ttf",
+    "/usr/share/fonts/truetype/wqy/wqy-microhei.ttc",
+    "/usr/share/fonts/wenquanyi/wqy-microhei/wqy-microhei.ttc",
+    "/usr/share/fonts/opentype/noto/NotoSansCJK-Regular.ttc",
+    "/usr/share/fonts/noto-cjk/NotoSansCJK-Regular.ttc",
+    "/usr/share/fonts/google-noto-cjk/NotoSansCJK-Regular.ttc",
+#endif
+  };
+  for (const char* path : kPaths) {
+    FILE* file = fopen(path, "rb");
+    if (file) {
+      fclose(file);
+      return path;
+    }
+  }
+  return NULL;
+}
+
 static void error_callback(int error, const char* description) {
   fprintf(stderr, "Error %d: %s\n", error, description);
 }
@@ -1714,12 +3350,36 @@ int main(int, char**) {
   glfwSetErrorCallback(error_callback);
   if (!glfwInit())
     return 1;
+  // Prefer a GL 3.3 core context, and fall back to whatever the default is,
+  // and the fixed-function renderer, if that's not available.
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   glfwWindowHint(GLFW_MAXIMIZED, 1);
   GLFWwindow* window = glfwCreateWindow(1280, 720, "Seaborgium", NULL, NULL);
+  if (!window) {
+    glfwDefaultWindowHints();
+    glfwWindowHint(GLFW_MAXIMIZED, 1);
+    window = glfwCreateWindow(1280, 720, "Seaborgium", NULL, NULL);
+    if (!window)
+      return 1;
+  }
   glfwMakeContextCurrent(window);
 
+  // Frames are only drawn when something has changed, and no more often than
+  // the display refreshes. Anything can ask for one, from any thread, and
+  // that wakes the main loop if it's waiting for events.
+  const GLFWvidmode* video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+  int refresh_rate =
+      video_mode && video_mode->refreshRate > 0 ? video_mode->refreshRate : 60;
+  FrameScheduler frame_scheduler([] { glfwPostEmptyEvent(); },
+                                 1.0 / refresh_rate);
+  frame_scheduler.RequestFrame();
+
   // Setup ImGui binding.
-  ImGui_ImplGlfw_Init(window, true);
+  if (!ImGui_ImplGlfw_Init(window, true, &frame_scheduler))
+    return 1;
 
   // Load Fonts.
   ImGuiIO& io = ImGui::GetIO();
@@ -1727,6 +3387,8 @@ int main(int, char**) {
   config.OversampleH = 4;
   config.OversampleV = 4;
   // TODO(scottmg): Font with macOS symbols.
+  // Only these are baked up front. Anything else is added to the atlas the
+  // first time it's drawn.
   static const ImWchar ranges[] = {
       0x0020,
       0x00FF,  // Basic Latin + Latin Supplement.
@@ -1740,28 +3402,92 @@ int main(int, char**) {
       0x2325,  // Option.
       0,
   };
+  // Merged into both fonts, for the glyphs they don't have. Only the
+  // ideographic space is baked from it, as something has to be.
+  const char* fallback_font = FindFallbackFont();
+  ImFontConfig fallback_config = config;
+  fallback_config.MergeMode = true;
+  static const ImWchar fallback_ranges[] = {0x3000, 0x3000, 0};
   io.Fonts->AddFontFromFileTTF(
       "Roboto-Regular.ttf", 15.0f, &config, ranges);
+  if (fallback_font) {
+    io.Fonts->AddFontFromFileTTF(
+        fallback_font, 15.0f, &fallback_config, fallback_ranges);
+  }
   io.Fonts->AddFontFromFileTTF(
       "RobotoMono-Regular.ttf", 14.0f, &config, ranges);
+  if (fallback_font) {
+    io.Fonts->AddFontFromFileTTF(
+        fallback_font, 14.0f, &fallback_config, fallback_ranges);
+  }
+  // Rasterizing them is most of the time to the first frame, so the result is
+  // kept for next time.
+  BuildFontAtlasCached(io.Fonts, GetFontAtlasCachePath());
+  DynamicGlyphAtlas glyphs(
+      io.Fonts, [&frame_scheduler] { frame_scheduler.RequestFrame(); });
 
   ImVec4 clear_color = ImColor(114, 144, 154);
 
-  std::unique_ptr<SourceView> source_view(new SourceView);
+  SourceFileCache source_files;
+  std::unique_ptr<SourceView> source_view(
+      new SourceView(&source_files, &frame_scheduler, &glyphs));
   source_view->SetFilePath("src/main.cc");
 
+  // NULL where there's no debugger for the platform yet.
+  std::unique_ptr<Debugger> debugger(
+      MakeDebugger([&frame_scheduler] { frame_scheduler.RequestFrame(); }));
+  std::unique_ptr<DebuggerView> debugger_view(
+      debugger ? new DebuggerView(debugger.get(), &frame_scheduler, &glyphs)
+               : NULL);
+  std::unique_ptr<MemoryView> memory_views[4];
+  bool memory_open[COUNTOF(memory_views)] = {};
+  if (debugger) {
+    for (auto& memory_view : memory_views)
+      memory_view.reset(new MemoryView(debugger.get(), &frame_scheduler));
+  }
+  char command_line[1024] = "";
+
   ImGui::PushStyleColor(ImGuiCol_WindowBg, kBase03);
 
+#if 0
+  // ImGui's own .ini isn't used, but the docks are kept in a file of their
+  // own.
+  std::string dock_layout_path = GetUserConfigPath("dock_layout");
+  if (!dock_layout_path.empty())
+    ImGui::LoadDockLayout(dock_layout_path.c_str());
+#endif
+
 //#define NO_EVENT_WAIT
 
   // Main loop
   while (!glfwWindowShouldClose(window)) {
 #if defined(NO_EVENT_WAIT)
-    glfwPollEvents();
-#else
-    glfwWaitEvents();
+    frame_scheduler.RequestFrame();
 #endif
+    // Sleep until there's something to draw, and then until it's time to.
+    double wait = frame_scheduler.TimeUntilFrame(glfwGetTime());
+    if (wait < 0)
+      glfwWaitEvents();
+    else if (wait > 0)
+      glfwWaitEventsTimeout(wait);
+    else
+      glfwPollEvents();
+    if (!frame_scheduler.BeginFrame(glfwGetTime()))
+      continue;
+    // Add whatever glyphs were missing last frame, before NewFrame() takes
+    // the white pixel's position in the atlas, which may move.
+    int glyphs_dirty_begin, glyphs_dirty_end;
+    if (glyphs.Update(&glyphs_dirty_begin, &glyphs_dirty_end))
+      ImGui_ImplGlfw_UpdateFontTexture(glyphs_dirty_begin, glyphs_dirty_end);
     ImGui_ImplGlfw_NewFrame();
+    if (debugger) {
+      DebugEvent event;
+      while (debugger->PollEvent(&event)) {
+        debugger_view->OnEvent(event);
+        for (auto& memory_view : memory_views)
+          memory_view->OnEvent(event);
+      }
+    }
 
 #if defined(OS_MAC)
 #define MAIN_MODIFIER "Cmd-"  // TODO(scottmg): ⌘
@@ -1770,12 +3496,16 @@ int main(int, char**) {
 #define MAIN_MODIFIER "Ctrl-"
 #define EXTRA_MODIFIER "Alt-"
 #endif
+    bool open_binary = false;
     if (ImGui::BeginMainMenuBar()) {
       if (ImGui::BeginMenu("File")) {
         if (ImGui::MenuItem("Open", MAIN_MODIFIER EXTRA_MODIFIER "O")) {
         }
-        if (ImGui::MenuItem("Open From Binary", MAIN_MODIFIER "O")) {
-          printf("hai\n");
+        if (ImGui::MenuItem("Open From Binary",
+                            MAIN_MODIFIER "O",
+                            false,
+                            debugger_view != NULL)) {
+          open_binary = true;
         }
         ImGui::Separator();
         if (ImGui::MenuItem("Quit", MAIN_MODIFIER "Q")) {
@@ -1796,14 +3526,13 @@ int main(int, char**) {
         }
         if (ImGui::MenuItem("Watch", MAIN_MODIFIER EXTRA_MODIFIER "W")) {
         }
-        if (ImGui::MenuItem("Memory 1", MAIN_MODIFIER EXTRA_MODIFIER "M")) {
-        }
-        if (ImGui::MenuItem("Memory 2", "")) {
-        }
-        if (ImGui::MenuItem("Memory 3", "")) {
-        }
-        if (ImGui::MenuItem("Memory 4", "")) {
-        }
+        ImGui::MenuItem("Memory 1",
+                        MAIN_MODIFIER EXTRA_MODIFIER "M",
+                        &memory_open[0],
+                        debugger != NULL);
+        ImGui::MenuItem("Memory 2", "", &memory_open[1], debugger != NULL);
+        ImGui::MenuItem("Memory 3", "", &memory_open[2], debugger != NULL);
+        ImGui::MenuItem("Memory 4", "", &memory_open[3], debugger != NULL);
         ImGui::EndMenu();
       }
       ImGui::EndMainMenuBar();
@@ -1811,6 +3540,30 @@ int main(int, char**) {
 #undef MAIN_MODIFIER
 #undef EXTRA_MODIFIER
 
+    // Popups can't be opened from within the menu, which has its own ID stack.
+    if (open_binary)
+      ImGui::OpenPopup("Open From Binary");
+    if (ImGui::BeginPopupModal(
+            "Open From Binary", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+      ImGui::Text("Command line:");
+      if (open_binary)
+        ImGui::SetKeyboardFocusHere();
+      glyphs.RequestGlyphs(ImGui::GetFont(), command_line);
+      bool run = ImGui::InputText("##command_line",
+                                  command_line,
+                                  sizeof(command_line),
+                                  ImGuiInputTextFlags_EnterReturnsTrue);
+      run |= ImGui::Button("Run");
+      ImGui::SameLine();
+      if (run) {
+        debugger_view->Launch(command_line);
+        ImGui::CloseCurrentPopup();
+      } else if (ImGui::Button("Cancel")) {
+        ImGui::CloseCurrentPopup();
+      }
+      ImGui::EndPopup();
+    }
+
     // 1. Show a simple window
     // Tip: if we don't call ImGui::Begin()/ImGui::End() the widgets appears in
     // a window automatically called "Debug"
@@ -1891,6 +3644,15 @@ int main(int, char**) {
           ImGui::CaptureKeyboardFromApp(false);
     }
 
+    std::string stop_path;
+    uint32_t stop_line;
+    if (debugger_view &&
+        debugger_view->TakeSourceLocation(&stop_path, &stop_line)) {
+      if (stop_path != source_view->path())
+        source_view->SetFilePath(stop_path);
+      source_view->ShowLine(stop_line);
+    }
+
     ImGui::SetNextWindowPos(ImVec2(600, 100));
     ImGui::SetNextWindowSize(ImVec2(650, 600), ImGuiSetCond_FirstUseEver);
     if (ImGui::Begin("Source",
@@ -1903,6 +3665,31 @@ int main(int, char**) {
       ImGui::End();
     }
 
+    if (debugger_view) {
+      ImGui::SetNextWindowPos(ImVec2(1260, 100), ImGuiSetCond_FirstUseEver);
+      ImGui::SetNextWindowSize(ImVec2(300, 450), ImGuiSetCond_FirstUseEver);
+      if (ImGui::Begin("Debugger")) {
+        ImGui::PushFont(io.Fonts->Fonts[1]);
+        debugger_view->Draw();
+        ImGui::PopFont();
+      }
+      ImGui::End();
+    }
+
+    for (size_t i = 0; i < COUNTOF(memory_views); ++i) {
+      if (!memory_open[i])
+        continue;
+      char title[32];
+      snprintf(title, sizeof(title), "Memory %d", static_cast<int>(i + 1));
+      ImGui::SetNextWindowSize(ImVec2(650, 400), ImGuiSetCond_FirstUseEver);
+      if (ImGui::Begin(title, &memory_open[i])) {
+        ImGui::PushFont(io.Fonts->Fonts[1]);
+        memory_views[i]->Draw();
+        ImGui::PopFont();
+      }
+      ImGui::End();
+    }
+
 #if 0
     {
       ImGui::SetNextWindowPos(ImVec2(0, 0));
@@ -1929,20 +3716,22 @@ int main(int, char**) {
         ImGui::EndDockspace();
       }
       ImGui::End();
+      if (!dock_layout_path.empty())
+        ImGui::SaveDockLayoutWhenSettled(dock_layout_path.c_str());
     }
 #endif
 
     // Rendering
-    int display_w, display_h;
-    glfwGetFramebufferSize(window, &display_w, &display_h);
-    glViewport(0, 0, display_w, display_h);
-    glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
-    glClear(GL_COLOR_BUFFER_BIT);
-    ImGui::Render();
-    glfwSwapBuffers(window);
+    if (ImGui_ImplGlfw_RenderFrame(clear_color))
+      glfwSwapBuffers(window);
   }
 
   // Cleanup
+#if 0
+  if (!dock_layout_path.empty())
+    ImGui::SaveDockLayout(dock_layout_path.c_str());
+  ImGui::ShutdownDock();
+#endif
   ImGui_ImplGlfw_Shutdown();
   glfwTerminate();
 
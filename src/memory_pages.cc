@@ -0,0 +1,140 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "memory_pages.h"
+
+#include <string.h>
+
+namespace {
+
+const uint64_t kPageMask = ~(MemoryPages::kPageSize - 1);
+
+}  // namespace
+
+MemoryPages::MemoryPages(size_t max_pages) : max_pages_(max_pages) {}
+
+MemoryPages::~MemoryPages() {}
+
+void MemoryPages::TakeMissing(uint64_t begin,
+                              uint64_t end,
+                              size_t max_request_size,
+                              std::vector<Request>* requests) {
+  requests->clear();
+  if (end <= begin)
+    return;
+  max_request_size &= kPageMask;
+  if (max_request_size < kPageSize)
+    max_request_size = kPageSize;
+  // Counted, rather than up to |end|, so the last page of the address space
+  // doesn't wrap around.
+  uint64_t first = begin & kPageMask;
+  uint64_t count = (((end - 1) & kPageMask) - first) / kPageSize + 1;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint64_t page = first + i * kPageSize;
+    Page& entry = pages_[page];
+    if (entry.pending || entry.unreadable || entry.data)
+      continue;
+    entry.pending = true;
+    if (!requests->empty()) {
+      Request& last = requests->back();
+      if (last.address + last.size == page &&
+          last.size + kPageSize <= max_request_size) {
+        last.size += kPageSize;
+        continue;
+      }
+    }
+    Request request = {page, static_cast<size_t>(kPageSize)};
+    requests->push_back(request);
+  }
+}
+
+void MemoryPages::OnRead(uint64_t address,
+                         size_t requested_size,
+                         const std::vector<uint8_t>& data) {
+  size_t page_count = requested_size / kPageSize;
+  size_t read_count = data.size() / kPageSize;
+  for (size_t i = 0; i < page_count; ++i) {
+    auto it = pages_.find(address + i * kPageSize);
+    // Trimmed, or cleared, since it was asked for.
+    if (it == pages_.end() || !it->second.pending)
+      continue;
+    Page& page = it->second;
+    page.pending = false;
+    if (i == read_count) {
+      page.unreadable = true;
+      continue;
+    }
+    // Otherwise it's after an unreadable page, and will be asked for again.
+    if (i > read_count)
+      continue;
+
+    const uint8_t* bytes = &data[i * kPageSize];
+    page.data.reset(new uint8_t[kPageSize]);
+    memcpy(page.data.get(), bytes, kPageSize);
+    page.changed.reset();
+    if (page.previous && memcmp(page.previous.get(), bytes, kPageSize) != 0) {
+      page.changed.reset(new uint64_t[kPageSize / 64]());
+      for (size_t j = 0; j < kPageSize; ++j) {
+        if (page.previous[j] != bytes[j])
+          page.changed[j / 64] |= UINT64_C(1) << (j % 64);
+      }
+    }
+  }
+}
+
+void MemoryPages::OnStopped() {
+  for (auto& it : pages_) {
+    Page& page = it.second;
+    // Anything still being read was from the last stop, and won't come back
+    // now that the process has run.
+    page.pending = false;
+    page.unreadable = false;
+    if (page.data)
+      page.previous = std::move(page.data);
+    page.changed.reset();
+  }
+}
+
+void MemoryPages::Clear() {
+  pages_.clear();
+}
+
+void MemoryPages::Trim(uint64_t begin, uint64_t end) {
+  if (pages_.size() <= max_pages_)
+    return;
+  pages_.erase(pages_.begin(), pages_.lower_bound(begin & kPageMask));
+  if (end > begin)
+    pages_.erase(pages_.lower_bound(end), pages_.end());
+}
+
+void MemoryPages::Get(uint64_t address,
+                      size_t size,
+                      uint8_t* bytes,
+                      ByteState* states) const {
+  uint64_t page_address = address & kPageMask;
+  DCHECK(address - page_address + size <= kPageSize);
+  auto it = pages_.find(page_address);
+  const Page* page = it == pages_.end() ? NULL : &it->second;
+  size_t offset = static_cast<size_t>(address - page_address);
+  for (size_t i = 0; i < size; ++i) {
+    size_t j = offset + i;
+    bytes[i] = 0;
+    if (!page) {
+      states[i] = kUnknown;
+    } else if (page->data) {
+      bytes[i] = page->data[j];
+      states[i] =
+          page->changed && (page->changed[j / 64] & (UINT64_C(1) << (j % 64)))
+              ? kChanged
+              : kUnchanged;
+    } else if (page->unreadable) {
+      states[i] = kUnreadable;
+    } else if (page->previous) {
+      bytes[i] = page->previous[j];
+      states[i] = kStale;
+    } else {
+      states[i] = kUnknown;
+    }
+  }
+}
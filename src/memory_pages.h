@@ -0,0 +1,108 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MEMORY_PAGES_H_
+#define MEMORY_PAGES_H_
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "core.h"
+
+// What a memory view knows of the process's memory, a page at a time. Pages
+// are read in the background, so a page can be known, not yet read, or
+// unreadable, and the view shows what it has without waiting for the rest.
+//
+// Each stop's bytes are compared with the last that were read at an earlier
+// stop, once when they arrive, so that drawing can show what's changed
+// without comparing anything itself.
+//
+// There's no telling which pages the process wrote to while it ran, so every
+// page that's on screen is read again at each stop. Those that aren't are
+// only read again if they're scrolled to.
+// Linux's soft-dirty bits (/proc/pid/clear_refs and /proc/pid/pagemap) could
+// say which pages are clean, but clearing them at each stop would make the
+// process fault on its next write to every page, which costs more.
+class MemoryPages {
+ public:
+  static const uint64_t kPageSize = 4096;
+
+  // How a byte should be shown.
+  enum ByteState {
+    // Not read yet.
+    kUnknown,
+    kUnreadable,
+    // From an earlier stop, as it hasn't been read again yet.
+    kStale,
+    kUnchanged,
+    // Different from the earlier stop.
+    kChanged,
+  };
+
+  // A run of pages to read, from |address|.
+  struct Request {
+    uint64_t address;
+    size_t size;
+  };
+
+  // Keeps at most around |max_pages|, other than those in use.
+  explicit MemoryPages(size_t max_pages);
+  ~MemoryPages();
+
+  // Marks the pages that cover [begin, end) that aren't read or being read
+  // as being read, and returns them in |requests|, with adjacent pages
+  // together, up to |max_request_size| bytes at a time.
+  void TakeMissing(uint64_t begin,
+                   uint64_t end,
+                   size_t max_request_size,
+                   std::vector<Request>* requests);
+
+  // Takes what was read for a request, which is |data| for as far as could
+  // be read, with the page after that being unreadable.
+  void OnRead(uint64_t address,
+              size_t requested_size,
+              const std::vector<uint8_t>& data);
+
+  // The process stopped again, so every page has to be read again, including
+  // those that didn't change, and will be compared with what's here now.
+  void OnStopped();
+
+  // The process is gone.
+  void Clear();
+
+  // Forgets pages outside [begin, end) if there are too many.
+  void Trim(uint64_t begin, uint64_t end);
+
+  // |size| bytes from |address|, which mustn't cross a page.
+  void Get(uint64_t address,
+           size_t size,
+           uint8_t* bytes,
+           ByteState* states) const;
+
+  size_t page_count() const { return pages_.size(); }
+
+ private:
+  struct Page {
+    Page() : pending(false), unreadable(false) {}
+    // Being read.
+    bool pending;
+    // At this stop.
+    bool unreadable;
+    // As of this stop, or NULL if it hasn't been read since.
+    std::unique_ptr<uint8_t[]> data;
+    // As of the last stop that it was read at before this one, or NULL.
+    std::unique_ptr<uint8_t[]> previous;
+    // A bit for each byte of |data| that's different in |previous|, or NULL
+    // if none are.
+    std::unique_ptr<uint64_t[]> changed;
+  };
+
+  const size_t max_pages_;
+  std::map<uint64_t, Page> pages_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryPages);
+};
+
+#endif  // MEMORY_PAGES_H_
@@ -0,0 +1,145 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "memory_pages.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+const uint64_t kPage = MemoryPages::kPageSize;
+
+std::vector<uint8_t> Filled(size_t pages, uint8_t value) {
+  return std::vector<uint8_t>(pages * kPage, value);
+}
+
+MemoryPages::ByteState StateAt(const MemoryPages& pages,
+                               uint64_t address,
+                               uint8_t* byte) {
+  MemoryPages::ByteState state;
+  pages.Get(address, 1, byte, &state);
+  return state;
+}
+
+}  // namespace
+
+TEST(MemoryPages, TakeMissing) {
+  MemoryPages pages(100);
+  std::vector<MemoryPages::Request> requests;
+
+  // Partial pages at either end are rounded out, and runs are split at the
+  // maximum size.
+  pages.TakeMissing(0x10010, 0x13001, 2 * kPage, &requests);
+  ASSERT_EQ(2u, requests.size());
+  EXPECT_EQ(0x10000u, requests[0].address);
+  EXPECT_EQ(2 * kPage, requests[0].size);
+  EXPECT_EQ(0x12000u, requests[1].address);
+  EXPECT_EQ(2 * kPage, requests[1].size);
+  EXPECT_EQ(4u, pages.page_count());
+
+  // Those are being read, so only the new ones are asked for, around them.
+  pages.TakeMissing(0xf000, 0x16000, 64 * 1024, &requests);
+  ASSERT_EQ(2u, requests.size());
+  EXPECT_EQ(0xf000u, requests[0].address);
+  EXPECT_EQ(kPage, requests[0].size);
+  EXPECT_EQ(0x14000u, requests[1].address);
+  EXPECT_EQ(2 * kPage, requests[1].size);
+
+  pages.TakeMissing(0x10000, 0x10000, 64 * 1024, &requests);
+  EXPECT_TRUE(requests.empty());
+
+  // The top of the address space doesn't wrap around.
+  pages.TakeMissing(~UINT64_C(0) - 10, ~UINT64_C(0), 64 * 1024, &requests);
+  ASSERT_EQ(1u, requests.size());
+  EXPECT_EQ(~UINT64_C(0) & ~(kPage - 1), requests[0].address);
+  EXPECT_EQ(kPage, requests[0].size);
+}
+
+TEST(MemoryPages, ShortRead) {
+  MemoryPages pages(100);
+  std::vector<MemoryPages::Request> requests;
+  pages.TakeMissing(0x10000, 0x14000, 64 * 1024, &requests);
+  ASSERT_EQ(1u, requests.size());
+
+  uint8_t byte;
+  EXPECT_EQ(MemoryPages::kUnknown, StateAt(pages, 0x10000, &byte));
+
+  // The third page couldn't be read, so the fourth wasn't either.
+  pages.OnRead(0x10000, 4 * kPage, Filled(2, 0xab));
+  EXPECT_EQ(MemoryPages::kUnchanged, StateAt(pages, 0x10000, &byte));
+  EXPECT_EQ(0xab, byte);
+  EXPECT_EQ(MemoryPages::kUnchanged, StateAt(pages, 0x11fff, &byte));
+  EXPECT_EQ(MemoryPages::kUnreadable, StateAt(pages, 0x12000, &byte));
+  EXPECT_EQ(MemoryPages::kUnknown, StateAt(pages, 0x13000, &byte));
+
+  // So the fourth is asked for again, on its own.
+  pages.TakeMissing(0x10000, 0x14000, 64 * 1024, &requests);
+  ASSERT_EQ(1u, requests.size());
+  EXPECT_EQ(0x13000u, requests[0].address);
+  EXPECT_EQ(kPage, requests[0].size);
+}
+
+TEST(MemoryPages, ChangesSinceLastStop) {
+  MemoryPages pages(100);
+  std::vector<MemoryPages::Request> requests;
+  pages.TakeMissing(0x10000, 0x12000, 64 * 1024, &requests);
+  pages.OnRead(0x10000, 2 * kPage, Filled(2, 1));
+
+  pages.OnStopped();
+  uint8_t byte;
+  EXPECT_EQ(MemoryPages::kStale, StateAt(pages, 0x10000, &byte));
+  EXPECT_EQ(1, byte);
+
+  pages.TakeMissing(0x10000, 0x12000, 64 * 1024, &requests);
+  ASSERT_EQ(1u, requests.size());
+  std::vector<uint8_t> data = Filled(2, 1);
+  data[5] = 2;
+  data[kPage + 100] = 3;
+  pages.OnRead(0x10000, 2 * kPage, data);
+
+  uint8_t bytes[8];
+  MemoryPages::ByteState states[8];
+  pages.Get(0x10000, 8, bytes, states);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(i == 5 ? MemoryPages::kChanged : MemoryPages::kUnchanged,
+              states[i]);
+    EXPECT_EQ(i == 5 ? 2 : 1, bytes[i]);
+  }
+  EXPECT_EQ(MemoryPages::kChanged, StateAt(pages, 0x11000 + 100, &byte));
+  EXPECT_EQ(3, byte);
+  EXPECT_EQ(MemoryPages::kUnchanged, StateAt(pages, 0x11000 + 101, &byte));
+
+  // A read that was asked for before a stop is dropped after it.
+  pages.OnStopped();
+  pages.TakeMissing(0x10000, 0x11000, 64 * 1024, &requests);
+  pages.OnStopped();
+  pages.OnRead(0x10000, kPage, Filled(1, 9));
+  EXPECT_EQ(MemoryPages::kStale, StateAt(pages, 0x10000, &byte));
+  EXPECT_EQ(1, byte);
+
+  pages.Clear();
+  EXPECT_EQ(0u, pages.page_count());
+  EXPECT_EQ(MemoryPages::kUnknown, StateAt(pages, 0x10000, &byte));
+}
+
+TEST(MemoryPages, Trim) {
+  MemoryPages pages(4);
+  std::vector<MemoryPages::Request> requests;
+  pages.TakeMissing(0x10000, 0x13000, 64 * 1024, &requests);
+  pages.Trim(0x11000, 0x12000);
+  EXPECT_EQ(3u, pages.page_count());
+
+  pages.TakeMissing(0x20000, 0x23000, 64 * 1024, &requests);
+  EXPECT_EQ(6u, pages.page_count());
+  pages.Trim(0x11000, 0x21000);
+  EXPECT_EQ(3u, pages.page_count());
+
+  // A read that comes back after being trimmed is ignored.
+  pages.OnRead(0x10000, kPage, Filled(1, 0));
+  EXPECT_EQ(3u, pages.page_count());
+  uint8_t byte;
+  EXPECT_EQ(MemoryPages::kUnknown, StateAt(pages, 0x10000, &byte));
+}
@@ -0,0 +1,1075 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// A debugger for x86-64 Linux, using ptrace.
+//
+// ptrace only lets the thread that attached to a process control it, so that's
+// all done on a thread of the debugger's own, which takes commands from the UI
+// thread through a queue. While the process is running, that thread is blocked
+// in waitpid(), so the UI thread gets its attention by sending the process a
+// SIGSTOP, which the debugger thread swallows. The process is then stopped
+// while the commands are handled, and carries on afterwards unless one of them
+// said otherwise.
+//
+// Processes are attached with PTRACE_SEIZE, rather than PTRACE_ATTACH or
+// PTRACE_TRACEME, so that the debugger thread can stop all of a process's
+// threads with PTRACE_INTERRUPT, without signals of its own getting mixed up
+// with the process's.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/personality.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "debugger.h"
+#include "ptrace/process_memory.h"
+#include "ring_queue.h"
+
+namespace {
+
+const uint8_t kInt3 = 0xcc;
+const long kTraceOptions = PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC |
+                           PTRACE_O_EXITKILL;
+
+// What waitpid() said about a thread that's stopped for a ptrace event, other
+// than a signal, or 0.
+int GetPtraceEvent(int status) {
+  return status >> 16;
+}
+
+// ptrace() takes the signal to resume with as its |data| pointer.
+void* SignalData(int signal) {
+  return reinterpret_cast<void*>(static_cast<intptr_t>(signal));
+}
+
+// Where the kernel started the program in |pid|, from its aux vector, or 0.
+uint64_t GetEntryPoint(int pid) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/auxv", pid);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+  uint64_t entry_point = 0;
+  uint64_t pair[2];
+  while (read(fd, pair, sizeof(pair)) == sizeof(pair) && pair[0] != AT_NULL) {
+    if (pair[0] == AT_ENTRY) {
+      entry_point = pair[1];
+      break;
+    }
+  }
+  close(fd);
+  return entry_point;
+}
+
+class DebuggerPtrace : public Debugger {
+ public:
+  explicit DebuggerPtrace(const std::function<void()>& wake);
+  ~DebuggerPtrace() override;
+
+  // For the queues' alignment.
+  static void* operator new(size_t size) {
+    return AlignedAlloc(size, CACHE_LINE_SIZE);
+  }
+  static void operator delete(void* pointer) { AlignedFree(pointer); }
+
+  void Launch(const std::string& path,
+              const std::vector<std::string>& args,
+              const std::string& working_directory) override;
+  void Attach(int process_id) override;
+  void Detach() override;
+  void Kill() override;
+  void Continue() override;
+  void StepInstruction(int thread_id) override;
+  void Pause() override;
+  void AddBreakpoint(uint64_t address) override;
+  void RemoveBreakpoint(uint64_t address) override;
+  size_t ReadMemory(uint64_t address, void* buffer, size_t size) override;
+  void ReadMemoryRanges(MemoryRange* ranges, size_t count) override;
+  void RequestMemory(uint64_t address, size_t size) override;
+  bool ReadRegisters(int thread_id, Registers* registers) override;
+  bool PollEvent(DebugEvent* event) override;
+  bool IsStopped() const override { return stopped_; }
+
+ private:
+  struct Command {
+    enum Type {
+      kLaunch,
+      kAttach,
+      kDetach,
+      kKill,
+      kContinue,
+      kStep,
+      kPause,
+      kAddBreakpoint,
+      kRemoveBreakpoint,
+      kReadMemory,
+      kRequestMemory,
+      kReadRegisters,
+      kQuit,
+    };
+
+    Command()
+        : type(kQuit),
+          id(0),
+          address(0),
+          ranges(NULL),
+          count(0),
+          registers(NULL) {}
+
+    Type type;
+    std::string path;
+    std::vector<std::string> args;
+    std::string working_directory;
+    // A process for kAttach, or a thread.
+    int id;
+    uint64_t address;
+    MemoryRange* ranges;
+    // Of |ranges|, or bytes for kRequestMemory.
+    size_t count;
+    Registers* registers;
+  };
+
+  struct ThreadState {
+    ThreadState() : stopped(false), pending_signal(0) {}
+    bool stopped;
+    // To pass on when the thread's resumed.
+    int pending_signal;
+  };
+
+  struct Breakpoint {
+    Breakpoint() : inserted(false), original(0) {}
+    bool inserted;
+    // The byte that the int3 replaced.
+    uint8_t original;
+  };
+
+  enum State {
+    kNoProcess,
+    kStopped,
+    kRunning,
+  };
+
+  // What to do after handling the commands that arrive while stopped.
+  enum ResumeMode {
+    kStayStopped,
+    kResumeAll,
+    kResumeStep,
+  };
+
+  // UI thread.
+  void Send(const Command& command);
+
+  // Debugger thread.
+  static int32_t ThreadMain(void* user_data);
+  void Run();
+  // Returns false when it's time to quit.
+  bool Handle(Command* command);
+  void DoLaunch(const Command& command);
+  void DoAttach(int pid);
+  void DoDetach();
+  void DoKill();
+  void EndSession();
+
+  void OnWaitStatus(int tid, int status);
+  // After a step, for |stepping_thread_|.
+  void OnStepped(int tid);
+  // Stops every thread that's running, with what they stopped for kept for
+  // when they're resumed. Returns false if the process exited instead.
+  bool StopAll();
+  void Resume();
+  void ResumeThread(int tid, ThreadState* thread);
+  void ReportStop(DebugEvent::StopReason reason, int signal);
+  void ProcessExited(int status);
+  void ForgetProcess();
+
+  bool InsertBreakpoint(uint64_t address, Breakpoint* breakpoint);
+  void UninsertBreakpoint(uint64_t address, Breakpoint* breakpoint);
+  void InsertAllBreakpoints();
+  void FinishStepOver();
+  bool IsBreakpointAt(uint64_t address) const;
+
+  uint64_t GetPC(int tid);
+  void SetPC(int tid, uint64_t pc);
+  void DoReadMemory(MemoryRange* ranges, size_t count);
+  bool DoReadRegisters(int tid, Registers* registers);
+
+  void Post(const DebugEvent& event);
+  void PostError(const char* format, ...);
+
+  SpscRingQueue<Command> commands_;
+  SpscRingQueue<DebugEvent> events_;
+
+  // Shared. Set while the debugger thread is waiting for the process, so the
+  // UI thread knows to interrupt it.
+  Atomic<int32_t> running_;
+  // Set when the UI thread has sent the process a SIGSTOP that the debugger
+  // thread hasn't seen yet, so that there's only ever one.
+  Atomic<int32_t> interrupt_pending_;
+  Atomic<int32_t> process_id_;
+  // For the commands that the UI thread waits for. The event outlives them,
+  // as Set() can still be using it after Wait() has returned.
+  Event reply_ready_;
+  size_t reply_result_;
+
+  // UI thread.
+  bool stopped_;
+
+  // Debugger thread.
+  State state_;
+  ResumeMode resume_mode_;
+  int step_thread_;
+  // The thread that's single stepping, with everything else stopped, or 0.
+  int stepping_thread_;
+  // If |stepping_thread_| is stepping over a breakpoint, its address, to put
+  // back afterwards.
+  uint64_t step_over_address_;
+  // The thread that the process last stopped for.
+  int current_thread_;
+  int pid_;
+  bool attached_;
+  std::map<int, ThreadState> threads_;
+  std::map<uint64_t, Breakpoint> breakpoints_;
+  // Emptied whenever the process runs, or the debugger writes to it.
+  std::unique_ptr<ProcessMemory> memory_;
+
+  Thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(DebuggerPtrace);
+};
+
+DebuggerPtrace::DebuggerPtrace(const std::function<void()>& wake)
+    : commands_(256),
+      events_(256, wake),
+      running_(0),
+      interrupt_pending_(0),
+      process_id_(0),
+      reply_result_(0),
+      stopped_(false),
+      state_(kNoProcess),
+      resume_mode_(kStayStopped),
+      step_thread_(0),
+      stepping_thread_(0),
+      step_over_address_(0),
+      current_thread_(0),
+      pid_(0),
+      attached_(false) {
+  thread_.Start(&DebuggerPtrace::ThreadMain, this, "debugger");
+}
+
+DebuggerPtrace::~DebuggerPtrace() {
+  Send(Command());
+  thread_.Join();
+}
+
+void DebuggerPtrace::Launch(const std::string& path,
+                            const std::vector<std::string>& args,
+                            const std::string& working_directory) {
+  Command command;
+  command.type = Command::kLaunch;
+  command.path = path;
+  command.args = args;
+  command.working_directory = working_directory;
+  stopped_ = false;
+  Send(command);
+}
+
+void DebuggerPtrace::Attach(int process_id) {
+  Command command;
+  command.type = Command::kAttach;
+  command.id = process_id;
+  stopped_ = false;
+  Send(command);
+}
+
+void DebuggerPtrace::Detach() {
+  Command command;
+  command.type = Command::kDetach;
+  stopped_ = false;
+  Send(command);
+}
+
+void DebuggerPtrace::Kill() {
+  Command command;
+  command.type = Command::kKill;
+  stopped_ = false;
+  Send(command);
+}
+
+void DebuggerPtrace::Continue() {
+  Command command;
+  command.type = Command::kContinue;
+  stopped_ = false;
+  Send(command);
+}
+
+void DebuggerPtrace::StepInstruction(int thread_id) {
+  Command command;
+  command.type = Command::kStep;
+  command.id = thread_id;
+  stopped_ = false;
+  Send(command);
+}
+
+void DebuggerPtrace::Pause() {
+  Command command;
+  command.type = Command::kPause;
+  Send(command);
+}
+
+void DebuggerPtrace::AddBreakpoint(uint64_t address) {
+  Command command;
+  command.type = Command::kAddBreakpoint;
+  command.address = address;
+  Send(command);
+}
+
+void DebuggerPtrace::RemoveBreakpoint(uint64_t address) {
+  Command command;
+  command.type = Command::kRemoveBreakpoint;
+  command.address = address;
+  Send(command);
+}
+
+size_t DebuggerPtrace::ReadMemory(uint64_t address, void* buffer, size_t size) {
+  MemoryRange range = {address, buffer, size, 0};
+  ReadMemoryRanges(&range, 1);
+  return range.bytes_read;
+}
+
+void DebuggerPtrace::ReadMemoryRanges(MemoryRange* ranges, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    ranges[i].bytes_read = 0;
+  if (!stopped_)
+    return;
+  Command command;
+  command.type = Command::kReadMemory;
+  command.ranges = ranges;
+  command.count = count;
+  Send(command);
+  reply_ready_.Wait();
+}
+
+void DebuggerPtrace::RequestMemory(uint64_t address, size_t size) {
+  if (!stopped_)
+    return;
+  Command command;
+  command.type = Command::kRequestMemory;
+  command.address = address;
+  command.count = size;
+  Send(command);
+}
+
+bool DebuggerPtrace::ReadRegisters(int thread_id, Registers* registers) {
+  if (!stopped_)
+    return false;
+  Command command;
+  command.type = Command::kReadRegisters;
+  command.id = thread_id;
+  command.registers = registers;
+  Send(command);
+  reply_ready_.Wait();
+  return reply_result_ != 0;
+}
+
+bool DebuggerPtrace::PollEvent(DebugEvent* event) {
+  if (!events_.Pop(event))
+    return false;
+  if (event->type == DebugEvent::kStopped)
+    stopped_ = true;
+  else if (event->type == DebugEvent::kExited)
+    stopped_ = false;
+  return true;
+}
+
+void DebuggerPtrace::Send(const Command& command) {
+  while (!commands_.Push(command))
+    std::this_thread::yield();
+  // Pairs with the fence in Resume(), so that either the debugger thread sees
+  // the command before resuming the process, or this sees that it did.
+  MemBarrier();
+  if (!running_.Load(std::memory_order_relaxed))
+    return;
+  // The process can go at any point in here. kill() of 0 would stop sg's
+  // whole process group, and a pending interrupt left behind is cleared when
+  // the next one starts.
+  int pid = process_id_.Load();
+  if (pid != 0 && interrupt_pending_.Exchange(1) == 0)
+    kill(pid, SIGSTOP);
+}
+
+// static
+int32_t DebuggerPtrace::ThreadMain(void* user_data) {
+  static_cast<DebuggerPtrace*>(user_data)->Run();
+  return 0;
+}
+
+void DebuggerPtrace::Run() {
+  for (;;) {
+    if (state_ == kRunning) {
+      int status;
+      int tid = waitpid(-1, &status, __WALL);
+      if (tid < 0) {
+        if (errno == EINTR)
+          continue;
+        // Everything's gone without saying so, which shouldn't happen.
+        ProcessExited(0);
+      } else {
+        OnWaitStatus(tid, status);
+      }
+      if (state_ == kRunning)
+        continue;
+    } else {
+      commands_.Wait();
+    }
+
+    Command command;
+    while (commands_.Pop(&command)) {
+      if (!Handle(&command))
+        return;
+    }
+    if (state_ == kStopped && resume_mode_ != kStayStopped)
+      Resume();
+  }
+}
+
+bool DebuggerPtrace::Handle(Command* command) {
+  switch (command->type) {
+    case Command::kLaunch:
+      DoLaunch(*command);
+      break;
+    case Command::kAttach:
+      DoAttach(command->id);
+      break;
+    case Command::kDetach:
+      if (state_ != kNoProcess)
+        DoDetach();
+      break;
+    case Command::kKill:
+      if (state_ != kNoProcess)
+        DoKill();
+      break;
+    case Command::kContinue:
+      if (state_ == kStopped)
+        resume_mode_ = kResumeAll;
+      break;
+    case Command::kStep:
+      if (state_ == kStopped && threads_.count(command->id)) {
+        resume_mode_ = kResumeStep;
+        step_thread_ = command->id;
+      }
+      break;
+    case Command::kPause:
+      // Only when the process was stopped to handle this, rather than it
+      // already being stopped.
+      if (state_ == kStopped && resume_mode_ != kStayStopped)
+        ReportStop(DebugEvent::kPaused, 0);
+      break;
+    case Command::kAddBreakpoint: {
+      Breakpoint& breakpoint = breakpoints_[command->address];
+      if (state_ == kStopped && !breakpoint.inserted)
+        InsertBreakpoint(command->address, &breakpoint);
+      break;
+    }
+    case Command::kRemoveBreakpoint: {
+      auto it = breakpoints_.find(command->address);
+      if (it != breakpoints_.end()) {
+        UninsertBreakpoint(it->first, &it->second);
+        breakpoints_.erase(it);
+      }
+      break;
+    }
+    case Command::kReadMemory:
+      if (state_ == kStopped)
+        DoReadMemory(command->ranges, command->count);
+      reply_ready_.Set();
+      break;
+    case Command::kRequestMemory:
+      if (state_ == kStopped) {
+        DebugEvent event;
+        event.type = DebugEvent::kMemory;
+        event.address = command->address;
+        event.size = command->count;
+        event.memory.resize(command->count);
+        MemoryRange range = {
+            command->address, event.memory.data(), command->count, 0};
+        DoReadMemory(&range, 1);
+        event.memory.resize(range.bytes_read);
+        Post(event);
+      }
+      break;
+    case Command::kReadRegisters:
+      reply_result_ = state_ == kStopped &&
+                      DoReadRegisters(command->id, command->registers);
+      reply_ready_.Set();
+      break;
+    case Command::kQuit:
+      EndSession();
+      return false;
+  }
+  return true;
+}
+
+void DebuggerPtrace::DoLaunch(const Command& command) {
+  EndSession();
+
+  // Everything the child needs is made before forking, as it mustn't
+  // allocate.
+  std::vector<const char*> argv;
+  argv.push_back(command.path.c_str());
+  for (const std::string& arg : command.args)
+    argv.push_back(arg.c_str());
+  argv.push_back(NULL);
+  const char* working_directory = command.working_directory.empty()
+                                      ? NULL
+                                      : command.working_directory.c_str();
+
+  // The child waits until it's been seized before starting the program.
+  int go[2];
+  if (pipe2(go, O_CLOEXEC) != 0) {
+    PostError("Couldn't run %s: %s", command.path.c_str(), strerror(errno));
+    return;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(go[1]);
+    char byte;
+    while (read(go[0], &byte, 1) < 0 && errno == EINTR) {
+    }
+    if (working_directory && chdir(working_directory) != 0)
+      _exit(127);
+    // So that addresses are the same from one run to the next.
+    personality(ADDR_NO_RANDOMIZE);
+    execvp(argv[0], const_cast<char* const*>(argv.data()));
+    _exit(127);
+  }
+  close(go[0]);
+  if (pid < 0) {
+    close(go[1]);
+    PostError("Couldn't run %s: %s", command.path.c_str(), strerror(errno));
+    return;
+  }
+  bool seized = ptrace(PTRACE_SEIZE, pid, NULL, kTraceOptions) == 0;
+  int seize_error = errno;
+  if (!seized)
+    kill(pid, SIGKILL);
+  close(go[1]);
+
+  // The first stop is the exec, unless it failed.
+  int status;
+  while (waitpid(pid, &status, __WALL) < 0 && errno == EINTR) {
+  }
+  if (!seized || !WIFSTOPPED(status) ||
+      GetPtraceEvent(status) != PTRACE_EVENT_EXEC) {
+    if (WIFSTOPPED(status)) {
+      kill(pid, SIGKILL);
+      while (waitpid(pid, &status, __WALL) < 0 && errno == EINTR) {
+      }
+    }
+    PostError("Couldn't run %s: %s",
+              command.path.c_str(),
+              strerror(seized ? ENOEXEC : seize_error));
+    return;
+  }
+
+  pid_ = pid;
+  interrupt_pending_.Store(0);
+  process_id_.Store(pid);
+  memory_.reset(new ProcessMemory(pid));
+  attached_ = false;
+  threads_[pid].stopped = true;
+  current_thread_ = pid;
+  InsertAllBreakpoints();
+  ReportStop(DebugEvent::kEntry, 0);
+}
+
+void DebuggerPtrace::DoAttach(int pid) {
+  EndSession();
+
+  if (ptrace(PTRACE_SEIZE, pid, NULL, kTraceOptions) != 0) {
+    PostError("Couldn't attach to %d: %s", pid, strerror(errno));
+    return;
+  }
+  pid_ = pid;
+  interrupt_pending_.Store(0);
+  process_id_.Store(pid);
+  memory_.reset(new ProcessMemory(pid));
+  attached_ = true;
+  threads_[pid];
+
+  // Threads can start while this is going on, so keep looking until there
+  // aren't any new ones.
+  char task_path[64];
+  snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
+  for (bool found = true; found;) {
+    found = false;
+    DIR* dir = opendir(task_path);
+    if (!dir)
+      break;
+    while (dirent* entry = readdir(dir)) {
+      int tid = atoi(entry->d_name);
+      if (tid <= 0 || threads_.count(tid))
+        continue;
+      if (ptrace(PTRACE_SEIZE, tid, NULL, kTraceOptions) == 0) {
+        threads_[tid];
+        found = true;
+      }
+    }
+    closedir(dir);
+  }
+
+  if (!StopAll())
+    return;
+  current_thread_ = pid;
+  InsertAllBreakpoints();
+  ReportStop(DebugEvent::kAttached, 0);
+}
+
+void DebuggerPtrace::DoDetach() {
+  for (auto& it : breakpoints_)
+    UninsertBreakpoint(it.first, &it.second);
+  for (auto& it : threads_) {
+    ptrace(
+        PTRACE_DETACH, it.first, NULL, SignalData(it.second.pending_signal));
+  }
+  // A SIGSTOP from an interrupt that hasn't arrived yet would otherwise leave
+  // the process stopped.
+  if (interrupt_pending_.Load())
+    kill(pid_, SIGCONT);
+  ForgetProcess();
+  DebugEvent event;
+  event.type = DebugEvent::kExited;
+  event.message = "Detached";
+  Post(event);
+}
+
+void DebuggerPtrace::DoKill() {
+  int pid = pid_;
+  kill(pid, SIGKILL);
+  for (;;) {
+    int status;
+    int tid = waitpid(-1, &status, __WALL);
+    if (tid < 0 && errno == EINTR)
+      continue;
+    if (tid < 0 || (tid == pid && (WIFEXITED(status) || WIFSIGNALED(status)))) {
+      ProcessExited(tid == pid ? status : 0);
+      return;
+    }
+  }
+}
+
+void DebuggerPtrace::EndSession() {
+  if (state_ == kNoProcess)
+    return;
+  if (attached_)
+    DoDetach();
+  else
+    DoKill();
+}
+
+void DebuggerPtrace::OnWaitStatus(int tid, int status) {
+  if (WIFEXITED(status) || WIFSIGNALED(status)) {
+    threads_.erase(tid);
+    if (tid == pid_) {
+      ProcessExited(status);
+    } else if (tid == stepping_thread_) {
+      // The thread exited, rather than finishing the step, and everything
+      // else is still stopped.
+      stepping_thread_ = 0;
+      step_over_address_ = 0;
+      current_thread_ = threads_.empty() ? 0 : threads_.begin()->first;
+      ReportStop(DebugEvent::kPaused, 0);
+    }
+    return;
+  }
+
+  // Threads that are new to us can report their first stop before the clone
+  // event for them does.
+  ThreadState& thread = threads_[tid];
+  thread.stopped = true;
+  int signal = WSTOPSIG(status);
+  uint64_t pc;
+  switch (GetPtraceEvent(status)) {
+    case PTRACE_EVENT_CLONE: {
+      unsigned long new_tid = 0;
+      ptrace(PTRACE_GETEVENTMSG, tid, NULL, &new_tid);
+      threads_[static_cast<int>(new_tid)];
+      ResumeThread(tid, &thread);
+      return;
+    }
+    case PTRACE_EVENT_EXEC:
+      // Every other thread's gone, and so are the breakpoints.
+      threads_.clear();
+      threads_[pid_].stopped = true;
+      for (auto& it : breakpoints_)
+        it.second.inserted = false;
+      stepping_thread_ = 0;
+      step_over_address_ = 0;
+      InsertAllBreakpoints();
+      ResumeThread(pid_, &threads_[pid_]);
+      return;
+    case PTRACE_EVENT_STOP:
+      // A new thread, or an interrupt from StopAll() that was overtaken by
+      // another stop. Leave it stopped if something else is being stepped.
+      if (!stepping_thread_ || tid == stepping_thread_)
+        ResumeThread(tid, &thread);
+      return;
+    case 0:
+      break;
+    default:
+      ResumeThread(tid, &thread);
+      return;
+  }
+
+  if (signal == SIGTRAP && tid == stepping_thread_) {
+    OnStepped(tid);
+    return;
+  }
+
+  // The step hasn't happened, so put the breakpoint back for now, and take
+  // the step again when resuming.
+  if (tid == stepping_thread_) {
+    FinishStepOver();
+    stepping_thread_ = 0;
+  }
+
+  if (signal == SIGTRAP && IsBreakpointAt((pc = GetPC(tid)) - 1)) {
+    SetPC(tid, pc - 1);
+    current_thread_ = tid;
+    if (StopAll())
+      ReportStop(DebugEvent::kBreakpoint, 0);
+    return;
+  }
+
+  if (signal == SIGSTOP && interrupt_pending_.Exchange(0)) {
+    // From Send(), so stop for the commands, and then carry on as before.
+    current_thread_ = tid;
+    if (StopAll()) {
+      running_.Store(0);
+      state_ = kStopped;
+    }
+    return;
+  }
+
+  thread.pending_signal = signal;
+  current_thread_ = tid;
+  if (StopAll())
+    ReportStop(DebugEvent::kSignal, signal);
+}
+
+void DebuggerPtrace::OnStepped(int tid) {
+  FinishStepOver();
+  stepping_thread_ = 0;
+  if (resume_mode_ == kResumeAll) {
+    // That was only to get off a breakpoint.
+    for (auto& it : threads_)
+      ResumeThread(it.first, &it.second);
+    return;
+  }
+  current_thread_ = tid;
+  ReportStop(DebugEvent::kStepped, 0);
+}
+
+bool DebuggerPtrace::StopAll() {
+  int running = 0;
+  for (auto& it : threads_) {
+    if (!it.second.stopped) {
+      ptrace(PTRACE_INTERRUPT, it.first, NULL, NULL);
+      ++running;
+    }
+  }
+
+  // Anything other than the interrupt that a thread stops for first is kept,
+  // and the interrupt will come along when it's resumed instead.
+  while (running > 0) {
+    int status;
+    int tid = waitpid(-1, &status, __WALL);
+    if (tid < 0) {
+      if (errno == EINTR)
+        continue;
+      ProcessExited(0);
+      return false;
+    }
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      auto it = threads_.find(tid);
+      if (it != threads_.end() && !it->second.stopped)
+        --running;
+      threads_.erase(tid);
+      if (tid == pid_) {
+        ProcessExited(status);
+        return false;
+      }
+      continue;
+    }
+
+    ThreadState& thread = threads_[tid];
+    if (!thread.stopped)
+      --running;
+    thread.stopped = true;
+    int signal = WSTOPSIG(status);
+    int event = GetPtraceEvent(status);
+    uint64_t pc;
+    if (event == PTRACE_EVENT_CLONE) {
+      unsigned long new_tid = 0;
+      ptrace(PTRACE_GETEVENTMSG, tid, NULL, &new_tid);
+      ThreadState& new_thread = threads_[static_cast<int>(new_tid)];
+      // It stops on its own when it starts.
+      if (!new_thread.stopped)
+        ++running;
+    } else if (event != 0) {
+    } else if (signal == SIGTRAP && IsBreakpointAt((pc = GetPC(tid)) - 1)) {
+      // It'll hit the breakpoint again when it's resumed.
+      SetPC(tid, pc - 1);
+    } else if (signal == SIGSTOP && interrupt_pending_.Exchange(0)) {
+    } else {
+      thread.pending_signal = signal;
+    }
+  }
+  return true;
+}
+
+void DebuggerPtrace::Resume() {
+  // Pairs with the fence in Send().
+  running_.Store(1);
+  MemBarrier();
+  if (commands_.Wait(0)) {
+    running_.Store(0);
+    return;
+  }
+
+  int tid = resume_mode_ == kResumeStep ? step_thread_ : current_thread_;
+  auto it = threads_.find(tid);
+  if (it != threads_.end()) {
+    uint64_t pc = GetPC(tid);
+    auto breakpoint = breakpoints_.find(pc);
+    if (breakpoint != breakpoints_.end() && breakpoint->second.inserted) {
+      // Step over it with the original instruction, and then put it back.
+      UninsertBreakpoint(pc, &breakpoint->second);
+      step_over_address_ = pc;
+      stepping_thread_ = tid;
+    } else if (resume_mode_ == kResumeStep) {
+      stepping_thread_ = tid;
+    }
+  }
+
+  state_ = kRunning;
+  if (stepping_thread_) {
+    ResumeThread(stepping_thread_, &threads_[stepping_thread_]);
+  } else {
+    for (auto& it : threads_)
+      ResumeThread(it.first, &it.second);
+  }
+}
+
+void DebuggerPtrace::ResumeThread(int tid, ThreadState* thread) {
+  if (!thread->stopped)
+    return;
+  memory_->Invalidate();
+  ptrace(tid == stepping_thread_ ? PTRACE_SINGLESTEP : PTRACE_CONT,
+         tid,
+         NULL,
+         SignalData(thread->pending_signal));
+  thread->stopped = false;
+  thread->pending_signal = 0;
+}
+
+void DebuggerPtrace::ReportStop(DebugEvent::StopReason reason, int signal) {
+  running_.Store(0);
+  state_ = kStopped;
+  resume_mode_ = kStayStopped;
+  DebugEvent event;
+  event.type = DebugEvent::kStopped;
+  event.reason = reason;
+  event.thread_id = current_thread_;
+  event.address = GetPC(current_thread_);
+  event.signal = signal;
+  if (reason == DebugEvent::kEntry || reason == DebugEvent::kAttached)
+    event.entry_point = GetEntryPoint(pid_);
+  Post(event);
+}
+
+void DebuggerPtrace::ProcessExited(int status) {
+  ForgetProcess();
+  DebugEvent event;
+  event.type = DebugEvent::kExited;
+  if (WIFEXITED(status))
+    event.exit_code = WEXITSTATUS(status);
+  else if (WIFSIGNALED(status))
+    event.signal = WTERMSIG(status);
+  Post(event);
+}
+
+void DebuggerPtrace::ForgetProcess() {
+  running_.Store(0);
+  interrupt_pending_.Store(0);
+  process_id_.Store(0);
+  state_ = kNoProcess;
+  resume_mode_ = kStayStopped;
+  stepping_thread_ = 0;
+  step_over_address_ = 0;
+  current_thread_ = 0;
+  pid_ = 0;
+  attached_ = false;
+  threads_.clear();
+  memory_.reset();
+  for (auto& it : breakpoints_)
+    it.second.inserted = false;
+}
+
+bool DebuggerPtrace::InsertBreakpoint(uint64_t address,
+                                      Breakpoint* breakpoint) {
+  errno = 0;
+  long word = ptrace(PTRACE_PEEKDATA, pid_, address, NULL);
+  if (errno != 0) {
+    PostError("Couldn't set a breakpoint at 0x%llx: %s",
+              static_cast<unsigned long long>(address),
+              strerror(errno));
+    return false;
+  }
+  breakpoint->original = static_cast<uint8_t>(word & 0xff);
+  word = (word & ~0xffL) | kInt3;
+  if (ptrace(PTRACE_POKEDATA, pid_, address, word) != 0) {
+    PostError("Couldn't set a breakpoint at 0x%llx: %s",
+              static_cast<unsigned long long>(address),
+              strerror(errno));
+    return false;
+  }
+  breakpoint->inserted = true;
+  memory_->Invalidate();
+  return true;
+}
+
+void DebuggerPtrace::UninsertBreakpoint(uint64_t address,
+                                        Breakpoint* breakpoint) {
+  if (!breakpoint->inserted)
+    return;
+  breakpoint->inserted = false;
+  errno = 0;
+  long word = ptrace(PTRACE_PEEKDATA, pid_, address, NULL);
+  if (errno != 0)
+    return;
+  word = (word & ~0xffL) | breakpoint->original;
+  ptrace(PTRACE_POKEDATA, pid_, address, word);
+  memory_->Invalidate();
+}
+
+void DebuggerPtrace::InsertAllBreakpoints() {
+  for (auto& it : breakpoints_) {
+    if (!it.second.inserted)
+      InsertBreakpoint(it.first, &it.second);
+  }
+}
+
+void DebuggerPtrace::FinishStepOver() {
+  if (!step_over_address_)
+    return;
+  // Unless it was removed in the meantime.
+  auto it = breakpoints_.find(step_over_address_);
+  if (it != breakpoints_.end())
+    InsertBreakpoint(it->first, &it->second);
+  step_over_address_ = 0;
+}
+
+bool DebuggerPtrace::IsBreakpointAt(uint64_t address) const {
+  auto it = breakpoints_.find(address);
+  return it != breakpoints_.end() && it->second.inserted;
+}
+
+uint64_t DebuggerPtrace::GetPC(int tid) {
+  user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) != 0)
+    return 0;
+  return regs.rip;
+}
+
+void DebuggerPtrace::SetPC(int tid, uint64_t pc) {
+  user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) != 0)
+    return;
+  regs.rip = pc;
+  ptrace(PTRACE_SETREGS, tid, NULL, &regs);
+}
+
+void DebuggerPtrace::DoReadMemory(MemoryRange* ranges, size_t count) {
+  memory_->Read(ranges, count);
+
+  // Hide the breakpoints.
+  for (size_t i = 0; i < count; ++i) {
+    const MemoryRange& range = ranges[i];
+    uint8_t* out = static_cast<uint8_t*>(range.buffer);
+    for (auto it = breakpoints_.lower_bound(range.address);
+         it != breakpoints_.end() &&
+         it->first < range.address + range.bytes_read;
+         ++it) {
+      if (it->second.inserted)
+        out[it->first - range.address] = it->second.original;
+    }
+  }
+}
+
+bool DebuggerPtrace::DoReadRegisters(int tid, Registers* registers) {
+  if (!threads_.count(tid))
+    return false;
+  user_regs_struct regs;
+  if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) != 0)
+    return false;
+  uint64_t* values = registers->values;
+  values[Registers::kRax] = regs.rax;
+  values[Registers::kRbx] = regs.rbx;
+  values[Registers::kRcx] = regs.rcx;
+  values[Registers::kRdx] = regs.rdx;
+  values[Registers::kRsi] = regs.rsi;
+  values[Registers::kRdi] = regs.rdi;
+  values[Registers::kRbp] = regs.rbp;
+  values[Registers::kRsp] = regs.rsp;
+  values[Registers::kR8] = regs.r8;
+  values[Registers::kR9] = regs.r9;
+  values[Registers::kR10] = regs.r10;
+  values[Registers::kR11] = regs.r11;
+  values[Registers::kR12] = regs.r12;
+  values[Registers::kR13] = regs.r13;
+  values[Registers::kR14] = regs.r14;
+  values[Registers::kR15] = regs.r15;
+  values[Registers::kRip] = regs.rip;
+  values[Registers::kRflags] = regs.eflags;
+  return true;
+}
+
+void DebuggerPtrace::Post(const DebugEvent& event) {
+  while (!events_.Push(event))
+    std::this_thread::yield();
+}
+
+void DebuggerPtrace::PostError(const char* format, ...) {
+  char message[1024];
+  va_list arg_list;
+  va_start(arg_list, format);
+  Vsnprintf(message, sizeof(message), format, arg_list);
+  va_end(arg_list);
+  DebugEvent event;
+  event.type = DebugEvent::kError;
+  event.message = message;
+  Post(event);
+}
+
+}  // namespace
+
+Debugger* MakeDebugger(const std::function<void()>& wake) {
+  return new DebuggerPtrace(wake);
+}
@@ -0,0 +1,241 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "debugger.h"
+
+#include <gtest/gtest.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/auxv.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The test binary is also the process that's debugged, with this set to what
+// it should do.
+const char kInferiorVariable[] = "SG_DEBUGGER_TEST_INFERIOR";
+const int kInferiorArgument = 21;
+
+NO_INLINE int InferiorFunction(int value) {
+  return value * 2;
+}
+
+// Through a pointer, so that the call can't be inlined or specialized, and
+// this is where a breakpoint is hit.
+int (*volatile g_inferior_function)(int) = &InferiorFunction;
+
+volatile bool g_spin = true;
+
+struct RunInferior {
+  RunInferior() {
+    const char* mode = getenv(kInferiorVariable);
+    if (!mode)
+      return;
+    if (strcmp(mode, "loop") == 0) {
+      while (g_spin) {
+      }
+    }
+    _exit(g_inferior_function(kInferiorArgument));
+  }
+} g_run_inferior;
+
+std::string GetExecutablePath() {
+  char path[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (length < 0)
+    return std::string();
+  return std::string(path, length);
+}
+
+// Where |path| is loaded in |process_id|.
+uint64_t GetLoadAddress(int process_id, const std::string& path) {
+  char maps_path[64];
+  snprintf(maps_path, sizeof(maps_path), "/proc/%d/maps", process_id);
+  FILE* file = fopen(maps_path, "r");
+  if (!file)
+    return 0;
+  uint64_t result = 0;
+  char line[PATH_MAX + 128];
+  while (!result && fgets(line, sizeof(line), file)) {
+    unsigned long long start, offset;
+    char name[PATH_MAX];
+    int fields = sscanf(
+        line, "%llx-%*x %*s %llx %*s %*s %s", &start, &offset, name);
+    if (fields == 3 && offset == 0 && path == name)
+      result = start;
+  }
+  fclose(file);
+  return result;
+}
+
+class DebuggerTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    debugger_.reset(MakeDebugger([this] { ready_.Set(); }));
+    ASSERT_TRUE(debugger_);
+  }
+
+  void TearDown() override {
+    unsetenv(kInferiorVariable);
+    debugger_.reset();
+  }
+
+  DebugEvent WaitForEvent() {
+    DebugEvent event;
+    while (!debugger_->PollEvent(&event)) {
+      if (!ready_.Wait(10000)) {
+        ADD_FAILURE() << "timed out waiting for an event";
+        break;
+      }
+    }
+    return event;
+  }
+
+  // Runs this test binary, to do |mode|, and waits for it to start.
+  int LaunchInferior(const char* mode) {
+    setenv(kInferiorVariable, mode, 1);
+    debugger_->Launch(GetExecutablePath(), std::vector<std::string>(), "");
+    DebugEvent event = WaitForEvent();
+    EXPECT_EQ(DebugEvent::kStopped, event.type) << event.message;
+    EXPECT_EQ(DebugEvent::kEntry, event.reason);
+    EXPECT_TRUE(debugger_->IsStopped());
+    return event.thread_id;
+  }
+
+  std::unique_ptr<Debugger> debugger_;
+  Event ready_;
+};
+
+}  // namespace
+
+TEST_F(DebuggerTest, LaunchAndExit) {
+  debugger_->Launch("/bin/sh", {"-c", "exit 3"}, "/");
+  DebugEvent event = WaitForEvent();
+  ASSERT_EQ(DebugEvent::kStopped, event.type) << event.message;
+  EXPECT_EQ(DebugEvent::kEntry, event.reason);
+  EXPECT_NE(0, event.thread_id);
+  EXPECT_NE(0u, event.entry_point);
+
+  debugger_->Continue();
+  EXPECT_FALSE(debugger_->IsStopped());
+  event = WaitForEvent();
+  EXPECT_EQ(DebugEvent::kExited, event.type);
+  EXPECT_EQ(3, event.exit_code);
+  EXPECT_FALSE(debugger_->IsStopped());
+}
+
+TEST_F(DebuggerTest, LaunchFailure) {
+  debugger_->Launch("/nonexistent/program", std::vector<std::string>(), "");
+  DebugEvent event = WaitForEvent();
+  EXPECT_EQ(DebugEvent::kError, event.type);
+  EXPECT_FALSE(event.message.empty());
+}
+
+TEST_F(DebuggerTest, BreakpointAndStep) {
+  int process_id = LaunchInferior("exit");
+  std::string path = GetExecutablePath();
+  uint64_t our_base = GetLoadAddress(getpid(), path);
+  uint64_t inferior_base = GetLoadAddress(process_id, path);
+  ASSERT_NE(0u, our_base);
+  ASSERT_NE(0u, inferior_base);
+  uint64_t function = reinterpret_cast<uint64_t>(&InferiorFunction);
+  uint64_t breakpoint = function - our_base + inferior_base;
+
+  debugger_->AddBreakpoint(breakpoint);
+  debugger_->Continue();
+  DebugEvent event = WaitForEvent();
+  ASSERT_EQ(DebugEvent::kStopped, event.type) << event.message;
+  EXPECT_EQ(DebugEvent::kBreakpoint, event.reason);
+  EXPECT_EQ(breakpoint, event.address);
+
+  Registers registers;
+  ASSERT_TRUE(debugger_->ReadRegisters(event.thread_id, &registers));
+  EXPECT_EQ(breakpoint, registers.values[Registers::kRip]);
+  EXPECT_EQ(static_cast<uint64_t>(kInferiorArgument),
+            registers.values[Registers::kRdi]);
+
+  // The same code as ours, without the int3.
+  uint8_t code[16];
+  ASSERT_EQ(sizeof(code),
+            debugger_->ReadMemory(breakpoint, code, sizeof(code)));
+  EXPECT_EQ(0, memcmp(code, reinterpret_cast<void*>(function), sizeof(code)));
+  uint8_t unmapped;
+  EXPECT_EQ(0u, debugger_->ReadMemory(0, &unmapped, 1));
+
+  // The same again, without waiting.
+  debugger_->RequestMemory(breakpoint, sizeof(code));
+  DebugEvent memory = WaitForEvent();
+  ASSERT_EQ(DebugEvent::kMemory, memory.type);
+  EXPECT_EQ(breakpoint, memory.address);
+  EXPECT_EQ(sizeof(code), memory.size);
+  ASSERT_EQ(sizeof(code), memory.memory.size());
+  EXPECT_EQ(0, memcmp(memory.memory.data(), code, sizeof(code)));
+
+  debugger_->StepInstruction(event.thread_id);
+  event = WaitForEvent();
+  ASSERT_EQ(DebugEvent::kStopped, event.type) << event.message;
+  EXPECT_EQ(DebugEvent::kStepped, event.reason);
+  EXPECT_NE(breakpoint, event.address);
+  ASSERT_TRUE(debugger_->ReadRegisters(event.thread_id, &registers));
+  EXPECT_EQ(event.address, registers.values[Registers::kRip]);
+
+  debugger_->Continue();
+  event = WaitForEvent();
+  EXPECT_EQ(DebugEvent::kExited, event.type);
+  EXPECT_EQ(kInferiorArgument * 2, event.exit_code);
+}
+
+TEST_F(DebuggerTest, PauseAndKill) {
+  LaunchInferior("loop");
+  debugger_->Continue();
+  debugger_->Pause();
+  DebugEvent event = WaitForEvent();
+  ASSERT_EQ(DebugEvent::kStopped, event.type) << event.message;
+  EXPECT_EQ(DebugEvent::kPaused, event.reason);
+
+  // Running again, and stopped by something that isn't a pause.
+  debugger_->Continue();
+  debugger_->AddBreakpoint(0x1000);
+  debugger_->Kill();
+  event = WaitForEvent();
+  // The breakpoint can't be set.
+  EXPECT_EQ(DebugEvent::kError, event.type);
+  event = WaitForEvent();
+  EXPECT_EQ(DebugEvent::kExited, event.type);
+  EXPECT_EQ(SIGKILL, event.signal);
+}
+
+TEST_F(DebuggerTest, AttachAndDetach) {
+  pid_t child = fork();
+  if (child == 0) {
+    for (;;)
+      pause();
+  }
+  ASSERT_LT(0, child);
+
+  debugger_->Attach(child);
+  DebugEvent event = WaitForEvent();
+  ASSERT_EQ(DebugEvent::kStopped, event.type) << event.message;
+  EXPECT_EQ(DebugEvent::kAttached, event.reason);
+  EXPECT_EQ(child, event.thread_id);
+  // A fork, so it's where we are.
+  EXPECT_EQ(getauxval(AT_ENTRY), event.entry_point);
+
+  debugger_->Detach();
+  event = WaitForEvent();
+  EXPECT_EQ(DebugEvent::kExited, event.type);
+
+  // Still there, and can be waited for as usual.
+  int status;
+  EXPECT_EQ(0, waitpid(child, &status, WNOHANG));
+  kill(child, SIGKILL);
+  EXPECT_EQ(child, waitpid(child, &status, 0));
+  EXPECT_TRUE(WIFSIGNALED(status));
+}
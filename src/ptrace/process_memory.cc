@@ -0,0 +1,203 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ptrace/process_memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace {
+
+// The most iovecs that process_vm_readv() takes at once.
+const size_t kMaxIovecs = 1024;
+
+// A memory view scrolling through a big allocation shouldn't keep all of it,
+// so the cache is emptied when it gets to this many pages.
+const size_t kMaxCachedPages = 4096;
+
+}  // namespace
+
+ProcessMemory::ProcessMemory(int process_id, Method method)
+    : process_id_(process_id),
+      page_size_(static_cast<uint64_t>(sysconf(_SC_PAGESIZE))),
+      method_(method),
+      mem_fd_(-1),
+      read_calls_(0) {}
+
+ProcessMemory::~ProcessMemory() {
+  if (mem_fd_ >= 0)
+    close(mem_fd_);
+}
+
+size_t ProcessMemory::Read(uint64_t address, void* buffer, size_t size) {
+  MemoryRange range = {address, buffer, size, 0};
+  Read(&range, 1);
+  return range.bytes_read;
+}
+
+void ProcessMemory::Read(MemoryRange* ranges, size_t count) {
+  uint64_t page_mask = ~(page_size_ - 1);
+
+  // Every page that's wanted, whether it's cached or not, so that if the
+  // cache has to be emptied, they're all read again together.
+  std::vector<uint64_t> wanted;
+  for (size_t i = 0; i < count; ++i) {
+    const MemoryRange& range = ranges[i];
+    if (range.size == 0)
+      continue;
+    uint64_t last = (range.address + range.size - 1) & page_mask;
+    for (uint64_t page = range.address & page_mask;; page += page_size_) {
+      wanted.push_back(page);
+      if (page == last)
+        break;
+    }
+  }
+  std::sort(wanted.begin(), wanted.end());
+  wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+  if (pages_.size() + wanted.size() > kMaxCachedPages)
+    pages_.clear();
+  wanted.erase(std::remove_if(wanted.begin(),
+                              wanted.end(),
+                              [this](uint64_t page) {
+                                return pages_.count(page) != 0;
+                              }),
+               wanted.end());
+  if (!wanted.empty())
+    Fetch(wanted);
+
+  for (size_t i = 0; i < count; ++i) {
+    MemoryRange& range = ranges[i];
+    uint8_t* out = static_cast<uint8_t*>(range.buffer);
+    range.bytes_read = 0;
+    while (range.bytes_read < range.size) {
+      uint64_t address = range.address + range.bytes_read;
+      auto it = pages_.find(address & page_mask);
+      if (it == pages_.end() || !it->second)
+        break;
+      uint64_t offset = address - it->first;
+      size_t chunk = static_cast<size_t>(std::min<uint64_t>(
+          page_size_ - offset, range.size - range.bytes_read));
+      memcpy(out + range.bytes_read, it->second.get() + offset, chunk);
+      range.bytes_read += chunk;
+    }
+  }
+}
+
+void ProcessMemory::Invalidate() {
+  pages_.clear();
+}
+
+void ProcessMemory::Fetch(const std::vector<uint64_t>& pages) {
+  std::vector<std::unique_ptr<uint8_t[]>> data;
+  std::vector<uint8_t*> buffers;
+  for (size_t first = 0; first < pages.size();) {
+    size_t count = std::min(pages.size() - first, kMaxIovecs);
+    data.resize(count);
+    buffers.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      if (!data[i])
+        data[i].reset(new uint8_t[page_size_]);
+      buffers[i] = data[i].get();
+    }
+
+    size_t read = ReadPages(&pages[first], count, buffers.data());
+    for (size_t i = 0; i < read; ++i)
+      pages_[pages[first + i]] = std::move(data[i]);
+    if (read < count) {
+      // Carry on after the one that couldn't be read.
+      pages_[pages[first + read]].reset();
+      ++read;
+    }
+    first += read;
+  }
+}
+
+size_t ProcessMemory::ReadPages(const uint64_t* pages,
+                                size_t count,
+                                uint8_t** buffers) {
+  if (method_ == kProcessVmReadv) {
+    errno = 0;
+    size_t read = ReadPagesWithProcessVmReadv(pages, count, buffers);
+    // Either the kernel's too old, or a seccomp policy doesn't allow it, as
+    // used to be the default in containers.
+    if (read > 0 || (errno != ENOSYS && errno != EPERM))
+      return read;
+    method_ = kProcMem;
+  }
+  return ReadPagesWithProcMem(pages, count, buffers);
+}
+
+size_t ProcessMemory::ReadPagesWithProcessVmReadv(const uint64_t* pages,
+                                                  size_t count,
+                                                  uint8_t** buffers) {
+  // One iovec for each page, as the read stops at the first iovec that can't
+  // be read in full, and then it's known which page that was.
+  std::vector<iovec> local(count);
+  std::vector<iovec> remote(count);
+  for (size_t i = 0; i < count; ++i) {
+    local[i].iov_base = buffers[i];
+    local[i].iov_len = page_size_;
+    remote[i].iov_base = reinterpret_cast<void*>(pages[i]);
+    remote[i].iov_len = page_size_;
+  }
+  ++read_calls_;
+  ssize_t result = process_vm_readv(process_id_,
+                                    local.data(),
+                                    static_cast<unsigned long>(count),
+                                    remote.data(),
+                                    static_cast<unsigned long>(count),
+                                    0);
+  if (result < 0)
+    return 0;
+  return static_cast<size_t>(result / page_size_);
+}
+
+size_t ProcessMemory::ReadPagesWithProcMem(const uint64_t* pages,
+                                           size_t count,
+                                           uint8_t** buffers) {
+  if (mem_fd_ < 0) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/mem", process_id_);
+    mem_fd_ = open(path, O_RDONLY | O_CLOEXEC);
+    if (mem_fd_ < 0)
+      return 0;
+  }
+
+  // A pread() for each run of pages that are next to each other, through a
+  // temporary buffer if there's more than one.
+  std::vector<uint8_t> run_buffer;
+  size_t done = 0;
+  while (done < count) {
+    size_t run = 1;
+    while (done + run < count &&
+           pages[done + run] == pages[done] + run * page_size_)
+      ++run;
+    uint8_t* out = buffers[done];
+    if (run > 1) {
+      run_buffer.resize(run * page_size_);
+      out = run_buffer.data();
+    }
+    ++read_calls_;
+    ssize_t result = pread(mem_fd_,
+                           out,
+                           run * page_size_,
+                           static_cast<off_t>(pages[done]));
+    size_t pages_read = result > 0 ? static_cast<size_t>(result / page_size_)
+                                   : 0;
+    if (run > 1) {
+      for (size_t i = 0; i < pages_read; ++i)
+        memcpy(buffers[done + i], out + i * page_size_, page_size_);
+    }
+    done += pages_read;
+    if (pages_read < run)
+      break;
+  }
+  return done;
+}
@@ -0,0 +1,75 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PTRACE_PROCESS_MEMORY_H_
+#define PTRACE_PROCESS_MEMORY_H_
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "core.h"
+#include "debugger.h"
+
+// Reads another process's memory, a page at a time, keeping the pages until
+// Invalidate(), so that everything a frame draws from the same few pages
+// costs nothing after the first read. The pages that are missing are read
+// with one process_vm_readv() however scattered they are, or with pread()
+// from /proc/pid/mem where that's not allowed.
+//
+// The caller has to be allowed to ptrace the process, and should keep it
+// stopped, as nothing here notices it changing.
+class ProcessMemory {
+ public:
+  enum Method {
+    kProcessVmReadv,
+    kProcMem,
+  };
+
+  // |method| is what to try first. process_vm_readv() falls back to
+  // /proc/pid/mem by itself if the kernel won't do it.
+  explicit ProcessMemory(int process_id, Method method = kProcessVmReadv);
+  ~ProcessMemory();
+
+  // As Debugger::ReadMemory().
+  size_t Read(uint64_t address, void* buffer, size_t size);
+  // Fills in each range's |bytes_read|.
+  void Read(MemoryRange* ranges, size_t count);
+
+  // Forgets everything that's been read, for when the process has run.
+  void Invalidate();
+
+  Method method() const { return method_; }
+  // How many times the process has been read from, for tests and stats.
+  int read_calls() const { return read_calls_; }
+
+ private:
+  // Unreadable pages are kept too, with no data, so they aren't retried.
+  typedef std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> PageMap;
+
+  // Reads |pages|, which are sorted, and none of which are cached, into
+  // |pages_|.
+  void Fetch(const std::vector<uint64_t>& pages);
+  // Reads |count| pages into |buffers|, stopping at the first that can't be
+  // read, and returns how many were.
+  size_t ReadPages(const uint64_t* pages, size_t count, uint8_t** buffers);
+  size_t ReadPagesWithProcessVmReadv(const uint64_t* pages,
+                                     size_t count,
+                                     uint8_t** buffers);
+  size_t ReadPagesWithProcMem(const uint64_t* pages,
+                              size_t count,
+                              uint8_t** buffers);
+
+  const int process_id_;
+  const uint64_t page_size_;
+  Method method_;
+  // /proc/pid/mem, opened the first time it's needed.
+  int mem_fd_;
+  int read_calls_;
+  PageMap pages_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcessMemory);
+};
+
+#endif  // PTRACE_PROCESS_MEMORY_H_
@@ -0,0 +1,172 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ptrace/process_memory.h"
+
+#include <gtest/gtest.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace {
+
+const int kPages = 4;
+// Unmapped in the child.
+const int kHolePage = 2;
+
+uint8_t ExpectedByte(uint64_t offset) {
+  return static_cast<uint8_t>((offset * 7 + offset / 4096) ^ 0x5a);
+}
+
+// A child process that's stopped and traced by this one, with |kPages| pages
+// at base() that only it has filled in, other than |kHolePage|, which it's
+// unmapped.
+class TracedChild {
+ public:
+  TracedChild() : process_id_(-1), page_size_(sysconf(_SC_PAGESIZE)) {
+    // Mapped before forking, so it's at the same address in the child.
+    void* base = mmap(NULL,
+                      kPages * page_size_,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0);
+    base_ = base == MAP_FAILED ? NULL : static_cast<uint8_t*>(base);
+    if (!base_)
+      return;
+    process_id_ = fork();
+    if (process_id_ == 0) {
+      ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+      for (size_t i = 0; i < kPages * page_size_; ++i)
+        base_[i] = ExpectedByte(i);
+      munmap(base_ + kHolePage * page_size_, page_size_);
+      raise(SIGSTOP);
+      _exit(0);
+    }
+    int status;
+    if (process_id_ > 0 &&
+        (waitpid(process_id_, &status, 0) != process_id_ ||
+         !WIFSTOPPED(status)))
+      process_id_ = -1;
+  }
+
+  ~TracedChild() {
+    if (process_id_ > 0) {
+      kill(process_id_, SIGKILL);
+      waitpid(process_id_, NULL, 0);
+    }
+    if (base_)
+      munmap(base_, kPages * page_size_);
+  }
+
+  bool ok() const { return process_id_ > 0; }
+  int process_id() const { return process_id_; }
+  uint64_t page_size() const { return page_size_; }
+  uint64_t address(uint64_t offset) const {
+    return reinterpret_cast<uint64_t>(base_) + offset;
+  }
+
+ private:
+  int process_id_;
+  uint64_t page_size_;
+  uint8_t* base_;
+
+  DISALLOW_COPY_AND_ASSIGN(TracedChild);
+};
+
+::testing::AssertionResult IsExpected(const uint8_t* data,
+                                      uint64_t offset,
+                                      size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] != ExpectedByte(offset + i)) {
+      return ::testing::AssertionFailure() << "wrong byte at offset "
+                                           << offset + i;
+    }
+  }
+  return ::testing::AssertionSuccess();
+}
+
+void TestScatteredRead(ProcessMemory::Method method) {
+  TracedChild child;
+  ASSERT_TRUE(child.ok());
+  uint64_t page = child.page_size();
+  ProcessMemory memory(child.process_id(), method);
+
+  uint8_t a[16], b[100], d[64];
+  std::vector<uint8_t> c(page + 32);
+  MemoryRange ranges[] = {
+      // Out of order, across a page boundary, and into the hole.
+      {child.address(3 * page + 8), a, sizeof(a), 0},
+      {child.address(page - 50), b, sizeof(b), 0},
+      {child.address(page + 100), c.data(), c.size(), 0},
+      {child.address(10), d, sizeof(d), 0},
+  };
+  memory.Read(ranges, COUNTOF(ranges));
+  EXPECT_EQ(sizeof(a), ranges[0].bytes_read);
+  EXPECT_TRUE(IsExpected(a, 3 * page + 8, sizeof(a)));
+  EXPECT_EQ(sizeof(b), ranges[1].bytes_read);
+  EXPECT_TRUE(IsExpected(b, page - 50, sizeof(b)));
+  EXPECT_EQ(page - 100, ranges[2].bytes_read);
+  EXPECT_TRUE(IsExpected(c.data(), page + 100, page - 100));
+  EXPECT_EQ(sizeof(d), ranges[3].bytes_read);
+  EXPECT_TRUE(IsExpected(d, 10, sizeof(d)));
+  // There's another go after the hole, for the page after it.
+  int calls = memory.read_calls();
+  if (method == ProcessMemory::kProcessVmReadv) {
+    EXPECT_EQ(2, calls);
+  }
+
+  // All cached, including the hole.
+  memory.Read(ranges, COUNTOF(ranges));
+  EXPECT_EQ(page - 100, ranges[2].bytes_read);
+  EXPECT_EQ(calls, memory.read_calls());
+  EXPECT_EQ(0u, memory.Read(child.address(kHolePage * page), d, 1));
+  EXPECT_EQ(calls, memory.read_calls());
+}
+
+}  // namespace
+
+TEST(ProcessMemory, ScatteredReads) {
+  TestScatteredRead(ProcessMemory::kProcessVmReadv);
+}
+
+TEST(ProcessMemory, ScatteredReadsFromProcMem) {
+  TestScatteredRead(ProcessMemory::kProcMem);
+}
+
+TEST(ProcessMemory, Invalidate) {
+  TracedChild child;
+  ASSERT_TRUE(child.ok());
+  ProcessMemory memory(child.process_id());
+
+  uint64_t word;
+  ASSERT_EQ(sizeof(word), memory.Read(child.address(0), &word, sizeof(word)));
+  uint64_t changed = ~word;
+  ASSERT_EQ(0,
+            ptrace(PTRACE_POKEDATA,
+                   child.process_id(),
+                   child.address(0),
+                   changed));
+
+  // Still as it was, until told otherwise.
+  uint64_t reread;
+  memory.Read(child.address(0), &reread, sizeof(reread));
+  EXPECT_EQ(word, reread);
+  memory.Invalidate();
+  memory.Read(child.address(0), &reread, sizeof(reread));
+  EXPECT_EQ(changed, reread);
+}
+
+TEST(ProcessMemory, Unmapped) {
+  TracedChild child;
+  ASSERT_TRUE(child.ok());
+  ProcessMemory memory(child.process_id());
+  uint8_t byte;
+  EXPECT_EQ(0u, memory.Read(0, &byte, 1));
+  EXPECT_EQ(0u, memory.Read(child.address(0), &byte, 0));
+}
@@ -0,0 +1,269 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef RING_QUEUE_H_
+#define RING_QUEUE_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "core.h"
+
+// Bounded, lock-free queues for handing things to another thread, e.g.
+// debugger events and output to the UI thread.
+//
+// The consumer can either block in Wait(), or, like the UI thread, sleep
+// somewhere else, in which case it passes a |wake| function that gets it to
+// come and pop, such as glfwPostEmptyEvent(). Either way, it's only woken when
+// something is pushed to a queue that it had emptied, so a busy consumer
+// costs the producers nothing more.
+//
+// Batches are cheaper than the same number of items pushed or popped one at
+// a time, as the indices are only updated, and the consumer woken, once.
+
+inline size_t RoundUpToPowerOfTwo(size_t value) {
+  size_t result = 1;
+  while (result < value)
+    result <<= 1;
+  return result;
+}
+
+// One producer thread, and one consumer thread.
+template <typename T>
+class SpscRingQueue {
+ public:
+  // Holds up to |capacity| items, rounded up to a power of two. |wake| is
+  // called on the producer's thread, and can be empty.
+  explicit SpscRingQueue(
+      size_t capacity,
+      const std::function<void()>& wake = std::function<void()>())
+      : capacity_(RoundUpToPowerOfTwo(capacity)),
+        mask_(capacity_ - 1),
+        slots_(new T[capacity_]),
+        wake_(wake) {
+    producer_.cached_head = 0;
+    consumer_.cached_tail = 0;
+  }
+
+  // Kept on their own cache lines when made with new, too.
+  static void* operator new(size_t size) {
+    return AlignedAlloc(size, CACHE_LINE_SIZE);
+  }
+  static void operator delete(void* pointer) { AlignedFree(pointer); }
+
+  size_t capacity() const { return capacity_; }
+
+  // Producer. Returns false if the queue is full.
+  bool Push(T item) { return PushBatch(&item, 1) == 1; }
+
+  // Moves as many of |items| as there's room for, and returns how many.
+  size_t PushBatch(T* items, size_t count) {
+    size_t tail = producer_.tail.Load(std::memory_order_relaxed);
+    if (capacity_ - (tail - producer_.cached_head) < count)
+      producer_.cached_head = consumer_.head.Load(std::memory_order_acquire);
+    count = std::min(count, capacity_ - (tail - producer_.cached_head));
+    if (count == 0)
+      return 0;
+    for (size_t i = 0; i < count; ++i)
+      slots_[(tail + i) & mask_] = std::move(items[i]);
+    producer_.tail.Store(tail + count, std::memory_order_release);
+
+    // Pairs with the fence in IsEmpty(), so that either the consumer sees
+    // these, or this sees that it had taken everything before them.
+    MemBarrier();
+    if (consumer_.head.Load(std::memory_order_relaxed) == tail)
+      Notify();
+    return count;
+  }
+
+  // Consumer. Returns false if the queue is empty.
+  bool Pop(T* item) { return PopBatch(item, 1) == 1; }
+
+  // Moves up to |max_count| items into |items|, and returns how many.
+  size_t PopBatch(T* items, size_t max_count) {
+    size_t head = consumer_.head.Load(std::memory_order_relaxed);
+    if (consumer_.cached_tail - head < max_count) {
+      consumer_.cached_tail = producer_.tail.Load(std::memory_order_acquire);
+      if (consumer_.cached_tail == head && IsEmpty())
+        return 0;
+    }
+    size_t count = std::min(max_count, consumer_.cached_tail - head);
+    for (size_t i = 0; i < count; ++i)
+      items[i] = std::move(slots_[(head + i) & mask_]);
+    consumer_.head.Store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Blocks until there's something to pop, or |msecs| (if not negative) runs
+  // out, which returns false.
+  bool Wait(int32_t msecs = -1) {
+    for (;;) {
+      if (!IsEmpty())
+        return true;
+      if (!ready_.Wait(msecs))
+        return !IsEmpty();
+    }
+  }
+
+ private:
+  // Consumer only. Also brings |cached_tail| up to date.
+  bool IsEmpty() {
+    MemBarrier();
+    consumer_.cached_tail = producer_.tail.Load(std::memory_order_acquire);
+    return consumer_.cached_tail ==
+           consumer_.head.Load(std::memory_order_relaxed);
+  }
+
+  void Notify() {
+    ready_.Set();
+    if (wake_)
+      wake_();
+  }
+
+  // Each side keeps the last value it saw of the other's index, so that it
+  // only has to read the other's cache line when that's run out.
+  struct ProducerState {
+    Atomic<size_t> tail;
+    size_t cached_head;
+  };
+  struct ConsumerState {
+    Atomic<size_t> head;
+    size_t cached_tail;
+  };
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+  std::function<void()> wake_;
+  Event ready_;
+  CACHE_LINE_ALIGN(ProducerState producer_);
+  CACHE_LINE_ALIGN(ConsumerState consumer_);
+
+  DISALLOW_COPY_AND_ASSIGN(SpscRingQueue);
+};
+
+// Any number of producer threads, and one consumer thread. Producers claim
+// slots with a compare-and-swap, and then fill them in at their own pace,
+// with the consumer stopping at the first that isn't filled in yet.
+template <typename T>
+class MpscRingQueue {
+ public:
+  // As SpscRingQueue, but |wake| is called on whichever producer's thread
+  // finds the consumer waiting.
+  explicit MpscRingQueue(
+      size_t capacity,
+      const std::function<void()>& wake = std::function<void()>())
+      : capacity_(RoundUpToPowerOfTwo(capacity)),
+        mask_(capacity_ - 1),
+        slots_(new Slot[capacity_]),
+        wake_(wake) {}
+
+  static void* operator new(size_t size) {
+    return AlignedAlloc(size, CACHE_LINE_SIZE);
+  }
+  static void operator delete(void* pointer) { AlignedFree(pointer); }
+
+  size_t capacity() const { return capacity_; }
+
+  // Producers. Returns false if the queue is full.
+  bool Push(T item) { return PushBatch(&item, 1) == 1; }
+
+  // Moves as many of |items| as there's room for, and returns how many. They
+  // stay together, with nothing from other producers in between.
+  size_t PushBatch(T* items, size_t count) {
+    size_t tail = tail_.Load(std::memory_order_relaxed);
+    size_t claimed;
+    do {
+      // Everything before |head_| has been taken and its slot is free, so
+      // this only errs towards thinking the queue is fuller than it is.
+      size_t head = head_.Load(std::memory_order_acquire);
+      claimed = std::min(count, capacity_ - (tail - head));
+      if (claimed == 0)
+        return 0;
+    } while (!tail_.CompareExchange(
+        &tail, tail + claimed, std::memory_order_relaxed));
+
+    for (size_t i = 0; i < claimed; ++i) {
+      Slot& slot = slots_[(tail + i) & mask_];
+      slot.value = std::move(items[i]);
+      slot.filled.Store(tail + i + 1, std::memory_order_release);
+    }
+
+    // As SpscRingQueue::PushBatch(), but the consumer might have taken some
+    // of these already, and be waiting for the rest. If it's stopped at
+    // another producer's slot, that producer will wake it.
+    MemBarrier();
+    if (head_.Load(std::memory_order_relaxed) - tail < claimed)
+      Notify();
+    return claimed;
+  }
+
+  // Consumer. Returns false if the queue is empty.
+  bool Pop(T* item) { return PopBatch(item, 1) == 1; }
+
+  // Moves up to |max_count| items into |items|, and returns how many.
+  size_t PopBatch(T* items, size_t max_count) {
+    size_t head = head_.Load(std::memory_order_relaxed);
+    size_t count = 0;
+    while (count < max_count && IsFilled(head + count, count == 0)) {
+      items[count] = std::move(slots_[(head + count) & mask_].value);
+      ++count;
+    }
+    if (count)
+      head_.Store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // As SpscRingQueue::Wait().
+  bool Wait(int32_t msecs = -1) {
+    for (;;) {
+      size_t head = head_.Load(std::memory_order_relaxed);
+      if (IsFilled(head, true))
+        return true;
+      if (!ready_.Wait(msecs))
+        return IsFilled(head, true);
+    }
+  }
+
+ private:
+  struct Slot {
+    Slot() : filled(0) {}
+    // One past the position the slot was last filled for, so that it's
+    // different on each trip around the ring.
+    Atomic<size_t> filled;
+    T value;
+  };
+
+  // Consumer only. |before_waiting| is for when this is what decides whether
+  // the consumer waits, rather than it just stopping a batch short.
+  bool IsFilled(size_t position, bool before_waiting) {
+    Atomic<size_t>& filled = slots_[position & mask_].filled;
+    if (filled.Load(std::memory_order_acquire) == position + 1)
+      return true;
+    if (!before_waiting)
+      return false;
+    MemBarrier();
+    return filled.Load(std::memory_order_acquire) == position + 1;
+  }
+
+  void Notify() {
+    ready_.Set();
+    if (wake_)
+      wake_();
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  std::function<void()> wake_;
+  Event ready_;
+  CACHE_LINE_ALIGN(Atomic<size_t> tail_);
+  CACHE_LINE_ALIGN(Atomic<size_t> head_);
+
+  DISALLOW_COPY_AND_ASSIGN(MpscRingQueue);
+};
+
+#endif  // RING_QUEUE_H_
@@ -0,0 +1,94 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how many items a second the ring queues move from producer threads
+// to a consumer, with different batch sizes and numbers of producers.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "core.h"
+#include "ring_queue.h"
+
+namespace {
+
+const uint64_t kItemsPerProducer = 10000000;
+const size_t kCapacity = 4096;
+
+template <typename Queue>
+struct Producer {
+  Queue* queue;
+  size_t batch;
+};
+
+template <typename Queue>
+int32_t Produce(void* user_data) {
+  Producer<Queue>* producer = static_cast<Producer<Queue>*>(user_data);
+  std::vector<uint64_t> batch(producer->batch);
+  uint64_t next = 0;
+  while (next < kItemsPerProducer) {
+    size_t count = static_cast<size_t>(
+        std::min<uint64_t>(batch.size(), kItemsPerProducer - next));
+    for (size_t i = 0; i < count; ++i)
+      batch[i] = next + i;
+    size_t pushed = producer->queue->PushBatch(batch.data(), count);
+    if (pushed == 0)
+      std::this_thread::yield();
+    next += pushed;
+  }
+  return 0;
+}
+
+template <typename Queue>
+void Run(const char* name, int producer_count, size_t batch) {
+  Queue queue(kCapacity);
+  std::vector<Producer<Queue>> producers(producer_count);
+  std::vector<Thread> threads(producer_count);
+
+  int64_t start = GetHPCounter();
+  for (int i = 0; i < producer_count; ++i) {
+    producers[i].queue = &queue;
+    producers[i].batch = batch;
+    threads[i].Start(&Produce<Queue>, &producers[i], "producer");
+  }
+  uint64_t total = kItemsPerProducer * producer_count;
+  uint64_t popped = 0;
+  uint64_t checksum = 0;
+  std::vector<uint64_t> items(batch);
+  while (popped < total) {
+    queue.Wait();
+    size_t count = queue.PopBatch(items.data(), items.size());
+    for (size_t i = 0; i < count; ++i)
+      checksum += items[i];
+    popped += count;
+  }
+  for (Thread& thread : threads)
+    thread.Join();
+  int64_t end = GetHPCounter();
+
+  double seconds = static_cast<double>(end - start) / GetHPFrequency();
+  uint64_t expected =
+      kItemsPerProducer * (kItemsPerProducer - 1) / 2 * producer_count;
+  printf("%-6s producers: %d  batch: %3zu  %8.2f M items/s%s\n",
+         name,
+         producer_count,
+         batch,
+         total / seconds / 1e6,
+         checksum == expected ? "" : "  (WRONG CHECKSUM)");
+}
+
+}  // namespace
+
+int main() {
+  for (size_t batch : {1, 16, 256})
+    Run<SpscRingQueue<uint64_t>>("spsc", 1, batch);
+  for (int producers : {1, 2, 4}) {
+    for (size_t batch : {1, 16, 256})
+      Run<MpscRingQueue<uint64_t>>("mpsc", producers, batch);
+  }
+  return 0;
+}
@@ -0,0 +1,171 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ring_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int kItemsPerProducer = 100000;
+
+// Items from each producer are numbered from 0, with the producer in the top
+// bits.
+uint32_t MakeItem(uint32_t producer, uint32_t i) {
+  return producer << 24 | i;
+}
+
+template <typename Queue>
+struct Producer {
+  Queue* queue;
+  uint32_t id;
+  size_t batch;
+};
+
+template <typename Queue>
+int32_t Produce(void* user_data) {
+  Producer<Queue>* producer = static_cast<Producer<Queue>*>(user_data);
+  std::vector<uint32_t> batch;
+  uint32_t next = 0;
+  while (next < kItemsPerProducer) {
+    batch.clear();
+    for (size_t i = 0; i < producer->batch && next + i < kItemsPerProducer;
+         ++i)
+      batch.push_back(MakeItem(producer->id, next + static_cast<uint32_t>(i)));
+    size_t pushed = producer->queue->PushBatch(batch.data(), batch.size());
+    // Let the consumer catch up, as it might be on the same CPU.
+    if (pushed == 0)
+      std::this_thread::yield();
+    next += static_cast<uint32_t>(pushed);
+  }
+  return 0;
+}
+
+// Pops everything that |producer_count| producers push, checking that each
+// producer's items arrive in order. Returns the number of items.
+template <typename Queue>
+int Consume(Queue* queue, int producer_count) {
+  std::vector<uint32_t> next(producer_count, 0);
+  int total = 0;
+  uint32_t items[64];
+  while (total < producer_count * kItemsPerProducer) {
+    EXPECT_TRUE(queue->Wait(10000));
+    size_t count = queue->PopBatch(items, COUNTOF(items));
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t producer = items[i] >> 24;
+      EXPECT_LT(producer, static_cast<uint32_t>(producer_count));
+      EXPECT_EQ(MakeItem(producer, next[producer]), items[i]);
+      ++next[producer];
+    }
+    total += static_cast<int>(count);
+  }
+  return total;
+}
+
+}  // namespace
+
+TEST(SpscRingQueue, PushAndPop) {
+  SpscRingQueue<std::string> queue(3);
+  EXPECT_EQ(4u, queue.capacity());
+  std::string item;
+  EXPECT_FALSE(queue.Pop(&item));
+  EXPECT_TRUE(queue.Push("a"));
+  EXPECT_TRUE(queue.Push("b"));
+  EXPECT_TRUE(queue.Pop(&item));
+  EXPECT_EQ("a", item);
+
+  // Around the end of the ring, until full.
+  std::string batch[] = {"c", "d", "e", "f"};
+  EXPECT_EQ(3u, queue.PushBatch(batch, COUNTOF(batch)));
+  EXPECT_FALSE(queue.Push("g"));
+  std::string popped[8];
+  EXPECT_EQ(4u, queue.PopBatch(popped, COUNTOF(popped)));
+  EXPECT_EQ("b", popped[0]);
+  EXPECT_EQ("c", popped[1]);
+  EXPECT_EQ("d", popped[2]);
+  EXPECT_EQ("e", popped[3]);
+  EXPECT_EQ(0u, queue.PopBatch(popped, COUNTOF(popped)));
+}
+
+TEST(SpscRingQueue, WakesWhenNoLongerEmpty) {
+  int wakes = 0;
+  SpscRingQueue<int> queue(8, [&wakes] { ++wakes; });
+  EXPECT_FALSE(queue.Wait(0));
+  queue.Push(1);
+  EXPECT_EQ(1, wakes);
+  // Not empty, so the consumer hasn't anything to be woken for.
+  queue.Push(2);
+  EXPECT_EQ(1, wakes);
+  EXPECT_TRUE(queue.Wait(0));
+  int items[2];
+  EXPECT_EQ(2u, queue.PopBatch(items, 2));
+  queue.Push(3);
+  EXPECT_EQ(2, wakes);
+}
+
+TEST(SpscRingQueue, AcrossThreads) {
+  typedef SpscRingQueue<uint32_t> Queue;
+  for (size_t batch : {1, 7, 64}) {
+    Queue queue(256);
+    Producer<Queue> producer = {&queue, 0, batch};
+    Thread thread;
+    thread.Start(&Produce<Queue>, &producer, "producer");
+    EXPECT_EQ(kItemsPerProducer, Consume(&queue, 1));
+    thread.Join();
+    EXPECT_FALSE(queue.Wait(0));
+  }
+}
+
+TEST(MpscRingQueue, PushAndPop) {
+  MpscRingQueue<std::string> queue(4);
+  std::string item;
+  EXPECT_FALSE(queue.Pop(&item));
+  std::string batch[] = {"a", "b", "c", "d", "e"};
+  EXPECT_EQ(4u, queue.PushBatch(batch, COUNTOF(batch)));
+  EXPECT_FALSE(queue.Push("f"));
+  EXPECT_TRUE(queue.Pop(&item));
+  EXPECT_EQ("a", item);
+  EXPECT_TRUE(queue.Push("f"));
+  std::string popped[8];
+  EXPECT_EQ(4u, queue.PopBatch(popped, COUNTOF(popped)));
+  EXPECT_EQ("b", popped[0]);
+  EXPECT_EQ("f", popped[3]);
+  EXPECT_FALSE(queue.Pop(&item));
+}
+
+TEST(MpscRingQueue, WakesWhenNoLongerEmpty) {
+  int wakes = 0;
+  MpscRingQueue<int> queue(8, [&wakes] { ++wakes; });
+  queue.Push(1);
+  queue.Push(2);
+  EXPECT_EQ(1, wakes);
+  int items[2];
+  EXPECT_EQ(2u, queue.PopBatch(items, 2));
+  queue.Push(3);
+  EXPECT_EQ(2, wakes);
+}
+
+TEST(MpscRingQueue, AcrossThreads) {
+  typedef MpscRingQueue<uint32_t> Queue;
+  const int kProducers = 4;
+  for (size_t batch : {1, 7, 64}) {
+    Queue queue(256);
+    Producer<Queue> producers[kProducers];
+    Thread threads[kProducers];
+    for (int i = 0; i < kProducers; ++i) {
+      producers[i].queue = &queue;
+      producers[i].id = i;
+      producers[i].batch = batch;
+      threads[i].Start(&Produce<Queue>, &producers[i], "producer");
+    }
+    EXPECT_EQ(kProducers * kItemsPerProducer, Consume(&queue, kProducers));
+    for (Thread& thread : threads)
+      thread.Join();
+    EXPECT_FALSE(queue.Wait(0));
+  }
+}
@@ -4,21 +4,24 @@
 
 #include "source_view/lexer.h"
 
+#include <ctype.h>
+
+#include <algorithm>
+
 #include "core.h"
 #include "source_view/lexer_state.h"
 
 namespace {
 
-// Get the result of a parse from a initial and final StringPiece representing
-// the current parse locations.
-std::string GetResult(const re2::StringPiece& initial,
-                      const re2::StringPiece final) {
-  size_t length = final.data() - initial.data();
-  return std::string(initial.data(), length);
-}
-
-size_t GetOffset(const re2::StringPiece& before, const std::string& base) {
-  return before.data() - base.data();
+// Make a Token for the text between the |initial| and |final| parse locations
+// in |base|.
+Token MakeToken(const re2::StringPiece& initial,
+                const re2::StringPiece& final,
+                const char* base,
+                Lexer::TokenType type) {
+  return Token(static_cast<uint32_t>(initial.data() - base),
+               static_cast<uint32_t>(final.data() - initial.data()),
+               type);
 }
 
 }  // namespace
@@ -57,51 +60,365 @@ LexerState* Lexer::AddState(const std::string& name) {
   return lexer_state;
 }
 
-void Lexer::GetTokensUnprocessed(const std::string& text,
-                                 std::vector<Token>* output_tokens) {
+// State for lexing part of a buffer.
+struct Lexer::Run {
+  Run()
+      : offset(0),
+        line(0),
+        tokens(NULL),
+        first_token_index(0),
+        stream(NULL),
+        checkpoints(NULL),
+        converge_with(NULL),
+        converge_after(0),
+        delta(0),
+        converged(-1),
+        stop_after(std::numeric_limits<size_t>::max()),
+        reached_end(false) {}
+
+  // Where to start lexing, and the state to start in. |line| is updated as
+  // lexing proceeds.
+  size_t offset;
   std::vector<LexerState*> state_stack;
-  CHECK(states_.find("root") != states_.end(), "expected root");
-  state_stack.push_back(states_["root"]);
+  uint32_t line;
+
+  // Tokens are appended to |tokens|. |first_token_index| is the index that
+  // the first of them will have in the full token stream.
+  std::vector<Token>* tokens;
+  uint32_t first_token_index;
+
+  // If non-NULL, a checkpoint is appended to |checkpoints| at each line start,
+  // with state stacks interned in |stream|.
+  TokenStream* stream;
+  std::vector<TokenStream::Checkpoint>* checkpoints;
+
+  // If non-NULL, lexing stops at a line start at or after |converge_after|
+  // that is in the same state as a checkpoint in |converge_with| that is
+  // |delta| bytes earlier. The index of that checkpoint is stored in
+  // |converged|, otherwise it's -1 when lexing reaches the end of the text.
+  const std::vector<TokenStream::Checkpoint>* converge_with;
+  size_t converge_after;
+  int64_t delta;
+  ptrdiff_t converged;
+
+  // Otherwise, lexing stops once a checkpoint has been recorded at a line start
+  // at or after |stop_after|, or sets |reached_end| at the end of the text.
+  size_t stop_after;
+  bool reached_end;
+};
+
+namespace {
+
+const uint32_t kNoStateStack = std::numeric_limits<uint32_t>::max();
+
+void CheckLength(size_t text_length) {
+  // RE2 lengths are ints, which also keeps offsets within Token's uint32_t.
+  CHECK(text_length <= static_cast<size_t>(std::numeric_limits<int>::max()),
+        "input too large");
+}
+
+bool IsNotSpace(char c) {
+  return !isspace(static_cast<unsigned char>(c));
+}
+
+size_t CountLines(uint32_t newlines, const char* text, size_t text_length) {
+  bool partial_last_line = text_length > 0 && text[text_length - 1] != '\n';
+  return newlines + (partial_last_line ? 1 : 0);
+}
+
+}  // namespace
+
+LexerState* Lexer::GetRootState() {
+  std::map<std::string, LexerState*>::iterator root = states_.find("root");
+  CHECK(root != states_.end(), "expected root");
+  return root->second;
+}
+
+void Lexer::GetTokensUnprocessed(const char* text,
+                                 size_t text_length,
+                                 std::vector<Token>* output_tokens) {
+  CheckLength(text_length);
+  Run run;
+  run.state_stack.push_back(GetRootState());
+  run.tokens = output_tokens;
+  LexRun(text, text_length, &run);
+}
+
+void Lexer::Lex(const char* text, size_t text_length, TokenStream* stream) {
+  stream->Clear();
+  LexUntil(text, text_length, text_length, stream);
+}
+
+void Lexer::LexUntil(const char* text,
+                     size_t text_length,
+                     size_t offset,
+                     TokenStream* stream) {
+  CheckLength(text_length);
+  std::vector<TokenStream::Checkpoint>& checkpoints = stream->checkpoints_;
+  if (stream->complete_ ||
+      (!checkpoints.empty() && offset <= stream->lexed_length_))
+    return;
 
-  re2::StringPiece input(text);
+  Run run;
+  if (checkpoints.empty()) {
+    run.state_stack.push_back(GetRootState());
+  } else {
+    // Resume from the checkpoint where the last run stopped, which LexRun()
+    // records again.
+    const TokenStream::Checkpoint& resume = checkpoints.back();
+    DCHECK(resume.token_index == stream->tokens_.size());
+    run.offset = resume.offset;
+    run.line = resume.line;
+    run.state_stack = stream->state_stacks_[resume.state_stack];
+    checkpoints.pop_back();
+  }
+  // Tokens are appended straight to the stream, so |first_token_index| stays
+  // 0 for the checkpoints' token indices to come out right.
+  run.tokens = &stream->tokens_;
+  run.stream = stream;
+  run.checkpoints = &checkpoints;
+  run.stop_after = offset;
+  LexRun(text, text_length, &run);
+  stream->complete_ = run.reached_end;
+  stream->lexed_length_ =
+      run.reached_end ? text_length : checkpoints.back().offset;
+  stream->line_count_ =
+      run.reached_end ? CountLines(run.line, text, text_length) : run.line;
+}
+
+void Lexer::Relex(const char* text,
+                  size_t text_length,
+                  size_t change_start,
+                  size_t old_change_end,
+                  size_t new_change_end,
+                  TokenStream* stream,
+                  TokenStreamChange* change) {
+  CheckLength(text_length);
+  DCHECK(change_start <= old_change_end && change_start <= new_change_end);
+  DCHECK(new_change_end <= text_length);
+  std::vector<TokenStream::Checkpoint>& checkpoints = stream->checkpoints_;
+  auto checkpoint_before = [](const TokenStream::Checkpoint& checkpoint,
+                              size_t offset) {
+    return checkpoint.offset < offset;
+  };
+
+  // Restart before the line containing the change. Patterns can scan past the
+  // end of the token they produce before failing, e.g. "^\\s*#endif" skips
+  // newlines and blank lines, and that determined which token was chosen for
+  // the line before. So back up at least one more line, and over any blank
+  // ones, to keep that lookahead in unchanged text.
+  std::vector<TokenStream::Checkpoint>::iterator restart = std::lower_bound(
+      checkpoints.begin(), checkpoints.end(), change_start, checkpoint_before);
+  if (restart != checkpoints.begin())
+    --restart;
+  while (restart != checkpoints.begin()) {
+    --restart;
+    const char* line_end = text + (restart + 1)->offset;
+    if (std::find_if(text + restart->offset, line_end, IsNotSpace) != line_end)
+      break;
+  }
+  Run run;
+  if (restart == checkpoints.end()) {
+    run.state_stack.push_back(GetRootState());
+  } else {
+    run.offset = restart->offset;
+    run.line = restart->line;
+    run.first_token_index = restart->token_index;
+    run.state_stack = stream->state_stacks_[restart->state_stack];
+  }
+  std::vector<Token> tokens;
+  std::vector<TokenStream::Checkpoint> new_checkpoints;
+  run.tokens = &tokens;
+  run.stream = stream;
+  run.checkpoints = &new_checkpoints;
+  run.converge_with = &checkpoints;
+  run.converge_after = new_change_end;
+  run.delta = static_cast<int64_t>(new_change_end) -
+              static_cast<int64_t>(old_change_end);
+  if (!stream->complete_) {
+    // Only relex what had been lexed, and up to the change if that was beyond
+    // it; LexUntil() will get to the rest.
+    if (old_change_end <= stream->lexed_length_)
+      run.stop_after = stream->lexed_length_ + run.delta;
+    else
+      run.stop_after = std::min(change_start, stream->lexed_length_);
+  }
+  size_t first_checkpoint = restart - checkpoints.begin();
+  change->first_token = run.first_token_index;
+  change->first_line = run.line;
+  LexRun(text, text_length, &run);
+
+  change->new_token_end = change->first_token + tokens.size();
+  change->new_line_end = run.line;
+  size_t last_checkpoint = checkpoints.size();
+  if (run.converged >= 0) {
+    // Everything from here on is the same as before, just moved.
+    last_checkpoint = run.converged;
+    const TokenStream::Checkpoint& at = checkpoints[last_checkpoint];
+    change->old_token_end = at.token_index;
+    change->old_line_end = at.line;
+    for (size_t i = at.token_index; i < stream->tokens_.size(); ++i)
+      stream->tokens_[i].offset = static_cast<uint32_t>(
+          stream->tokens_[i].offset + run.delta);
+    int64_t line_delta = static_cast<int64_t>(change->new_line_end) -
+                         static_cast<int64_t>(change->old_line_end);
+    int64_t token_delta = static_cast<int64_t>(change->new_token_end) -
+                          static_cast<int64_t>(change->old_token_end);
+    for (size_t i = last_checkpoint; i < checkpoints.size(); ++i) {
+      checkpoints[i].offset =
+          static_cast<uint32_t>(checkpoints[i].offset + run.delta);
+      checkpoints[i].line = static_cast<uint32_t>(checkpoints[i].line +
+                                                  line_delta);
+      checkpoints[i].token_index =
+          static_cast<uint32_t>(checkpoints[i].token_index + token_delta);
+    }
+    stream->line_count_ += line_delta;
+  } else {
+    change->old_token_end = stream->tokens_.size();
+    change->old_line_end = stream->line_count_;
+    stream->complete_ = run.reached_end;
+    if (run.reached_end)
+      stream->line_count_ = CountLines(run.line, text, text_length);
+    else
+      stream->line_count_ = run.line;
+    change->new_line_end = stream->line_count_;
+  }
+
+  std::vector<Token>& all_tokens = stream->tokens_;
+  all_tokens.erase(all_tokens.begin() + change->first_token,
+                   all_tokens.begin() + change->old_token_end);
+  all_tokens.insert(all_tokens.begin() + change->first_token,
+                    tokens.begin(),
+                    tokens.end());
+  checkpoints.erase(checkpoints.begin() + first_checkpoint,
+                    checkpoints.begin() + last_checkpoint);
+  checkpoints.insert(checkpoints.begin() + first_checkpoint,
+                     new_checkpoints.begin(),
+                     new_checkpoints.end());
+  stream->lexed_length_ =
+      stream->complete_ ? text_length : checkpoints.back().offset;
+}
+
+void Lexer::LexRun(const char* text, size_t text_length, Run* run) {
+  std::vector<LexerState*>& state_stack = run->state_stack;
+  auto checkpoint_before = [](const TokenStream::Checkpoint& checkpoint,
+                              size_t offset) {
+    return checkpoint.offset < offset;
+  };
+  uint32_t state_stack_id = kNoStateStack;
+  size_t last_checkpoint_offset = std::numeric_limits<size_t>::max();
+  size_t start_offset = run->offset;
+
+  re2::StringPiece input(text + run->offset,
+                         static_cast<int>(text_length - run->offset));
+  std::vector<int> candidates;
   for (;;) {
-    LexerState* current_state = state_stack.back();
-    size_t token_defs_count;
-    const LexerState::TokenDef* token_defs =
-        current_state->GetTokenDefs(&token_defs_count);
-    size_t i;
-    for (i = 0; i < token_defs_count; ++i) {
-      re2::StringPiece from = input;
-      const LexerState::TokenDef* token_def = &token_defs[i];
-      if (RE2::Consume(&input, *token_def->regex)) {
-        output_tokens->push_back(Token(
-            GetOffset(from, text), token_def->action, GetResult(from, input)));
-        if (token_def->new_state) {
-          if (token_def->new_state == Push) {
-            state_stack.push_back(current_state);
-          } else if (token_def->new_state == Pop) {
-            state_stack.pop_back();
-          } else {
-            // TODO(scottmg): state tuple, if needed.
-            state_stack.push_back(token_def->new_state);
-          }
+    size_t offset = input.data() - text;
+    if (run->checkpoints && offset != last_checkpoint_offset &&
+        (offset == 0 || text[offset - 1] == '\n')) {
+      if (state_stack_id == kNoStateStack)
+        state_stack_id = run->stream->InternStateStack(state_stack);
+      TokenStream::Checkpoint checkpoint;
+      checkpoint.offset = static_cast<uint32_t>(offset);
+      checkpoint.line = run->line;
+      checkpoint.token_index =
+          static_cast<uint32_t>(run->first_token_index + run->tokens->size());
+      checkpoint.state_stack = state_stack_id;
+      if (run->converge_with && offset >= run->converge_after) {
+        std::vector<TokenStream::Checkpoint>::const_iterator old =
+            std::lower_bound(run->converge_with->begin(),
+                             run->converge_with->end(),
+                             static_cast<size_t>(offset - run->delta),
+                             checkpoint_before);
+        if (old != run->converge_with->end() &&
+            old->offset == offset - run->delta &&
+            old->state_stack == state_stack_id) {
+          run->converged = old - run->converge_with->begin();
+          return;
         }
-        break;
       }
+      run->checkpoints->push_back(checkpoint);
+      last_checkpoint_offset = offset;
+      if (offset >= run->stop_after && offset > start_offset &&
+          offset < text_length)
+        return;
     }
-    if (i == token_defs_count) {
-      if (input.empty())
+
+    LexerState* current_state = state_stack.back();
+    re2::StringPiece from = input;
+    const LexerState::TokenDef* token_def =
+        current_state->Match(&input, &candidates);
+    if (token_def) {
+      run->tokens->push_back(MakeToken(from, input, text, token_def->action));
+      run->line += static_cast<uint32_t>(
+          std::count(from.data(), input.data(), '\n'));
+      if (token_def->new_state) {
+        state_stack_id = kNoStateStack;
+        if (token_def->new_state == Push) {
+          state_stack.push_back(current_state);
+        } else if (token_def->new_state == Pop) {
+          state_stack.pop_back();
+        } else {
+          // TODO(scottmg): state tuple, if needed.
+          state_stack.push_back(token_def->new_state);
+        }
+      }
+    } else {
+      if (input.empty()) {
+        run->reached_end = true;
         break;
+      }
       // No match, if at EOL, reset to root state.
       if (input[0] == '\n') {
         CHECK(false, "todo; untested");
+        state_stack_id = kNoStateStack;
         state_stack.clear();
-        state_stack.push_back(states_["root"]);
-        output_tokens->push_back(Token(GetOffset(input, text), Text, "\n"));
-        input = re2::StringPiece(input.data() + 1, input.size() - 1);
+        state_stack.push_back(GetRootState());
+        input.remove_prefix(1);
+        run->tokens->push_back(MakeToken(from, input, text, Text));
+        ++run->line;
       } else {
         CHECK(false, "todo; untested, should add Error token");
       }
     }
   }
 }
+
+void TokenStream::Clear() {
+  tokens_.clear();
+  checkpoints_.clear();
+  state_stacks_.clear();
+  lexed_length_ = 0;
+  line_count_ = 0;
+  complete_ = false;
+}
+
+uint32_t TokenStream::InternStateStack(
+    const std::vector<LexerState*>& state_stack) {
+  for (size_t i = 0; i < state_stacks_.size(); ++i) {
+    if (state_stacks_[i] == state_stack)
+      return static_cast<uint32_t>(i);
+  }
+  state_stacks_.push_back(state_stack);
+  return static_cast<uint32_t>(state_stacks_.size() - 1);
+}
+
+void FindChangedRange(const char* old_text,
+                      size_t old_length,
+                      const char* new_text,
+                      size_t new_length,
+                      size_t* change_start,
+                      size_t* old_change_end,
+                      size_t* new_change_end) {
+  size_t common = std::min(old_length, new_length);
+  size_t prefix = 0;
+  while (prefix < common && old_text[prefix] == new_text[prefix])
+    ++prefix;
+  size_t suffix = 0;
+  while (suffix < common - prefix &&
+         old_text[old_length - suffix - 1] == new_text[new_length - suffix - 1])
+    ++suffix;
+  *change_start = prefix;
+  *old_change_end = old_length - suffix;
+  *new_change_end = new_length - suffix;
+}
@@ -14,6 +14,8 @@
 
 class LexerState;
 class Token;
+class TokenStream;
+struct TokenStreamChange;
 
 // This module (regex, input, parsed tokens) works entirely in utf8, even on
 // Windows, because that's what RE2 processes.
@@ -27,8 +29,49 @@ class Lexer {
   explicit Lexer(const std::string& name);
   ~Lexer();
   LexerState* AddState(const std::string& name);
-  void GetTokensUnprocessed(const std::string& text,
+
+  // Tokens refer to |text| by offset, so the caller must keep it alive for as
+  // long as it wants to get at the tokens' text.
+  void GetTokensUnprocessed(const char* text,
+                            size_t text_length,
                             std::vector<Token>* output_tokens);
+  void GetTokensUnprocessed(const std::string& text,
+                            std::vector<Token>* output_tokens) {
+    GetTokensUnprocessed(text.data(), text.size(), output_tokens);
+  }
+
+  // Lexes all of |text| into |stream|, also recording the lexer state at the
+  // start of each line so that Relex() can restart from there later.
+  void Lex(const char* text, size_t text_length, TokenStream* stream);
+
+  // Continues lexing |text| into |stream| from where it last stopped (or from
+  // the start, for an empty stream) until at least |offset| is covered,
+  // stopping at the next line start. This lets a view lex only as far as it is
+  // displaying rather than the whole buffer up front.
+  void LexUntil(const char* text,
+                size_t text_length,
+                size_t offset,
+                TokenStream* stream);
+
+  // Updates |stream|, which was made by Lex() from an older version of |text|,
+  // where [change_start, old_change_end) of the old text has since been
+  // replaced by [change_start, new_change_end) of |text|. Lexing restarts a
+  // line or so before the change, and stops at the first line start after the
+  // change where the lexer is in the same state as it was for the old text.
+  // The tokens and lines that were replaced are returned in |change|. If
+  // |stream| is only partly lexed, this doesn't lex beyond the part that was.
+  //
+  // This assumes that choosing a token doesn't depend on text more than a
+  // line, plus any blank lines, past where it starts. Patterns that only fail
+  // after scanning further than that (e.g. an unterminated block comment) can
+  // leave tokens before the restart point stale.
+  void Relex(const char* text,
+             size_t text_length,
+             size_t change_start,
+             size_t old_change_end,
+             size_t new_change_end,
+             TokenStream* stream,
+             TokenStreamChange* change);
 
   enum TokenType {
     Comment,
@@ -66,22 +109,114 @@ class Lexer {
 #endif
 
  private:
+  struct Run;
+  LexerState* GetRootState();
+  void LexRun(const char* text, size_t text_length, Run* run);
+
   std::string name_;
   std::map<std::string, LexerState*> states_;
 
   DISALLOW_COPY_AND_ASSIGN(Lexer);
 };
 
+// A range of the lexed buffer, which is owned by the caller of
+// GetTokensUnprocessed(). Deliberately small and without a copy of the text,
+// as there are a lot of these for a big file.
 class Token {
  public:
-  Token() : index(std::numeric_limits<size_t>::max()), token(Lexer::Invalid) {}
+  Token()
+      : offset(std::numeric_limits<uint32_t>::max()),
+        length(0),
+        token(Lexer::Invalid) {}
 
-  Token(size_t index, Lexer::TokenType token, const std::string& value)
-      : index(index), token(token), value(value) {}
+  Token(uint32_t offset, uint32_t length, Lexer::TokenType token)
+      : offset(offset), length(length), token(token) {}
 
-  size_t index;
+  // |text| is the buffer that was passed to GetTokensUnprocessed().
+  const char* begin(const char* text) const { return text + offset; }
+  const char* end(const char* text) const { return text + offset + length; }
+  std::string GetText(const char* text) const {
+    return std::string(begin(text), length);
+  }
+  std::string GetText(const std::string& text) const {
+    return GetText(text.data());
+  }
+
+  uint32_t offset;
+  uint32_t length;
   Lexer::TokenType token;
-  std::string value;
 };
 
+// The tokens for a buffer, along with the lexer state at the start of each
+// line, so that Lexer::Relex() can update them when the buffer changes without
+// lexing all of it again.
+class TokenStream {
+ public:
+  TokenStream() : lexed_length_(0), line_count_(0), complete_(false) {}
+
+  void Clear();
+
+  const std::vector<Token>& tokens() const { return tokens_; }
+
+  // How much of the buffer has been lexed, always up to a line start unless
+  // the whole buffer has been.
+  size_t lexed_length() const { return lexed_length_; }
+  bool complete() const { return complete_; }
+
+  // The number of lines in the buffer, where a trailing newline does not
+  // start another line. Only lines before lexed_length() are counted until
+  // the stream is complete.
+  size_t line_count() const { return line_count_; }
+
+ private:
+  friend class Lexer;
+
+  struct Checkpoint {
+    // The start of a line, which is also the start of a token.
+    uint32_t offset;
+    uint32_t line;
+    // The index of the token starting at |offset|.
+    uint32_t token_index;
+    // Index into |state_stacks_|.
+    uint32_t state_stack;
+  };
+
+  uint32_t InternStateStack(const std::vector<LexerState*>& state_stack);
+
+  std::vector<Token> tokens_;
+  std::vector<Checkpoint> checkpoints_;
+  // There are only ever a handful of distinct stacks, so checkpoints refer to
+  // them by index rather than each holding a copy.
+  std::vector<std::vector<LexerState*>> state_stacks_;
+  size_t lexed_length_;
+  size_t line_count_;
+  bool complete_;
+
+  DISALLOW_COPY_AND_ASSIGN(TokenStream);
+};
+
+// What Lexer::Relex() replaced in a TokenStream.
+struct TokenStreamChange {
+  // Tokens [first_token, old_token_end) became [first_token, new_token_end).
+  size_t first_token;
+  size_t old_token_end;
+  size_t new_token_end;
+
+  // Likewise for lines.
+  size_t first_line;
+  size_t old_line_end;
+  size_t new_line_end;
+};
+
+// Finds the smallest range that differs between |old_text| and |new_text|, in
+// the form that Lexer::Relex() wants. If the texts are identical, the range is
+// empty and at the end.
+void FindChangedRange(const char* old_text,
+                      size_t old_length,
+                      const char* new_text,
+                      size_t new_length,
+                      size_t* change_start,
+                      size_t* old_change_end,
+                      size_t* new_change_end);
+
 #endif  // SOURCE_VIEW_LEXER_H_
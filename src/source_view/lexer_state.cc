@@ -4,6 +4,9 @@
 
 #include "source_view/lexer_state.h"
 
+#include <algorithm>
+#include <memory>
+
 void TokenDefinitions::Add(const std::string& regex,
                            Lexer::TokenType token_type) {
   token_data_.push_back(TokenData(regex, token_type, NULL));
@@ -16,7 +19,11 @@ void TokenDefinitions::AddWithTransition(const std::string& regex,
 }
 
 LexerState::LexerState(const std::string& name)
-    : token_defs_(NULL), token_defs_count_(0), name_(name) {
+    : token_defs_(NULL),
+      token_defs_count_(0),
+      combined_regex_(NULL),
+      combined_set_(NULL),
+      name_(name) {
 }
 
 LexerState::~LexerState() {
@@ -24,6 +31,8 @@ LexerState::~LexerState() {
     delete token_defs_[i].regex;
   }
   delete[] token_defs_;
+  delete combined_regex_;
+  delete combined_set_;
 }
 
 void LexerState::SetTokenDefinitions(const TokenDefinitions& tokens) {
@@ -35,9 +44,61 @@ void LexerState::SetTokenDefinitions(const TokenDefinitions& tokens) {
     token_defs_[i].action = tokens.token_data_[i].action;
     token_defs_[i].new_state = tokens.token_data_[i].new_state;
   }
+
+  // If anything fails to build, Match() tries the definitions one at a time.
+  std::string combined;
+  std::unique_ptr<re2::RE2::Set> set(
+      new re2::RE2::Set(options, re2::RE2::ANCHOR_BOTH));
+  for (size_t i = 0; i < token_defs_count_; ++i) {
+    if (!token_defs_[i].regex->ok() ||
+        set->Add(tokens.token_data_[i].regex, NULL) != static_cast<int>(i)) {
+      return;
+    }
+    if (i > 0)
+      combined += "|";
+    combined += "(?:" + tokens.token_data_[i].regex + ")";
+  }
+  if (token_defs_count_ == 0 || !set->Compile())
+    return;
+  std::unique_ptr<re2::RE2> regex(new re2::RE2(combined, options));
+  if (!regex->ok())
+    return;
+  combined_regex_ = regex.release();
+  combined_set_ = set.release();
 }
 
-const LexerState::TokenDef* LexerState::GetTokenDefs(size_t* count) const {
-  *count = token_defs_count_;
-  return token_defs_;
+const LexerState::TokenDef* LexerState::Match(
+    re2::StringPiece* input,
+    std::vector<int>* candidates) const {
+  if (combined_regex_) {
+    re2::StringPiece match;
+    if (!combined_regex_->Match(*input,
+                                0,
+                                static_cast<int>(input->size()),
+                                re2::RE2::ANCHOR_START,
+                                &match,
+                                1)) {
+      return NULL;
+    }
+    int length = static_cast<int>(match.size());
+    // The set only sees the matched text, so assertions at its end (\b, $)
+    // are confirmed against the real following input before accepting.
+    if (combined_set_->Match(match, candidates)) {
+      std::sort(candidates->begin(), candidates->end());
+      for (int index : *candidates) {
+        const TokenDef* token_def = &token_defs_[index];
+        if (token_def->regex->Match(
+                *input, 0, length, re2::RE2::ANCHOR_BOTH, NULL, 0)) {
+          input->remove_prefix(length);
+          return token_def;
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < token_defs_count_; ++i) {
+    if (RE2::Consume(input, *token_defs_[i].regex))
+      return &token_defs_[i];
+  }
+  return NULL;
 }
@@ -10,6 +10,7 @@
 
 #include "core.h"
 #include "re2/re2.h"
+#include "re2/set.h"
 #include "source_view/lexer.h"
 
 class TokenDefinitions {
@@ -54,7 +55,22 @@ class LexerState {
   TokenDef* token_defs_;
   size_t token_defs_count_;
 
-  const TokenDef* GetTokenDefs(size_t* count) const;
+  // All of the token regexes joined into a single alternation. RE2's
+  // leftmost-first semantics prefer earlier alternatives, so one DFA scan with
+  // this finds the extent of the match that trying each regex in turn would
+  // have produced.
+  re2::RE2* combined_regex_;
+  // The same regexes, anchored at both ends. Matching this against exactly the
+  // extent found by |combined_regex_| yields which definitions could have
+  // produced it; the lowest index among those is the one that matched.
+  re2::RE2::Set* combined_set_;
+
+  // Finds the highest priority definition that matches at the start of
+  // |input|, and advances |input| past the match. |candidates| is scratch
+  // space, to avoid reallocating for each token. Returns NULL if no
+  // definition matches.
+  const TokenDef* Match(re2::StringPiece* input,
+                        std::vector<int>* candidates) const;
 
   std::string name_;
 
@@ -6,6 +6,7 @@
 
 #include <gtest/gtest.h>
 
+#include <string.h>
 #include <memory>
 
 #include "source_view/cpp_lexer.h"
@@ -21,30 +22,31 @@ TEST(Lexer, Basic) {
   defs.Add("c", Lexer::KeywordPseudo);
   root->SetTokenDefinitions(defs);
 
+  const char kInput[] = "ababc";
   std::vector<Token> tokens;
-  lexer->GetTokensUnprocessed("ababc", &tokens);
+  lexer->GetTokensUnprocessed(kInput, strlen(kInput), &tokens);
 
-  EXPECT_EQ(5, tokens.size());
+  EXPECT_EQ(5u, tokens.size());
 
-  EXPECT_EQ(0, tokens[0].index);
+  EXPECT_EQ(0u, tokens[0].offset);
   EXPECT_EQ(Lexer::Keyword, tokens[0].token);
-  EXPECT_EQ("a", tokens[0].value);
+  EXPECT_EQ("a", tokens[0].GetText(kInput));
 
-  EXPECT_EQ(1, tokens[1].index);
+  EXPECT_EQ(1u, tokens[1].offset);
   EXPECT_EQ(Lexer::KeywordConstant, tokens[1].token);
-  EXPECT_EQ("b", tokens[1].value);
+  EXPECT_EQ("b", tokens[1].GetText(kInput));
 
-  EXPECT_EQ(2, tokens[2].index);
+  EXPECT_EQ(2u, tokens[2].offset);
   EXPECT_EQ(Lexer::Keyword, tokens[2].token);
-  EXPECT_EQ("a", tokens[2].value);
+  EXPECT_EQ("a", tokens[2].GetText(kInput));
 
-  EXPECT_EQ(3, tokens[3].index);
+  EXPECT_EQ(3u, tokens[3].offset);
   EXPECT_EQ(Lexer::KeywordConstant, tokens[3].token);
-  EXPECT_EQ("b", tokens[3].value);
+  EXPECT_EQ("b", tokens[3].GetText(kInput));
 
-  EXPECT_EQ(4, tokens[4].index);
+  EXPECT_EQ(4u, tokens[4].offset);
   EXPECT_EQ(Lexer::KeywordPseudo, tokens[4].token);
-  EXPECT_EQ("c", tokens[4].value);
+  EXPECT_EQ("c", tokens[4].GetText(kInput));
 }
 
 TEST(Lexer, IniFile) {
@@ -61,7 +63,7 @@ TEST(Lexer, IniFile) {
   std::vector<Token> tokens;
   lexer->GetTokensUnprocessed("[wee]\n; stuff\n# things\n    \n", &tokens);
 
-  EXPECT_EQ(6, tokens.size());
+  EXPECT_EQ(6u, tokens.size());
   // TODO(scottmg): More detailed expectations.
 }
 
@@ -70,19 +72,19 @@ TEST(Lexer, BasicCpp) {
 
   std::vector<Token> tokens;
   lexer->GetTokensUnprocessed("int foo;", &tokens);
-  EXPECT_EQ(4, tokens.size());
+  EXPECT_EQ(4u, tokens.size());
 
   EXPECT_EQ(Lexer::KeywordType, tokens[0].token);
-  EXPECT_EQ(0, tokens[0].index);
+  EXPECT_EQ(0u, tokens[0].offset);
 
   EXPECT_EQ(Lexer::Text, tokens[1].token);
-  EXPECT_EQ(3, tokens[1].index);
+  EXPECT_EQ(3u, tokens[1].offset);
 
   EXPECT_EQ(Lexer::Name, tokens[2].token);
-  EXPECT_EQ(4, tokens[2].index);
+  EXPECT_EQ(4u, tokens[2].offset);
 
   EXPECT_EQ(Lexer::Punctuation, tokens[3].token);
-  EXPECT_EQ(7, tokens[3].index);
+  EXPECT_EQ(7u, tokens[3].offset);
 }
 
 TEST(Lexer, CppIf0) {
@@ -91,7 +93,7 @@ TEST(Lexer, CppIf0) {
   std::vector<Token> tokens;
   lexer->GetTokensUnprocessed("#if 0\nthis is some stuff\n#endif\n", &tokens);
 
-  EXPECT_EQ(3, tokens.size());
+  EXPECT_EQ(3u, tokens.size());
   EXPECT_EQ(Lexer::CommentPreproc, tokens[0].token);
   EXPECT_EQ(Lexer::Comment, tokens[1].token);
   EXPECT_EQ(Lexer::CommentPreproc, tokens[2].token);
@@ -104,7 +106,7 @@ TEST(Lexer, CppNumbers) {
   lexer->GetTokensUnprocessed("42 23.42 23. .42 023 0xdeadbeef 23e+42 42e-23",
                               &tokens);
 
-  EXPECT_EQ(15, tokens.size());
+  EXPECT_EQ(15u, tokens.size());
   EXPECT_EQ(Lexer::LiteralNumberInteger, tokens[0].token);
   EXPECT_EQ(Lexer::LiteralNumberFloat, tokens[2].token);
   EXPECT_EQ(Lexer::LiteralNumberFloat, tokens[4].token);
@@ -114,3 +116,219 @@ TEST(Lexer, CppNumbers) {
   EXPECT_EQ(Lexer::LiteralNumberFloat, tokens[12].token);
   EXPECT_EQ(Lexer::LiteralNumberFloat, tokens[14].token);
 }
+
+TEST(Lexer, FirstDefinitionWins) {
+  std::unique_ptr<Lexer> lexer(new Lexer("priority"));
+  LexerState* root = lexer->AddState("root");
+
+  // Earlier definitions take priority even when a later one would match a
+  // longer run of the input.
+  TokenDefinitions defs;
+  defs.Add("ab", Lexer::Keyword);
+  defs.Add("a", Lexer::KeywordConstant);
+  defs.Add("[a-z]+", Lexer::Name);
+  root->SetTokenDefinitions(defs);
+
+  const std::string input = "abaxyz";
+  std::vector<Token> tokens;
+  lexer->GetTokensUnprocessed(input, &tokens);
+
+  ASSERT_EQ(3u, tokens.size());
+  EXPECT_EQ(Lexer::Keyword, tokens[0].token);
+  EXPECT_EQ("ab", tokens[0].GetText(input));
+  EXPECT_EQ(Lexer::KeywordConstant, tokens[1].token);
+  EXPECT_EQ("a", tokens[1].GetText(input));
+  EXPECT_EQ(Lexer::Name, tokens[2].token);
+  EXPECT_EQ("xyz", tokens[2].GetText(input));
+}
+
+TEST(Lexer, FirstDefinitionWinsAtWordBoundary) {
+  std::unique_ptr<Lexer> lexer(new Lexer("boundary"));
+  LexerState* root = lexer->AddState("root");
+
+  // "ab\\b" matches "ab" when it's the whole input, but not when followed by
+  // more identifier characters.
+  TokenDefinitions defs;
+  defs.Add("ab\\b", Lexer::Keyword);
+  defs.Add("ab", Lexer::Name);
+  defs.Add("[a-z]", Lexer::Text);
+  defs.Add("\\s+", Lexer::Text);
+  root->SetTokenDefinitions(defs);
+
+  const std::string input = "abc ab";
+  std::vector<Token> tokens;
+  lexer->GetTokensUnprocessed(input, &tokens);
+
+  ASSERT_EQ(4u, tokens.size());
+  EXPECT_EQ(Lexer::Name, tokens[0].token);
+  EXPECT_EQ("ab", tokens[0].GetText(input));
+  EXPECT_EQ(Lexer::Text, tokens[1].token);
+  EXPECT_EQ("c", tokens[1].GetText(input));
+  EXPECT_EQ(Lexer::Text, tokens[2].token);
+  EXPECT_EQ(Lexer::Keyword, tokens[3].token);
+  EXPECT_EQ("ab", tokens[3].GetText(input));
+}
+
+namespace {
+
+void ExpectSameTokens(const TokenStream& expected, const TokenStream& actual) {
+  EXPECT_EQ(expected.line_count(), actual.line_count());
+  ASSERT_EQ(expected.tokens().size(), actual.tokens().size());
+  for (size_t i = 0; i < expected.tokens().size(); ++i) {
+    EXPECT_EQ(expected.tokens()[i].offset, actual.tokens()[i].offset);
+    EXPECT_EQ(expected.tokens()[i].length, actual.tokens()[i].length);
+    EXPECT_EQ(expected.tokens()[i].token, actual.tokens()[i].token);
+  }
+}
+
+// Relexes |stream| (lexed from |old_text|) for |new_text|, and checks that the
+// result is the same as lexing |new_text| from scratch.
+void RelexAndCompare(Lexer* lexer,
+                     const std::string& old_text,
+                     const std::string& new_text,
+                     TokenStream* stream,
+                     TokenStreamChange* change) {
+  size_t change_start, old_change_end, new_change_end;
+  FindChangedRange(old_text.data(),
+                   old_text.size(),
+                   new_text.data(),
+                   new_text.size(),
+                   &change_start,
+                   &old_change_end,
+                   &new_change_end);
+  lexer->Relex(new_text.data(),
+               new_text.size(),
+               change_start,
+               old_change_end,
+               new_change_end,
+               stream,
+               change);
+
+  TokenStream expected;
+  lexer->Lex(new_text.data(), new_text.size(), &expected);
+  ExpectSameTokens(expected, *stream);
+}
+
+}  // namespace
+
+TEST(Lexer, RelexStopsWhenStateConverges) {
+  std::unique_ptr<Lexer> lexer(MakeCppLexer());
+
+  const std::string old_text = "int a;\nint b;\nint c;\nint d;\n";
+  const std::string new_text = "int a;\nint bigger;\nint c;\nint d;\n";
+  TokenStream stream;
+  lexer->Lex(old_text.data(), old_text.size(), &stream);
+  EXPECT_EQ(4u, stream.line_count());
+
+  TokenStreamChange change;
+  RelexAndCompare(lexer.get(), old_text, new_text, &stream, &change);
+
+  // Only the edited line, and the one before it, are lexed again.
+  EXPECT_EQ(0u, change.first_line);
+  EXPECT_EQ(2u, change.old_line_end);
+  EXPECT_EQ(2u, change.new_line_end);
+  EXPECT_EQ(change.old_token_end, change.new_token_end);
+  EXPECT_EQ(10u, change.new_token_end - change.first_token);
+}
+
+TEST(Lexer, RelexContinuesWhileStateDiffers) {
+  std::unique_ptr<Lexer> lexer(MakeCppLexer());
+
+  const std::string old_text = "a;\nb;\nc; */\nd;\ne;\n";
+  const std::string new_text = "a;\n/*b;\nc; */\nd;\ne;\n";
+  TokenStream stream;
+  lexer->Lex(old_text.data(), old_text.size(), &stream);
+
+  TokenStreamChange change;
+  RelexAndCompare(lexer.get(), old_text, new_text, &stream, &change);
+
+  // The edit is at the start of the second line, so lexing restarts from the
+  // first. The comment covers the third line too, so that's relexed as well.
+  EXPECT_EQ(0u, change.first_line);
+  EXPECT_EQ(3u, change.new_line_end);
+
+  // And removing it again should get back to where we started.
+  RelexAndCompare(lexer.get(), new_text, old_text, &stream, &change);
+  EXPECT_EQ(0u, change.first_line);
+  EXPECT_EQ(3u, change.old_line_end);
+}
+
+TEST(Lexer, RelexLineCountChanges) {
+  std::unique_ptr<Lexer> lexer(MakeCppLexer());
+
+  const std::string old_text = "x = 1;\ny = 2;\nz = 3;";
+  const std::string new_text = "x = 1;\ny = 2;\nw = 0;\nz = 3;";
+  TokenStream stream;
+  lexer->Lex(old_text.data(), old_text.size(), &stream);
+  EXPECT_EQ(3u, stream.line_count());
+
+  TokenStreamChange change;
+  RelexAndCompare(lexer.get(), old_text, new_text, &stream, &change);
+  EXPECT_EQ(4u, stream.line_count());
+  EXPECT_EQ(change.old_line_end + 1, change.new_line_end);
+
+  // Nothing changed, so only the last couple of lines are looked at again.
+  RelexAndCompare(lexer.get(), new_text, new_text, &stream, &change);
+  EXPECT_EQ(2u, change.first_line);
+  EXPECT_EQ(4u, change.new_line_end);
+  EXPECT_EQ(change.old_token_end, change.new_token_end);
+}
+
+TEST(Lexer, LexUntilStopsAtLineStart) {
+  std::unique_ptr<Lexer> lexer(MakeCppLexer());
+
+  const std::string text = "int a;\n/* b\nc */\nint d;\n";
+  TokenStream stream;
+  lexer->LexUntil(text.data(), text.size(), 1, &stream);
+  EXPECT_FALSE(stream.complete());
+  EXPECT_EQ(7u, stream.lexed_length());
+  EXPECT_EQ(1u, stream.line_count());
+
+  // Lines can only be stopped at where a token starts, so this goes on past
+  // the end of the comment.
+  lexer->LexUntil(text.data(), text.size(), 9, &stream);
+  EXPECT_EQ(17u, stream.lexed_length());
+  EXPECT_EQ(3u, stream.line_count());
+  lexer->LexUntil(text.data(), text.size(), 16, &stream);
+  EXPECT_EQ(17u, stream.lexed_length());
+
+  lexer->LexUntil(text.data(), text.size(), text.size(), &stream);
+  EXPECT_TRUE(stream.complete());
+  EXPECT_EQ(text.size(), stream.lexed_length());
+
+  TokenStream expected;
+  lexer->Lex(text.data(), text.size(), &expected);
+  ExpectSameTokens(expected, stream);
+}
+
+TEST(Lexer, RelexPartlyLexed) {
+  std::unique_ptr<Lexer> lexer(MakeCppLexer());
+
+  const std::string old_text = "a;\nb;\nc;\nd;\ne;\nf;\n";
+  const std::string new_text = "a;\nbb;\nc;\nd;\ne;\nf;\n";
+  TokenStream stream;
+  lexer->LexUntil(old_text.data(), old_text.size(), 9, &stream);
+  EXPECT_EQ(9u, stream.lexed_length());
+
+  // An edit in the lexed part moves where lexing stopped.
+  TokenStreamChange change;
+  lexer->Relex(new_text.data(), new_text.size(), 4, 4, 5, &stream, &change);
+  EXPECT_FALSE(stream.complete());
+  EXPECT_EQ(10u, stream.lexed_length());
+  EXPECT_EQ(3u, stream.line_count());
+
+  // One after it doesn't lex any further.
+  const std::string newer_text = "a;\nbb;\nc;\nd;\ne;\nfff;\n";
+  lexer->Relex(
+      newer_text.data(), newer_text.size(), 16, 16, 18, &stream, &change);
+  EXPECT_EQ(10u, stream.lexed_length());
+  EXPECT_EQ(3u, stream.line_count());
+
+  lexer->LexUntil(newer_text.data(), newer_text.size(), 11, &stream);
+  EXPECT_EQ(13u, stream.lexed_length());
+  lexer->LexUntil(
+      newer_text.data(), newer_text.size(), newer_text.size(), &stream);
+  TokenStream expected;
+  lexer->Lex(newer_text.data(), newer_text.size(), &expected);
+  ExpectSameTokens(expected, stream);
+}
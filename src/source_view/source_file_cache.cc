@@ -0,0 +1,166 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "source_view/source_file_cache.h"
+
+#if PLATFORM_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Empty files can't be mapped, so they all share this instead.
+const char kEmpty[] = "";
+
+#if PLATFORM_WINDOWS
+
+typedef HANDLE FileHandle;
+const FileHandle kInvalidFile = INVALID_HANDLE_VALUE;
+
+FileHandle OpenFile(const std::string& path, SourceFile::Key* key) {
+  // Other programs may still write to, or replace, the file while it's open.
+  HANDLE file = CreateFileA(path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+  if (file == INVALID_HANDLE_VALUE)
+    return kInvalidFile;
+  BY_HANDLE_FILE_INFORMATION info;
+  if (!GetFileInformationByHandle(file, &info) ||
+      (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+    CloseHandle(file);
+    return kInvalidFile;
+  }
+  key->id = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) |
+            info.nFileIndexLow;
+  key->device = info.dwVolumeSerialNumber;
+  key->modified =
+      (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+      info.ftLastWriteTime.dwLowDateTime;
+  key->size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) |
+              info.nFileSizeLow;
+  return file;
+}
+
+void CloseFile(FileHandle file) {
+  CloseHandle(file);
+}
+
+const char* MapFile(FileHandle file, size_t size) {
+  HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping)
+    return NULL;
+  // The view keeps the mapping alive by itself.
+  void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+  CloseHandle(mapping);
+  return static_cast<const char*>(data);
+}
+
+void UnmapFile(const char* data, size_t size) {
+  UNUSED(size);
+  UnmapViewOfFile(data);
+}
+
+#elif PLATFORM_POSIX
+
+typedef int FileHandle;
+const FileHandle kInvalidFile = -1;
+
+FileHandle OpenFile(const std::string& path, SourceFile::Key* key) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return kInvalidFile;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return kInvalidFile;
+  }
+  key->id = st.st_ino;
+  key->device = st.st_dev;
+#if PLATFORM_OSX
+  const struct timespec& modified = st.st_mtimespec;
+#else
+  const struct timespec& modified = st.st_mtim;
+#endif
+  key->modified = static_cast<uint64_t>(modified.tv_sec) * 1000000000 +
+                  modified.tv_nsec;
+  key->size = st.st_size;
+  return fd;
+}
+
+void CloseFile(FileHandle file) {
+  close(file);
+}
+
+const char* MapFile(FileHandle file, size_t size) {
+  void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+  if (data == MAP_FAILED)
+    return NULL;
+  return static_cast<const char*>(data);
+}
+
+void UnmapFile(const char* data, size_t size) {
+  munmap(const_cast<char*>(data), size);
+}
+
+#endif
+
+}  // namespace
+
+SourceFile::SourceFile(const Key& key, const char* data, size_t size)
+    : key_(key), data_(data), size_(size) {}
+
+SourceFile::~SourceFile() {
+  if (data_ != kEmpty)
+    UnmapFile(data_, size_);
+}
+
+SourceFileCache::SourceFileCache() {}
+
+SourceFileCache::~SourceFileCache() {}
+
+std::shared_ptr<const SourceFile> SourceFileCache::Get(
+    const std::string& path) {
+  SourceFile::Key key;
+  FileHandle handle = OpenFile(path, &key);
+  if (handle == kInvalidFile)
+    return NULL;
+  // Too big to map, on 32-bit.
+  if (static_cast<size_t>(key.size) != key.size) {
+    CloseFile(handle);
+    return NULL;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::weak_ptr<const SourceFile>& entry = files_[path];
+  std::shared_ptr<const SourceFile> file = entry.lock();
+  if (file && file->key_ == key) {
+    CloseFile(handle);
+    return file;
+  }
+
+  size_t size = static_cast<size_t>(key.size);
+  const char* data = size ? MapFile(handle, size) : kEmpty;
+  CloseFile(handle);
+  if (!data)
+    return NULL;
+  file.reset(new SourceFile(key, data, size));
+  entry = file;
+
+  // Forget about any files that aren't being used any more while we're here.
+  for (auto it = files_.begin(); it != files_.end();) {
+    if (it->second.expired())
+      it = files_.erase(it);
+    else
+      ++it;
+  }
+  return file;
+}
@@ -0,0 +1,79 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SOURCE_VIEW_SOURCE_FILE_CACHE_H_
+#define SOURCE_VIEW_SOURCE_FILE_CACHE_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "core.h"
+
+// The contents of a file, mapped read-only, rather than read into memory.
+//
+// Something else writing to the file in place (rather than replacing it) can
+// change the contents underneath us, and truncating it makes touching the
+// pages past the new end fault on POSIX. On Windows it's the writer that
+// fails instead, while the file is mapped.
+class SourceFile {
+ public:
+  // Identifies a version of a file. |id| is the inode, or file index on
+  // Windows.
+  struct Key {
+    bool operator==(const Key& other) const {
+      return id == other.id && device == other.device &&
+             modified == other.modified && size == other.size;
+    }
+    uint64_t id;
+    uint64_t device;
+    uint64_t modified;
+    uint64_t size;
+  };
+
+  ~SourceFile();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Whether |other| is a mapping of the same file on disk, rather than of one
+  // that has replaced it at the same path. If so, changes to one may show up
+  // in the other.
+  bool SameFileAs(const SourceFile& other) const {
+    return key_.id == other.key_.id && key_.device == other.key_.device;
+  }
+
+ private:
+  friend class SourceFileCache;
+
+  SourceFile(const Key& key, const char* data, size_t size);
+
+  Key key_;
+  const char* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(SourceFile);
+};
+
+// Maps source files so that every view of a file shares one mapping, which is
+// only made again when the file has changed. This is safe to use from any
+// thread.
+class SourceFileCache {
+ public:
+  SourceFileCache();
+  ~SourceFileCache();
+
+  // Returns NULL if |path| can't be opened or mapped.
+  std::shared_ptr<const SourceFile> Get(const std::string& path);
+
+ private:
+  std::mutex mutex_;
+  // Held weakly, so a file is unmapped once nothing is showing it.
+  std::map<std::string, std::weak_ptr<const SourceFile>> files_;
+
+  DISALLOW_COPY_AND_ASSIGN(SourceFileCache);
+};
+
+#endif  // SOURCE_VIEW_SOURCE_FILE_CACHE_H_
@@ -0,0 +1,81 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "source_view/source_file_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+namespace {
+
+const char kTestFile[] = "source_file_cache_test.tmp";
+const char kOldTestFile[] = "source_file_cache_test.tmp.old";
+
+void WriteTestFile(const char* path, const std::string& contents) {
+  FILE* f = fopen(path, "wb");
+  ASSERT_TRUE(f);
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+}
+
+std::string Contents(const SourceFile& file) {
+  return std::string(file.data(), file.size());
+}
+
+}  // namespace
+
+TEST(SourceFileCache, SharesMapping) {
+  WriteTestFile(kTestFile, "int main() {}\n");
+  SourceFileCache cache;
+  std::shared_ptr<const SourceFile> a = cache.Get(kTestFile);
+  std::shared_ptr<const SourceFile> b = cache.Get(kTestFile);
+  ASSERT_TRUE(a);
+  EXPECT_EQ(a, b);
+  EXPECT_EQ("int main() {}\n", Contents(*a));
+  a.reset();
+  b.reset();
+  remove(kTestFile);
+}
+
+TEST(SourceFileCache, ReplacedFile) {
+  WriteTestFile(kTestFile, "old\n");
+  SourceFileCache cache;
+  std::shared_ptr<const SourceFile> old_file = cache.Get(kTestFile);
+  ASSERT_TRUE(old_file);
+
+  rename(kTestFile, kOldTestFile);
+  WriteTestFile(kTestFile, "newer\n");
+  std::shared_ptr<const SourceFile> new_file = cache.Get(kTestFile);
+  ASSERT_TRUE(new_file);
+  EXPECT_NE(old_file, new_file);
+  EXPECT_FALSE(new_file->SameFileAs(*old_file));
+  EXPECT_EQ("old\n", Contents(*old_file));
+  EXPECT_EQ("newer\n", Contents(*new_file));
+  EXPECT_EQ(new_file, cache.Get(kTestFile));
+
+  old_file.reset();
+  new_file.reset();
+  remove(kTestFile);
+  remove(kOldTestFile);
+}
+
+TEST(SourceFileCache, UnusedFilesAreUnmapped) {
+  WriteTestFile(kTestFile, "abc");
+  SourceFileCache cache;
+  std::weak_ptr<const SourceFile> weak = cache.Get(kTestFile);
+  EXPECT_TRUE(weak.expired());
+  remove(kTestFile);
+}
+
+TEST(SourceFileCache, EmptyAndMissingFiles) {
+  WriteTestFile(kTestFile, "");
+  SourceFileCache cache;
+  std::shared_ptr<const SourceFile> empty = cache.Get(kTestFile);
+  ASSERT_TRUE(empty);
+  EXPECT_EQ(0u, empty->size());
+  EXPECT_FALSE(cache.Get("this_file_does_not_exist.cc"));
+  empty.reset();
+  remove(kTestFile);
+}
@@ -0,0 +1,311 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "source_view/source_loader.h"
+
+#include <string.h>
+
+#include "source_view/cpp_lexer.h"
+
+namespace {
+
+// How much to lex before handing a block of lines over to the UI thread.
+const size_t kBlockBytes = 64 * 1024;
+
+void FindLineStarts(const SourceFile& file, std::vector<uint32_t>* starts) {
+  const char* begin = file.data();
+  const char* end = begin + file.size();
+  for (const char* p = begin; p != end;) {
+    starts->push_back(static_cast<uint32_t>(p - begin));
+    const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+    p = newline ? newline + 1 : end;
+  }
+}
+
+// Splits tokens [first_token, end_token) of |stream| into runs for each line,
+// appending to |runs|, and the index of each line's first run to |line_runs|.
+// The first token must start a line.
+void MakeRuns(const char* text,
+              const TokenStream& stream,
+              size_t first_token,
+              size_t end_token,
+              std::vector<ColorRun>* runs,
+              std::vector<uint32_t>* line_runs) {
+  if (first_token == end_token)
+    return;
+  size_t line_start = stream.tokens()[first_token].offset;
+  size_t line_first_run = runs->size();
+  for (size_t i = first_token; i < end_token; ++i) {
+    const Token& token = stream.tokens()[i];
+    // If we have multiple lines in a token, push as separate pieces.
+    size_t start = token.offset;
+    size_t end = token.offset + token.length;
+    for (;;) {
+      const char* newline =
+          static_cast<const char*>(memchr(text + start, '\n', end - start));
+      size_t piece_end = newline ? newline - text : end;
+      if (piece_end != start) {
+        uint32_t run_start = static_cast<uint32_t>(start - line_start);
+        uint32_t length = static_cast<uint32_t>(piece_end - start);
+        if (runs->size() > line_first_run && runs->back().type == token.token) {
+          runs->back().length += length;
+        } else {
+          ColorRun run = {run_start, length, token.token};
+          runs->push_back(run);
+        }
+      }
+      if (!newline)
+        break;
+      line_runs->push_back(static_cast<uint32_t>(line_first_run));
+      line_first_run = runs->size();
+      start = piece_end + 1;
+      line_start = start;
+    }
+  }
+  if (runs->size() > line_first_run)
+    line_runs->push_back(static_cast<uint32_t>(line_first_run));
+}
+
+}  // namespace
+
+SourceLoader::SourceLoader(SourceFileCache* files,
+                           const std::function<void()>& wake)
+    : files_(files),
+      wake_(wake),
+      head_(new Node),
+      first_generation_(0),
+      status_(kLoading),
+      line_runs_(1, 0),
+      tail_(head_),
+      request_pending_(false),
+      request_fresh_(false),
+      quit_(false),
+      generation_(0),
+      thread_(&SourceLoader::ThreadMain, this) {}
+
+SourceLoader::~SourceLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+    ++generation_;
+  }
+  request_ready_.notify_one();
+  thread_.join();
+  while (head_) {
+    Node* next = head_->next.load(std::memory_order_relaxed);
+    delete head_;
+    head_ = next;
+  }
+}
+
+void SourceLoader::Load(const std::string& path) {
+  bool fresh = path != path_;
+  uint32_t generation;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    request_path_ = path;
+    request_pending_ = true;
+    request_fresh_ = request_fresh_ || fresh;
+    generation = ++generation_;
+  }
+  request_ready_.notify_one();
+
+  if (fresh) {
+    path_ = path;
+    first_generation_ = generation;
+    status_ = kLoading;
+    file_.reset();
+    line_starts_.clear();
+    runs_.clear();
+    line_runs_.assign(1, 0);
+  }
+}
+
+bool SourceLoader::Poll() {
+  bool changed = false;
+  for (;;) {
+    Node* next = head_->next.load(std::memory_order_acquire);
+    if (!next)
+      break;
+    delete head_;
+    head_ = next;
+    if (next->update.generation >= first_generation_) {
+      Apply(&next->update);
+      changed = true;
+    }
+    next->update = Update();
+  }
+  return changed;
+}
+
+const char* SourceLoader::LineBegin(size_t line) const {
+  return file_->data() + line_starts_[line];
+}
+
+const char* SourceLoader::LineEnd(size_t line) const {
+  const char* end = line + 1 < line_starts_.size()
+                        ? file_->data() + line_starts_[line + 1]
+                        : file_->data() + file_->size();
+  if (end != LineBegin(line) && end[-1] == '\n')
+    --end;
+  return end;
+}
+
+void SourceLoader::Apply(Update* update) {
+  switch (update->type) {
+    case Update::kLoaded:
+      runs_.clear();
+      line_runs_.assign(1, 0);
+      // Fall through.
+    case Update::kReloaded:
+      status_ = kLoaded;
+      file_ = update->file;
+      line_starts_.swap(update->line_starts);
+      break;
+    case Update::kLexed:
+      break;
+    case Update::kFailed:
+      status_ = kFailed;
+      file_.reset();
+      line_starts_.clear();
+      runs_.clear();
+      line_runs_.assign(1, 0);
+      return;
+  }
+
+  // Replace the runs for the old lines, and then the lines' indices into them,
+  // moving the indices of the lines after them to match.
+  size_t first_line = update->first_line;
+  size_t old_line_end = update->old_line_end;
+  DCHECK(first_line <= old_line_end && old_line_end <= colored_line_count());
+  uint32_t first_run = line_runs_[first_line];
+  uint32_t old_run_end = line_runs_[old_line_end];
+  runs_.erase(runs_.begin() + first_run, runs_.begin() + old_run_end);
+  runs_.insert(
+      runs_.begin() + first_run, update->runs.begin(), update->runs.end());
+  for (uint32_t& line_run : update->line_runs)
+    line_run += first_run;
+  line_runs_.erase(line_runs_.begin() + first_line,
+                   line_runs_.begin() + old_line_end);
+  line_runs_.insert(line_runs_.begin() + first_line,
+                    update->line_runs.begin(),
+                    update->line_runs.end());
+  uint32_t new_run_end = static_cast<uint32_t>(first_run + update->runs.size());
+  for (size_t i = first_line + update->line_runs.size(); i < line_runs_.size();
+       ++i)
+    line_runs_[i] = line_runs_[i] - old_run_end + new_run_end;
+}
+
+void SourceLoader::Post(Update* update) {
+  Node* node = new Node;
+  node->update = std::move(*update);
+  tail_->next.store(node, std::memory_order_release);
+  tail_ = node;
+  wake_();
+}
+
+void SourceLoader::ThreadMain() {
+  std::unique_ptr<Lexer> lexer(MakeCppLexer());
+  std::string path;
+  std::shared_ptr<const SourceFile> file;
+  TokenStream tokens;
+
+  for (;;) {
+    std::string request_path;
+    bool fresh;
+    uint32_t generation;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      request_ready_.wait(lock, [this] { return quit_ || request_pending_; });
+      if (quit_)
+        return;
+      request_path.swap(request_path_);
+      request_pending_ = false;
+      fresh = request_fresh_;
+      request_fresh_ = false;
+      generation = generation_.load();
+    }
+
+    Update update;
+    update.generation = generation;
+    update.first_line = 0;
+    update.old_line_end = 0;
+    std::shared_ptr<const SourceFile> new_file = files_->Get(request_path);
+    if (!new_file) {
+      path.clear();
+      file.reset();
+      tokens.Clear();
+      update.type = Update::kFailed;
+      Post(&update);
+      continue;
+    }
+    FindLineStarts(*new_file, &update.line_starts);
+
+    // The old contents can only be compared with when they're still there,
+    // i.e. the file is unchanged, or has been replaced rather than rewritten.
+    if (!fresh && request_path == path && tokens.complete() &&
+        (new_file == file || !new_file->SameFileAs(*file))) {
+      size_t change_start, old_change_end, new_change_end;
+      FindChangedRange(file->data(),
+                       file->size(),
+                       new_file->data(),
+                       new_file->size(),
+                       &change_start,
+                       &old_change_end,
+                       &new_change_end);
+      TokenStreamChange change;
+      lexer->Relex(new_file->data(),
+                   new_file->size(),
+                   change_start,
+                   old_change_end,
+                   new_change_end,
+                   &tokens,
+                   &change);
+      update.type = Update::kReloaded;
+      update.first_line = change.first_line;
+      update.old_line_end = change.old_line_end;
+      MakeRuns(new_file->data(),
+               tokens,
+               change.first_token,
+               change.new_token_end,
+               &update.runs,
+               &update.line_runs);
+      DCHECK(update.line_runs.size() ==
+             change.new_line_end - change.first_line);
+    } else {
+      // A different file, one that was rewritten in place or only partly
+      // lexed, or one that the UI thread has thrown away, so start from
+      // scratch.
+      tokens.Clear();
+      update.type = Update::kLoaded;
+    }
+    path = request_path;
+    file = new_file;
+    update.file = file;
+    Post(&update);
+
+    // Then lex the rest a block at a time, until done or there's something
+    // newer to do.
+    while (!tokens.complete() && generation_.load() == generation) {
+      size_t first_token = tokens.tokens().size();
+      Update block;
+      block.type = Update::kLexed;
+      block.generation = generation;
+      block.first_line = tokens.line_count();
+      block.old_line_end = block.first_line;
+      lexer->LexUntil(file->data(),
+                      file->size(),
+                      tokens.lexed_length() + kBlockBytes,
+                      &tokens);
+      MakeRuns(file->data(),
+               tokens,
+               first_token,
+               tokens.tokens().size(),
+               &block.runs,
+               &block.line_runs);
+      DCHECK(block.line_runs.size() == tokens.line_count() - block.first_line);
+      Post(&block);
+    }
+  }
+}
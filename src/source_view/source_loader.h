@@ -0,0 +1,150 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SOURCE_VIEW_SOURCE_LOADER_H_
+#define SOURCE_VIEW_SOURCE_LOADER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core.h"
+#include "source_view/lexer.h"
+#include "source_view/source_file_cache.h"
+
+// Part of a line that's all one color. |start| is relative to the start of
+// the line, so a run stays valid when lines before it are added or removed.
+struct ColorRun {
+  uint32_t start;
+  uint32_t length;
+  Lexer::TokenType type;
+};
+
+// Reads and lexes a source file on a background thread, so that opening a big
+// file doesn't hold up drawing. The lexed lines are handed back a block at a
+// time, and Poll() picks them up on the UI thread, which is the only thread
+// that should call any of the methods here.
+class SourceLoader {
+ public:
+  // Files are read through |files|, which must outlive this. |wake| is called
+  // on the loading thread whenever something new is ready, to get the UI
+  // thread to come and Poll() for it.
+  SourceLoader(SourceFileCache* files, const std::function<void()>& wake);
+  ~SourceLoader();
+
+  // Starts loading |path|, abandoning any load that's in progress. Loading the
+  // same path again keeps the old contents until the new ones are read, and
+  // only relexes the part of the file that changed.
+  void Load(const std::string& path);
+
+  // Takes whatever the loading thread has finished since the last call.
+  // Returns true if anything changed.
+  bool Poll();
+
+  enum Status {
+    kLoading,
+    kLoaded,
+    kFailed,
+  };
+  Status status() const { return status_; }
+
+  // The file's contents, once it's loaded.
+  const SourceFile& file() const { return *file_; }
+  size_t line_count() const { return line_starts_.size(); }
+  // Not including the newline.
+  const char* LineBegin(size_t line) const;
+  const char* LineEnd(size_t line) const;
+
+  // Lines [0, colored_line_count()) have been lexed, and the rest should be
+  // shown uncolored until they are. Each colored line's runs cover all of it,
+  // with adjacent tokens of the same type merged.
+  size_t colored_line_count() const { return line_runs_.size() - 1; }
+  const ColorRun* RunsBegin(size_t line) const {
+    return runs_.data() + line_runs_[line];
+  }
+  const ColorRun* RunsEnd(size_t line) const {
+    return runs_.data() + line_runs_[line + 1];
+  }
+
+ private:
+  // What the loading thread has done, sent to the UI thread.
+  struct Update {
+    enum Type {
+      // A new file, with nothing lexed yet.
+      kLoaded,
+      // The same file, changed. The colored lines [first_line, old_line_end)
+      // were replaced by the ones here.
+      kReloaded,
+      // Newly lexed lines, following on from the last block.
+      kLexed,
+      kFailed,
+    };
+    Type type;
+    uint32_t generation;
+    std::shared_ptr<const SourceFile> file;
+    std::vector<uint32_t> line_starts;
+    size_t first_line;
+    size_t old_line_end;
+    // The colored lines, as indices into |runs| of where each starts.
+    std::vector<ColorRun> runs;
+    std::vector<uint32_t> line_runs;
+  };
+
+  // A queue from the loading thread to the UI thread where neither side ever
+  // waits for the other. The consumer owns a dummy node at |head_|, so the
+  // two only touch the same node through its atomic |next|.
+  struct Node {
+    Node() : next(NULL) {}
+    Update update;
+    std::atomic<Node*> next;
+  };
+
+  void ThreadMain();
+  void Post(Update* update);
+  void Apply(Update* update);
+
+  SourceFileCache* files_;
+  std::function<void()> wake_;
+
+  // UI thread. Updates from before |first_generation_|, which was when a
+  // different file was asked for, are dropped.
+  Node* head_;
+  std::string path_;
+  uint32_t first_generation_;
+  Status status_;
+  std::shared_ptr<const SourceFile> file_;
+  // All in one place rather than a container per line, as there are a lot of
+  // lines in a big file. |line_runs_| has an extra entry at the end of the
+  // colored lines for where the last one's runs end.
+  std::vector<uint32_t> line_starts_;
+  std::vector<ColorRun> runs_;
+  std::vector<uint32_t> line_runs_;
+
+  // Loading thread.
+  Node* tail_;
+
+  // Requests to the loading thread. |generation_| counts them, and is also
+  // read without the lock by the loading thread to notice that it's been
+  // given something new to do.
+  std::mutex mutex_;
+  std::condition_variable request_ready_;
+  std::string request_path_;
+  bool request_pending_;
+  // Set when the UI thread has thrown away what it had, so the loading thread
+  // has to start from scratch too.
+  bool request_fresh_;
+  bool quit_;
+  std::atomic<uint32_t> generation_;
+
+  std::thread thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(SourceLoader);
+};
+
+#endif  // SOURCE_VIEW_SOURCE_LOADER_H_
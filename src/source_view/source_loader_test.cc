@@ -0,0 +1,171 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "source_view/source_loader.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+namespace {
+
+const char kTestFile[] = "source_loader_test.tmp";
+const char kOldTestFile[] = "source_loader_test.tmp.old";
+
+void WriteTestFile(const std::string& contents) {
+  FILE* f = fopen(kTestFile, "wb");
+  ASSERT_TRUE(f);
+  fwrite(contents.data(), 1, contents.size(), f);
+  fclose(f);
+}
+
+// Lets the test sleep until the loading thread has something for it.
+class Waker {
+ public:
+  Waker() : woken_(false) {}
+
+  std::function<void()> GetWakeFunction() {
+    return [this] {
+      std::lock_guard<std::mutex> lock(mutex_);
+      woken_ = true;
+      cv_.notify_one();
+    };
+  }
+
+  // Polls |loader| until it has something new, and has finished loading and
+  // lexing.
+  void WaitForLoad(SourceLoader* loader) {
+    bool changed = false;
+    for (;;) {
+      changed = loader->Poll() || changed;
+      if (changed &&
+          (loader->status() == SourceLoader::kFailed ||
+           (loader->status() == SourceLoader::kLoaded &&
+            loader->colored_line_count() == loader->line_count())))
+        return;
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return woken_; });
+      woken_ = false;
+    }
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool woken_;
+};
+
+std::string FileContents(const SourceLoader& loader) {
+  return std::string(loader.file().data(), loader.file().size());
+}
+
+// Reassembles the colored lines to compare with the text.
+std::string JoinColoredLines(const SourceLoader& loader) {
+  std::string result;
+  for (size_t i = 0; i < loader.colored_line_count(); ++i) {
+    for (const ColorRun* run = loader.RunsBegin(i); run != loader.RunsEnd(i);
+         ++run)
+      result.append(loader.LineBegin(i) + run->start, run->length);
+    result += "\n";
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(SourceLoader, LoadAndLex) {
+  std::string contents;
+  for (int i = 0; i < 20000; ++i)
+    contents += "int x = 0;  // " + std::to_string(i) + "\n";
+  WriteTestFile(contents);
+
+  Waker waker;
+  SourceFileCache files;
+  SourceLoader loader(&files, waker.GetWakeFunction());
+  EXPECT_EQ(SourceLoader::kLoading, loader.status());
+  loader.Load(kTestFile);
+  waker.WaitForLoad(&loader);
+  ASSERT_EQ(SourceLoader::kLoaded, loader.status());
+  EXPECT_EQ(contents, FileContents(loader));
+  EXPECT_EQ(20000u, loader.line_count());
+  EXPECT_EQ(contents, JoinColoredLines(loader));
+  EXPECT_EQ("int x = 0;  // 1",
+            std::string(loader.LineBegin(1), loader.LineEnd(1)));
+
+  const ColorRun* first = loader.RunsBegin(1);
+  const ColorRun* last = loader.RunsEnd(1) - 1;
+  ASSERT_LT(first, last);
+  EXPECT_EQ(Lexer::KeywordType, first->type);
+  EXPECT_EQ(0u, first->start);
+  EXPECT_EQ(3u, first->length);
+  EXPECT_EQ(Lexer::CommentSingle, last->type);
+  EXPECT_EQ(12u, last->start);
+  EXPECT_EQ(4u, last->length);
+
+  remove(kTestFile);
+}
+
+TEST(SourceLoader, ReloadChangedFile) {
+  WriteTestFile("int a;\nint b;\nint c;\n");
+  Waker waker;
+  SourceFileCache files;
+  SourceLoader loader(&files, waker.GetWakeFunction());
+  loader.Load(kTestFile);
+  waker.WaitForLoad(&loader);
+  EXPECT_EQ(3u, loader.colored_line_count());
+
+  // Replace the file, as editors tend to, rather than writing over it. That
+  // leaves the old contents to find out what changed.
+  const std::string changed = "int a;\n/* b; */\nint x;\nint c;\n";
+  rename(kTestFile, kOldTestFile);
+  WriteTestFile(changed);
+  loader.Load(kTestFile);
+  // Until the reload arrives the old contents are still there.
+  EXPECT_EQ(SourceLoader::kLoaded, loader.status());
+  EXPECT_EQ(3u, loader.line_count());
+  waker.WaitForLoad(&loader);
+  EXPECT_EQ(changed, FileContents(loader));
+  EXPECT_EQ(changed, JoinColoredLines(loader));
+  EXPECT_EQ(Lexer::CommentMultiline, loader.RunsBegin(1)->type);
+
+  remove(kTestFile);
+  remove(kOldTestFile);
+}
+
+#if PLATFORM_POSIX
+// Windows doesn't allow truncating a file that's mapped.
+TEST(SourceLoader, ReloadRewrittenFile) {
+  WriteTestFile("int a;\nint b;\nint c;\n");
+  Waker waker;
+  SourceFileCache files;
+  SourceLoader loader(&files, waker.GetWakeFunction());
+  loader.Load(kTestFile);
+  waker.WaitForLoad(&loader);
+
+  // The old mapping sees this too, so it's lexed again from scratch.
+  const std::string changed = "int a;\n\"b;\"\n";
+  WriteTestFile(changed);
+  loader.Load(kTestFile);
+  waker.WaitForLoad(&loader);
+  EXPECT_EQ(changed, FileContents(loader));
+  EXPECT_EQ(changed, JoinColoredLines(loader));
+  EXPECT_EQ(Lexer::LiteralString, loader.RunsBegin(1)->type);
+
+  remove(kTestFile);
+}
+#endif
+
+TEST(SourceLoader, MissingFile) {
+  Waker waker;
+  SourceFileCache files;
+  SourceLoader loader(&files, waker.GetWakeFunction());
+  loader.Load("this_file_does_not_exist.cc");
+  EXPECT_EQ(SourceLoader::kLoading, loader.status());
+  waker.WaitForLoad(&loader);
+  EXPECT_EQ(SourceLoader::kFailed, loader.status());
+}
@@ -5,73 +5,19 @@
 #include "source_view/source_view.h"
 
 #include "skin.h"
-#include "source_view/cpp_lexer.h"
 
-SourceView::SourceView() : scroll_(this, Skin::current().text_line_height()) {
+SourceView::SourceView(SourceFileCache* files)
+    : scroll_(this, Skin::current().text_line_height()),
+      // Nothing's invalidated when woken; the next Render() picks up what's
+      // been loaded.
+      loader_(files, [] {}) {
 }
 
 SourceView::~SourceView() {
 }
 
-static void SplitString(const std::string& str,
-                        char delimiter,
-                        std::vector<std::string>* into) {
-  std::vector<std::string> parsed;
-  std::string::size_type pos = 0;
-  for (;;) {
-    const std::string::size_type at = str.find(delimiter, pos);
-    if (at == std::string::npos) {
-      parsed.push_back(str.substr(pos));
-      break;
-    } else {
-      parsed.push_back(str.substr(pos, at - pos));
-      pos = at + 1;
-    }
-  }
-  into->swap(parsed);
-}
-
-// TODO(scottmg): Losing last line if doesn't end in \n.
-void SyntaxHighlight(const std::string& input, std::vector<Line>* lines) {
-  std::unique_ptr<Lexer> lexer(MakeCppLexer());
-  std::vector<Token> tokens;
-  lexer->GetTokensUnprocessed(input, &tokens);
-  Line current_line;
-  for (size_t i = 0; i < tokens.size(); ++i) {
-    const Token& token = tokens[i];
-    if (token.value == "\n") {
-      lines->push_back(current_line);
-      current_line.clear();
-    } else {
-      ColoredText fragment;
-      fragment.type = token.token;
-      std::vector<std::string> tok_lines;
-      SplitString(token.value, '\n', &tok_lines);
-      fragment.text = tok_lines[0];
-      current_line.push_back(fragment);
-      // If we have multiple lines in a token, push as separate pieces.
-      for (size_t i = 1; i < tok_lines.size(); ++i) {
-        lines->push_back(current_line);
-        current_line.clear();
-        fragment.text = tok_lines[i];
-        current_line.push_back(fragment);
-      }
-    }
-  }
-}
-
 void SourceView::SetFilePath(const std::string& path) {
-  // TODO(scottmg): On background thread.
-  FILE* f = fopen(path.c_str(), "rb");
-  if (!f)
-    return;
-  fseek(f, 0, SEEK_END);
-  int len = ftell(f);
-  std::unique_ptr<char[]> file_contents(new char[len]);
-  fseek(f, 0, SEEK_SET);
-  fread(file_contents.get(), 1, len, f);
-  fclose(f);
-  SyntaxHighlight(std::string(file_contents.get(), len), &lines_);
+  loader_.Load(path);
 }
 
 bool SourceView::NotifyMouseWheel(int x,
@@ -94,6 +40,7 @@ bool SourceView::NotifyKey(Key::Enum key, bool down, uint8_t modifiers) {
 }
 
 void SourceView::Render() {
+  loader_.Poll();
   scroll_.Update();
   const Skin& skin = Skin::current();
   const ColorScheme& cs = skin.GetColorScheme();
@@ -106,7 +53,7 @@ void SourceView::Render() {
   // Not quite right, but probably close enough.
   int largest_numbers_width = renderer->MeasureText(
       skin.mono_font(),
-      base::IntToString16(lines_.size()).c_str()).x;
+      base::IntToString16(loader_.line_count()).c_str()).x;
   static const int left_margin = 5;
   static const int right_margin = 10;
   static const int indicator_width = line_height;
@@ -121,7 +68,7 @@ void SourceView::Render() {
 
   int y_pixel_scroll = scroll_.GetOffset();
 
-  for (size_t i = start_line; i < lines_.size(); ++i) {
+  for (size_t i = start_line; i < loader_.line_count(); ++i) {
     // Extra |line_height| added to height so that a full line is drawn at
     // the bottom when partial-line pixel scrolled.
     if (!LineInView(i))
@@ -147,14 +94,17 @@ void SourceView::Render() {
     // it's completely static in our case anyway.
     // - etc.
     std::vector<RangeAndColor> ranges;
-    std::string current_line;
-    for (size_t j = 0; j < lines_[i].size(); ++j) {
-      RangeAndColor rac(
-          static_cast<int>(current_line.size()),
-          static_cast<int>(current_line.size() + lines_[i][j].text.size()),
-          ColorForTokenType(skin, lines_[i][j].type));
-      ranges.push_back(rac);
-      current_line += lines_[i][j].text;
+    std::string current_line(loader_.LineBegin(i), loader_.LineEnd(i));
+    // Lines that haven't been lexed yet are left uncolored.
+    if (i < loader_.colored_line_count()) {
+      for (const ColorRun* run = loader_.RunsBegin(i);
+           run != loader_.RunsEnd(i);
+           ++run) {
+        RangeAndColor rac(static_cast<int>(run->start),
+                          static_cast<int>(run->start + run->length),
+                          ColorForTokenType(skin, run->type));
+        ranges.push_back(rac);
+      }
     }
     GfxColoredText(Font::kMono,
                    cs.text(),
@@ -180,7 +130,8 @@ void SourceView::Render() {
 }
 
 int SourceView::GetContentSize() {
-  return static_cast<int>(Skin::current().text_line_height() * lines_.size());
+  return static_cast<int>(Skin::current().text_line_height() *
+                          loader_.line_count());
 }
 
 const Rect& SourceView::GetScreenRect() const {
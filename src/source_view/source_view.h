@@ -11,17 +11,12 @@
 #include "gfx.h"
 #include "scroll_helper.h"
 #include "source_view/lexer.h"
+#include "source_view/source_loader.h"
 #include "widget.h"
 
-struct ColoredText {
-  Lexer::TokenType type;
-  std::string text;
-};
-typedef std::vector<ColoredText> Line;
-
 class SourceView : public Widget, public ScrollHelperDataProvider {
  public:
-  SourceView();
+  explicit SourceView(SourceFileCache* files);
   ~SourceView() override;
 
   void SetFilePath(const std::string& path);
@@ -45,7 +40,7 @@ class SourceView : public Widget, public ScrollHelperDataProvider {
   const Color& ColorForTokenType(const Skin& skin, Lexer::TokenType type);
 
   ScrollHelper scroll_;
-  std::vector<Line> lines_;
+  SourceLoader loader_;
 
   DISALLOW_COPY_AND_ASSIGN(SourceView);
 };
@@ -0,0 +1,162 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "user_files.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "core.h"
+
+#if PLATFORM_WINDOWS
+#include <windows.h>
+#elif PLATFORM_POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if PLATFORM_WINDOWS
+
+std::string GetUserPath(const char* variable, const std::string& name) {
+  const char* base = getenv(variable);
+  if (!base)
+    return std::string();
+  std::string dir = std::string(base) + "\\sg";
+  if (!CreateDirectoryA(dir.c_str(), NULL) &&
+      GetLastError() != ERROR_ALREADY_EXISTS)
+    return std::string();
+  return dir + "\\" + name;
+}
+
+#elif PLATFORM_POSIX
+
+// |xdg_variable| and |fallback| (relative to the home directory) are where
+// the XDG base directory spec puts it, and |mac_dir| where macOS does.
+std::string GetUserPath(const char* xdg_variable,
+                        const char* fallback,
+                        const char* mac_dir,
+                        const std::string& name) {
+  std::string dir;
+  const char* home = getenv("HOME");
+#if PLATFORM_OSX
+  UNUSED(xdg_variable);
+  UNUSED(fallback);
+  if (!home)
+    return std::string();
+  dir = std::string(home) + mac_dir;
+#else
+  UNUSED(mac_dir);
+  const char* xdg_dir = getenv(xdg_variable);
+  if (xdg_dir && xdg_dir[0]) {
+    dir = xdg_dir;
+  } else if (home) {
+    dir = std::string(home) + fallback;
+    mkdir(dir.c_str(), 0700);
+  } else {
+    return std::string();
+  }
+  dir += "/sg";
+#endif
+  if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)
+    return std::string();
+  return dir + "/" + name;
+}
+
+#endif
+
+// Creates a new, empty file with a name no one else is using, in the same
+// directory as |path| so that it can be renamed over it. Returns it opened
+// for writing, and its name in |temp_path|, or NULL if it couldn't be.
+FILE* CreateTempFileNextTo(const std::string& path, std::string* temp_path) {
+#if PLATFORM_WINDOWS
+  std::string::size_type slash = path.find_last_of("\\/");
+  std::string dir =
+      slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+  char name[MAX_PATH];
+  if (GetTempFileNameA(dir.c_str(), "sg", 0, name) == 0)
+    return NULL;
+  *temp_path = name;
+  FILE* file = fopen(name, "wb");
+  if (!file)
+    DeleteFileA(name);
+  return file;
+#elif PLATFORM_POSIX
+  std::string pattern = path + ".XXXXXX";
+  std::vector<char> name(pattern.begin(), pattern.end());
+  name.push_back(0);
+  int fd = mkstemp(name.data());
+  if (fd < 0)
+    return NULL;
+  *temp_path = name.data();
+  FILE* file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    unlink(name.data());
+  }
+  return file;
+#endif
+}
+
+}  // namespace
+
+std::string GetUserCachePath(const std::string& name) {
+#if PLATFORM_WINDOWS
+  return GetUserPath("LOCALAPPDATA", name);
+#elif PLATFORM_POSIX
+  return GetUserPath("XDG_CACHE_HOME", "/.cache", "/Library/Caches/sg", name);
+#endif
+}
+
+std::string GetUserConfigPath(const std::string& name) {
+#if PLATFORM_WINDOWS
+  return GetUserPath("APPDATA", name);
+#elif PLATFORM_POSIX
+  return GetUserPath(
+      "XDG_CONFIG_HOME", "/.config", "/Library/Application Support/sg", name);
+#endif
+}
+
+bool ReadFileContents(const std::string& path, std::vector<char>* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  bool ok = size >= 0;
+  if (ok) {
+    contents->resize(size);
+    ok = fread(contents->data(), 1, size, file) == static_cast<size_t>(size);
+  }
+  fclose(file);
+  return ok;
+}
+
+bool WriteFileAtomically(const std::string& path,
+                         const void* data,
+                         size_t size) {
+  // Each writer has its own, so that two at once (e.g. two instances
+  // exiting together) can't write into the same one.
+  std::string temp_path;
+  FILE* file = CreateTempFileNextTo(path, &temp_path);
+  if (!file)
+    return false;
+  bool ok = fwrite(data, 1, size, file) == size;
+  ok = fclose(file) == 0 && ok;
+#if PLATFORM_WINDOWS
+  ok = ok && MoveFileExA(temp_path.c_str(),
+                         path.c_str(),
+                         MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  ok = ok && rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+  if (!ok)
+    remove(temp_path.c_str());
+  return ok;
+}
@@ -0,0 +1,30 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef USER_FILES_H_
+#define USER_FILES_H_
+
+#include <string>
+#include <vector>
+
+// Where to keep a file called |name| that only makes things faster, and can
+// be thrown away at any time, in the user's cache directory. The directory is
+// created if needed. Empty if there isn't one.
+std::string GetUserCachePath(const std::string& name);
+
+// As GetUserCachePath(), but for settings that should be kept, in the user's
+// configuration directory.
+std::string GetUserConfigPath(const std::string& name);
+
+// Reads all of |path| into |contents|.
+bool ReadFileContents(const std::string& path, std::vector<char>* contents);
+
+// Replaces |path| with |size| bytes of |data|. It's written elsewhere first,
+// so something else reading it at the same time, e.g. another instance
+// starting up, sees either the old contents or the new, but never half.
+bool WriteFileAtomically(const std::string& path,
+                         const void* data,
+                         size_t size);
+
+#endif  // USER_FILES_H_
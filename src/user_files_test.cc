@@ -0,0 +1,76 @@
+// Copyright 2016 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "user_files.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include "core.h"
+
+namespace {
+
+const char kTestFile[] = "user_files_test.tmp";
+
+std::string ReadAll(const std::string& path) {
+  std::vector<char> contents;
+  if (!ReadFileContents(path, &contents))
+    return "<failed>";
+  return std::string(contents.begin(), contents.end());
+}
+
+// Writes kTestFile full of the letter in |user_data| over and over.
+int32_t WriteRepeatedly(void* user_data) {
+  const std::string contents(64 * 1024, *static_cast<char*>(user_data));
+  for (int i = 0; i < 50; ++i) {
+    if (!WriteFileAtomically(kTestFile, contents.data(), contents.size()))
+      return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
+TEST(UserFiles, WriteAndRead) {
+  const std::string first = "first";
+  ASSERT_TRUE(WriteFileAtomically(kTestFile, first.data(), first.size()));
+  EXPECT_EQ(first, ReadAll(kTestFile));
+
+  // Replacing it leaves nothing of the old contents, or the temporary file.
+  const std::string second("a\0b", 3);
+  ASSERT_TRUE(WriteFileAtomically(kTestFile, second.data(), second.size()));
+  EXPECT_EQ(second, ReadAll(kTestFile));
+  FILE* temp = fopen((std::string(kTestFile) + ".tmp").c_str(), "rb");
+  EXPECT_FALSE(temp);
+  if (temp)
+    fclose(temp);
+
+  ASSERT_TRUE(WriteFileAtomically(kTestFile, "", 0));
+  EXPECT_EQ("", ReadAll(kTestFile));
+
+  remove(kTestFile);
+}
+
+TEST(UserFiles, ConcurrentWriters) {
+  char letters[] = "abcd";
+  Thread threads[4];
+  for (int i = 0; i < 4; ++i)
+    threads[i].Start(&WriteRepeatedly, &letters[i], "writer");
+  for (Thread& thread : threads)
+    EXPECT_EQ(0, thread.Join());
+
+  // Whoever was last, it's all theirs.
+  std::string contents = ReadAll(kTestFile);
+  ASSERT_EQ(64u * 1024, contents.size());
+  EXPECT_EQ(std::string(contents.size(), contents[0]), contents);
+  EXPECT_NE(std::string::npos, std::string("abcd").find(contents[0]));
+
+  remove(kTestFile);
+}
+
+TEST(UserFiles, ReadMissingFile) {
+  std::vector<char> contents;
+  EXPECT_FALSE(ReadFileContents("this_file_does_not_exist.tmp", &contents));
+}